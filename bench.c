@@ -0,0 +1,342 @@
+// bench.c
+// Microbenchmarks das primitivas de fs.c sobre uma imagem temporária.
+//
+//   gcc -O2 bench.c fs.c -o bench
+//   ./bench -o atual.csv                  # mede e grava resultados
+//   ./bench -o novo.csv -c atual.csv      # compara com uma base salva
+#include "fs.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+
+#define DEFAULT_OPS 2000
+
+typedef struct {
+    char primitive[32];
+    char param[16];
+    long value;
+    int ops;
+    double ops_per_sec;
+    uint64_t p50, p99, p999;
+} bench_result_t;
+
+static bench_result_t results[128];
+static int results_count = 0;
+static int base_ops = DEFAULT_OPS;
+static int real_sync = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, int n, double p) {
+    if (n == 0) return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+/* Consolida as latências de uma medição em um resultado */
+static void record(const char *primitive, const char *param, long value, uint64_t *lat, int n) {
+    if (results_count == (int)(sizeof(results) / sizeof(results[0]))) return;
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) total += lat[i];
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+
+    bench_result_t *r = &results[results_count++];
+    snprintf(r->primitive, sizeof(r->primitive), "%s", primitive);
+    snprintf(r->param, sizeof(r->param), "%s", param);
+    r->value = value;
+    r->ops = n;
+    r->ops_per_sec = total ? n / (total / 1e9) : 0;
+    r->p50 = percentile(lat, n, 0.50);
+    r->p99 = percentile(lat, n, 0.99);
+    r->p999 = percentile(lat, n, 0.999);
+
+    printf("%-22s %-6s %8ld %7d ops %12.0f ops/s  p50 %9lu ns  p99 %9lu ns  p999 %9lu ns\n",
+           r->primitive, r->param, r->value, r->ops, r->ops_per_sec,
+           (unsigned long)r->p50, (unsigned long)r->p99, (unsigned long)r->p999);
+    fflush(stdout);
+}
+
+/* Recria a imagem de disco do zero */
+static int fresh_image(void) {
+    if (disk) unmount_fs();
+    unlink(DISK_NAME);
+    if (init_fs() != 0) return -1;
+    set_deferred_sync(!real_sync);
+    return 0;
+}
+
+/* Cria 'count' arquivos vazios f0..fN em dir_inode */
+static int populate_dir(int dir_inode, int count) {
+    char name[MAX_NAMESIZE];
+    for (int i = 0; i < count; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        if (createFile(dir_inode, name, ROOT_UID) != 0) return -1;
+    }
+    return 0;
+}
+
+/* allocateBlock com o disco preenchido até 'fill' por cento */
+static void bench_allocate_block(int fill) {
+    if (fresh_image() != 0) return;
+    uint32_t to_fill = (uint64_t)computed_data_blocks * fill / 100;
+    if (to_fill > 0) allocateBlockRun(to_fill);
+
+    int n = base_ops;
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    for (int i = 0; i < n; i++) {
+        uint64_t t0 = now_ns();
+        int b = allocateBlock();
+        lat[i] = now_ns() - t0;
+        freeBlock(b);
+    }
+    record("allocateBlock", "fill%", fill, lat, n);
+    free(lat);
+}
+
+/* dirFindEntry e dirAddEntry em um diretório com 'entries' entradas */
+static void bench_dir(int entries) {
+    if (fresh_image() != 0) return;
+    if (createDirectory(ROOT_INODE, "d", ROOT_UID) != 0) return;
+    int dir;
+    if (dirFindEntry(ROOT_INODE, "d", FILE_DIRECTORY, &dir) != 0) return;
+    if (populate_dir(dir, entries) != 0) return;
+
+    int n = base_ops;
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    char name[MAX_NAMESIZE];
+    int found;
+    srand(42);
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "f%d", rand() % entries);
+        uint64_t t0 = now_ns();
+        dirFindEntry(dir, name, FILE_REGULAR, &found);
+        lat[i] = now_ns() - t0;
+    }
+    record("dirFindEntry", "dirsz", entries, lat, n);
+
+    // adições: poucas em relação ao tamanho para não mudar a escala medida
+    int adds = entries < n ? entries : n;
+    int target;
+    if (dirFindEntry(dir, "f0", FILE_REGULAR, &target) != 0) { free(lat); return; }
+    for (int i = 0; i < adds; i++) {
+        snprintf(name, sizeof(name), "a%d", i);
+        uint64_t t0 = now_ns();
+        dirAddEntry(dir, name, FILE_REGULAR, target);
+        lat[i] = now_ns() - t0;
+    }
+    record("dirAddEntry", "dirsz", entries, lat, adds);
+    free(lat);
+}
+
+/* resolvePath de um caminho com 'depth' níveis */
+static void bench_resolve(int depth) {
+    if (fresh_image() != 0) return;
+    char path[4096] = "~";
+    int cur = ROOT_INODE;
+    for (int i = 0; i < depth; i++) {
+        if (createDirectory(cur, "d", ROOT_UID) != 0) return;
+        if (dirFindEntry(cur, "d", FILE_DIRECTORY, &cur) != 0) return;
+        strcat(path, "/d");
+    }
+
+    int n = base_ops;
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    int out;
+    for (int i = 0; i < n; i++) {
+        uint64_t t0 = now_ns();
+        resolvePath(path, ROOT_INODE, &out);
+        lat[i] = now_ns() - t0;
+    }
+    record("resolvePath", "depth", depth, lat, n);
+    free(lat);
+}
+
+/* addContentToInode e readContentFromInode com arquivos de 'size' bytes */
+static void bench_content(size_t size) {
+    if (fresh_image() != 0) return;
+
+    // arquivos grandes consomem inodes de extensão: limita o total escrito
+    int n = base_ops;
+    size_t budget = 16u * 1024 * 1024;
+    if ((size_t)n * size > budget) n = budget / size;
+    if (n < 10) n = 10;
+
+    char *data = malloc(size + 1);
+    char *buffer = malloc(size + 1);
+    int *inodes = malloc(n * sizeof(int));
+    uint64_t *lat = malloc(n * sizeof(uint64_t));
+    for (size_t i = 0; i < size; i++) data[i] = 'a' + i % 26;
+
+    char name[MAX_NAMESIZE];
+    int done = 0;
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        if (createFile(ROOT_INODE, name, ROOT_UID) != 0) break;
+        if (dirFindEntry(ROOT_INODE, name, FILE_REGULAR, &inodes[i]) != 0) break;
+        uint64_t t0 = now_ns();
+        if (addContentToInode(inodes[i], data, size, ROOT_UID) != 0) break;
+        lat[i] = now_ns() - t0;
+        done++;
+    }
+    record("addContentToInode", "bytes", size, lat, done);
+
+    size_t got;
+    for (int i = 0; i < done; i++) {
+        uint64_t t0 = now_ns();
+        readContentFromInode(inodes[i], buffer, size + 1, &got, ROOT_UID);
+        lat[i] = now_ns() - t0;
+    }
+    record("readContentFromInode", "bytes", size, lat, done);
+
+    free(data); free(buffer); free(inodes); free(lat);
+}
+
+/* Custo dos checksums: CRC32C de um bloco isolado e readBlocks de 'count'
+ * blocos contíguos com e sem verificação */
+static void bench_checksum(int count) {
+    if (fresh_image() != 0) return;
+    int first = allocateBlockRun(count);
+    if (first < 0) return;
+
+    char *buffer = malloc((size_t)count * BLOCK_SIZE);
+    uint64_t *lat = malloc(base_ops * sizeof(uint64_t));
+    for (size_t i = 0; i < (size_t)count * BLOCK_SIZE; i++) buffer[i] = 'a' + i % 26;
+    if (writeBlocks(first, count, buffer) != 0) goto out;
+
+    if (count == 1) {
+        volatile uint32_t sink = 0;
+        for (int i = 0; i < base_ops; i++) {
+            uint64_t t0 = now_ns();
+            sink ^= crc32c(0, buffer, BLOCK_SIZE);
+            lat[i] = now_ns() - t0;
+        }
+        (void)sink;
+        record("crc32c", crc32c_backend(), BLOCK_SIZE, lat, base_ops);
+    }
+
+    for (int verify = 0; verify <= 1; verify++) {
+        fs_verify_checksums = verify;
+        for (int i = 0; i < base_ops; i++) {
+            uint64_t t0 = now_ns();
+            readBlocks(first, count, buffer);
+            lat[i] = now_ns() - t0;
+        }
+        record(verify ? "readBlocks+crc" : "readBlocks", "blocks", count, lat, base_ops);
+    }
+    fs_verify_checksums = 1;
+out:
+    free(buffer); free(lat);
+}
+
+static void write_results(FILE *f) {
+    fprintf(f, "primitive,param,value,ops,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+    for (int i = 0; i < results_count; i++) {
+        bench_result_t *r = &results[i];
+        fprintf(f, "%s,%s,%ld,%d,%.0f,%lu,%lu,%lu\n", r->primitive, r->param, r->value, r->ops,
+                r->ops_per_sec, (unsigned long)r->p50, (unsigned long)r->p99, (unsigned long)r->p999);
+    }
+    fclose(f);
+}
+
+/* Compara com uma base salva; retorna o número de regressões */
+static int compare_baseline(FILE *f, double tolerance) {
+    char line[512];
+    int regressions = 0;
+    printf("\n%-22s %-6s %8s %14s %14s %8s\n", "primitive", "param", "value", "base ops/s", "ops/s", "delta");
+    if (!fgets(line, sizeof(line), f)) { fclose(f); return 0; } // cabeçalho
+    while (fgets(line, sizeof(line), f)) {
+        bench_result_t b;
+        unsigned long p50, p99, p999;
+        if (sscanf(line, "%31[^,],%15[^,],%ld,%d,%lf,%lu,%lu,%lu", b.primitive, b.param, &b.value,
+                   &b.ops, &b.ops_per_sec, &p50, &p99, &p999) != 8) continue;
+
+        for (int i = 0; i < results_count; i++) {
+            bench_result_t *r = &results[i];
+            if (strcmp(r->primitive, b.primitive) || strcmp(r->param, b.param) || r->value != b.value)
+                continue;
+            double delta = b.ops_per_sec > 0 ? (r->ops_per_sec / b.ops_per_sec - 1.0) * 100.0 : 0;
+            int slower = delta < -tolerance ||
+                         (p99 > 0 && r->p99 > p99 * (1.0 + tolerance / 100.0));
+            printf("%-22s %-6s %8ld %14.0f %14.0f %+7.1f%%%s\n", r->primitive, r->param, r->value,
+                   b.ops_per_sec, r->ops_per_sec, delta, slower ? "  REGRESSÃO" : "");
+            regressions += slower;
+        }
+    }
+    fclose(f);
+    return regressions;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s [-o resultados.csv] [-c base.csv] [-t tolerancia%%] [-n ops] [-s]\n", prog);
+    fprintf(stderr, "  -s  mantém fsync por escrita (padrão: sincronização adiada)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = NULL, *baseline_path = NULL;
+    double tolerance = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tolerance = atof(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) base_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0) real_sync = 1;
+        else { usage(argv[0]); return 2; }
+    }
+    if (base_ops < 10) base_ops = 10;
+
+    // os arquivos de resultado são abertos antes de trocar de diretório
+    FILE *out = NULL, *baseline = NULL;
+    if (out_path && !(out = fopen(out_path, "w"))) { perror(out_path); return 2; }
+    if (baseline_path && !(baseline = fopen(baseline_path, "r"))) { perror(baseline_path); return 2; }
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return 2;
+
+    char scratch[] = "/tmp/fsbench.XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        perror("Erro ao criar diretório temporário");
+        return 2;
+    }
+    fs_verbose = 0;
+
+    int fills[] = {0, 50, 90, 99};
+    for (size_t i = 0; i < sizeof(fills) / sizeof(fills[0]); i++) bench_allocate_block(fills[i]);
+
+    int dir_sizes[] = {16, 128, 1024, 8192};
+    for (size_t i = 0; i < sizeof(dir_sizes) / sizeof(dir_sizes[0]); i++) bench_dir(dir_sizes[i]);
+
+    int depths[] = {1, 4, 16, 64};
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) bench_resolve(depths[i]);
+
+    size_t sizes[] = {64, 4096, 65536, 1048576};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) bench_content(sizes[i]);
+
+    int runs[] = {1, 8, 64};
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) bench_checksum(runs[i]);
+
+    unmount_fs();
+    unlink(DISK_NAME);
+    if (chdir(cwd) == 0) rmdir(scratch);
+
+    if (out) write_results(out);
+    if (baseline) {
+        int regressions = compare_baseline(baseline, tolerance);
+        if (regressions > 0) {
+            printf("\n%d regressão(ões) acima de %.1f%%\n", regressions, tolerance);
+            return 1;
+        }
+    }
+    return 0;
+}
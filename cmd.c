@@ -6,11 +6,104 @@
 
 #define MAX_INPUT 256
 
-int main() {
+static FILE *command_log = NULL;
+
+/* Grava a linha no log de comandos (-l), para reprodução com o workload */
+static void log_command(const char *line) {
+    if (!command_log) return;
+    size_t len = strcspn(line, "\n");
+    if (len == 0) return;
+    fprintf(command_log, "%.*s\n", (int)len, line);
+    fflush(command_log);
+}
+
+/* Modo batch: executa os comandos de um script (ou stdin) sem prompt.
+ * Os metadados só são gravados a cada sync_every comandos (0 = só no fim).
+ * Retorna o número de comandos que falharam. */
+static int run_batch(FILE *script, int sync_every) {
+    int current_inode = 0;
+    int uid = ROOT_UID;
+    char input[MAX_INPUT];
+    char line_copy[MAX_INPUT];
+    int line_no = 0, executed = 0, failures = 0;
+
+    set_deferred_sync(1);
+
+    while (fgets(input, MAX_INPUT, script)) {
+        line_no++;
+
+        // ignora linhas vazias e comentários
+        char *p = input;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\n' || *p == '\0' || *p == '#') continue;
+
+        strncpy(line_copy, p, MAX_INPUT - 1);
+        line_copy[MAX_INPUT - 1] = '\0';
+        line_copy[strcspn(line_copy, "\n")] = 0;
+
+        log_command(p);
+        int res = cmd_exec(p, &current_inode, &uid);
+        if (res == 1) break;
+        if (res != 0) {
+            fprintf(stderr, "linha %d: falha em '%s'\n", line_no, line_copy);
+            failures++;
+        }
+
+        if (sync_every > 0 && ++executed % sync_every == 0) flush_fs();
+    }
+
+    set_deferred_sync(0);
+    return failures;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s                              (modo interativo)\n", prog);
+    fprintf(stderr, "     %s -b <script|-> [-n N] [-q]    (modo batch, '-' lê de stdin;\n", prog);
+    fprintf(stderr, "                                       -n sincroniza a cada N comandos;\n");
+    fprintf(stderr, "                                       -q omite as mensagens [INFO])\n");
+    fprintf(stderr, "     -l <arquivo>                      grava os comandos executados\n");
+}
+
+int main(int argc, char *argv[]) {
     int current_inode = 0; // inode raiz
-    char user[10] = "root";  // usuário fixo para testes
+    int uid = ROOT_UID;      // sessão começa como root
     char input[MAX_INPUT];
 
+    const char *script_path = NULL;
+    int sync_every = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            script_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            sync_every = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-q") == 0) {
+            fs_verbose = 0;
+        }
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            command_log = fopen(argv[++i], "a");
+            if (!command_log) {
+                perror("Erro ao abrir log de comandos");
+                return 2;
+            }
+        }
+        else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *script = NULL;
+    if (script_path) {
+        script = strcmp(script_path, "-") == 0 ? stdin : fopen(script_path, "r");
+        if (!script) {
+            perror("Erro ao abrir script");
+            return 2;
+        }
+    }
+
     if (access(DISK_NAME, F_OK) == 0) {
     // Disco existe → montar
     if (mount_fs() != 0) {
@@ -25,99 +118,25 @@ int main() {
         }
     }
 
+    if (script) {
+        int failures = run_batch(script, sync_every);
+        if (script != stdin) fclose(script);
+        unmount_fs();
+        if (failures) fprintf(stderr, "%d comando(s) falharam\n", failures);
+        return failures ? 1 : 0;
+    }
+
     printf("MiniFS Terminal. Digite 'exit' para sair.\n");
 
     while (1) {
-        printf("%s@[%s]> ", user, inode_table[current_inode].name); 
+        printf("%s@[%s]> ", userName(uid), inode_meta[current_inode].name);
         if (!fgets(input, MAX_INPUT, stdin)) break;
 
-        // Remove \n final
-        input[strcspn(input, "\n")] = 0;
-
-        // Sair
-        if (strcmp(input, "exit") == 0) break;
-
-        // Parse do comando
-        char *cmd = strtok(input, " ");
-        char *arg1 = strtok(NULL, " ");
-        char *arg2 = strtok(NULL, " ");
-        char *arg3 = strtok(NULL, "");
-        //char *arg4 = strtok(NULL, " ");
-
-        if (!cmd) continue;
-        
-
-        if (strcmp(cmd, "cd") == 0 && arg1) {
-            cmd_cd(&current_inode, arg1);
-        }
-        else if (strcmp(cmd, "mkdir") == 0 && arg1) {
-            cmd_mkdir(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "touch") == 0 && arg1) {
-            cmd_touch(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "rm") == 0 && arg1) {
-            cmd_rm(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "clear") == 0) {
-            system("clear");
-        }
-        else if (strcmp(cmd, "rmdir") == 0 && arg1) {
-            cmd_rmdir(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "echo") == 0 && arg1) {
-            char *content = arg1;
-            char *redir = arg2; // > ou >>
-            char *filename = arg3;
-
-            if (redir && filename && content) {
-                if (strcmp(redir, ">") == 0) {
-                    cmd_echo_arrow(current_inode, filename, content, user);
-                }
-                else if (strcmp(redir, ">>") == 0) {
-                    cmd_echo_arrow_arrow(current_inode, filename, content, user);
-                }
-            } else {
-                printf("Falha: echo conteudo >|>> arquivo\n");
-            }
-            
-        }
-        else if (strcmp(cmd, "cat") == 0 && arg1) {
-            cmd_cat(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "ls") == 0) {
-            if (arg1 && strcmp(arg1, "-l") == 0) {
-                cmd_ls(current_inode, arg2? arg2 : ".", user, 1);
-            }
-            else {
-                cmd_ls(current_inode, arg1? arg1 : ".", user, 0);
-            }
-        }
-        else if (strcmp(cmd, "cp") == 0 && arg1 && arg2) {
-            cmd_cp(current_inode, ".", arg1, ".", arg2, user);
-        }
-        else if (strcmp(cmd, "mv") == 0 && arg1 && arg2) {
-            cmd_mv(current_inode, ".", arg1, ".", arg2, user);
-        }
-        else if (strcmp(cmd, "ln") == 0 && arg1 && strcmp(arg1, "-s") == 0 && arg2 && arg3) {
-            cmd_ln_s(current_inode, arg2, arg3, user);
-        }
-        else if (strcmp(cmd, "su") == 0 && arg1){
-            strncpy(user, arg1, 10);
-        }
-        else if (strcmp(cmd, "unlink") == 0 && arg1){
-            cmd_unlink(current_inode, arg1, user);
-        }
-        else if (strcmp(cmd, "df") == 0){
-            cmd_df();
-        }
-        else {
-            printf("Comando não reconhecido\n");
-        }
+        log_command(input);
+        if (cmd_exec(input, &current_inode, &uid) == 1) break;
     }
 
     printf("Saindo...\n");
     unmount_fs();
     return 0;
 }
-
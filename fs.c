@@ -1,3 +1,4 @@
+#define _GNU_SOURCE   /* fallocate(FALLOC_FL_PUNCH_HOLE) */
 #include "fs.h"
 #include <string.h>
 #include <errno.h>
@@ -9,25 +10,315 @@
 #include <time.h>
 #include <stdlib.h>
 #include <math.h>
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <fnmatch.h>
 
 /* ---- Variáveis globais ---- */
 unsigned char *block_bitmap = NULL;
 unsigned char *inode_bitmap = NULL;
 inode_t *inode_table = NULL;
+inode_meta_t *inode_meta = NULL;
+fs_user_table_t *user_table = NULL;
+uint16_t *block_refs = NULL;
+dedup_entry_t *dedup_index = NULL;
+uint32_t *block_crc = NULL;
+inode_usage_t *inode_usage = NULL;
+fs_snapshot_table_t *snapshot_table = NULL;
+int fs_verify_checksums = 1;
 FILE *disk = NULL;
 
 /* Layout do FS */
 off_t off_block_bitmap = 0;
 off_t off_inode_bitmap = 0;
 off_t off_inode_table = 0;
+off_t off_user_table = 0;
+off_t off_inode_meta = 0;
+off_t off_dedup = 0;
+off_t off_crc = 0;
+off_t off_usage = 0;
+off_t off_snapshots = 0;
 off_t off_data_region = 0;
 
 size_t computed_block_bitmap_bytes = 0;
 size_t computed_inode_bitmap_bytes = 0;
 size_t computed_inode_table_bytes = 0;
+size_t computed_inode_meta_bytes = 0;
+size_t computed_user_table_bytes = 0;
+size_t computed_dedup_bytes = 0;
+size_t computed_crc_bytes = 0;
+size_t computed_usage_bytes = 0;
+size_t computed_snapshot_bytes = 0;
 uint32_t computed_meta_blocks = 0;
 uint32_t computed_data_blocks = 0;
 
+/* Mensagens [INFO] de montagem; desligadas quando stdout carrega dados */
+int fs_verbose = 1;
+
+/* Sincronização adiada: sync_fs apenas marca pendência até flush_fs */
+static int sync_deferred = 0;
+static int sync_pending = 0;
+
+/* Imagens antigas não têm o campo state: o header acaba antes do bitmap */
+static int header_has_state = 0;
+static uint32_t fs_features = 0;    /* FS_FEAT_* do volume montado */
+
+/* Com um snapshot aberto (snapshotEnter), as tabelas globais apontam para a
+ * imagem dele e nada pode ser gravado por cima dos metadados vivos */
+static int snapshot_view = 0;
+
+/* ---- Estatísticas de execução ---- */
+fs_stats_t fs_stats;
+
+const char *const fs_cmd_names[STAT_CMD_COUNT] = {
+    "-", "cd", "mkdir", "touch", "echo >", "echo >>", "cat", "cp", "mv",
+    "ln -s", "ls", "rm", "rmdir", "unlink", "df", "import", "export", "fsck",
+    "useradd", "compress", "dedup", "discard", "trim", "snapshot", "du", "find",
+    "defrag", "truncate", "fallocate", "write"
+};
+
+/* Contadores são atualizados atomicamente (relaxed): custo de um add */
+#define STAT_ADD(field, n) __atomic_fetch_add(&fs_stats.field, (uint64_t)(n), __ATOMIC_RELAXED)
+
+static uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Bucket do histograma: 0 para < 1us, i para [2^(i-1), 2^i) us */
+static int stats_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int b = 0;
+    while (us && b < STAT_LAT_BUCKETS - 1) { us >>= 1; b++; }
+    return b;
+}
+
+static void stats_cmd_done(fs_cmd_id_t id, uint64_t start, int result) {
+    uint64_t elapsed = stats_now() - start;
+    STAT_ADD(cmd_calls[id], 1);
+    if (result != 0) STAT_ADD(cmd_errors[id], 1);
+    STAT_ADD(cmd_total_ns[id], elapsed);
+    STAT_ADD(cmd_latency[id][stats_bucket(elapsed)], 1);
+}
+
+/* Zera todos os contadores e histogramas */
+void reset_stats(void) {
+    memset(&fs_stats, 0, sizeof(fs_stats));
+}
+
+/* ---- Trace de E/S por bloco ---- */
+/* Ring buffer de registros binários; quando cheio, sobrescreve os mais antigos */
+static trace_record_t *trace_ring = NULL;
+static uint32_t trace_capacity = 0;
+static uint64_t trace_head = 0;        /* total de registros já gravados */
+static uint64_t trace_epoch = 0;       /* instante de trace_start */
+static int trace_enabled = 0;
+static fs_cmd_id_t current_cmd = STAT_CMD_NONE;
+
+static void trace_record(trace_op_t op, uint32_t target, uint32_t size, uint64_t start) {
+    uint64_t now = stats_now();
+    uint64_t slot = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+    trace_record_t *r = &trace_ring[slot % trace_capacity];
+    r->timestamp_ns = start - trace_epoch;
+    r->target = target;
+    r->size = size;
+    r->latency_ns = (now - start) > UINT32_MAX ? UINT32_MAX : (uint32_t)(now - start);
+    r->op = op;
+    r->cmd = current_cmd;
+    r->reserved = 0;
+}
+
+/* Liga o trace com espaço para 'capacity' registros (0 = padrão) */
+int trace_start(uint32_t capacity) {
+    if (capacity == 0) capacity = TRACE_DEFAULT_RECORDS;
+    trace_enabled = 0;
+    if (capacity != trace_capacity) {
+        trace_record_t *ring = realloc(trace_ring, (size_t)capacity * sizeof(trace_record_t));
+        if (!ring) return -1;
+        trace_ring = ring;
+        trace_capacity = capacity;
+    }
+    trace_head = 0;
+    trace_epoch = stats_now();
+    trace_enabled = 1;
+    return 0;
+}
+
+/* Desliga o trace, mantendo o buffer para trace_dump */
+void trace_stop(void) {
+    trace_enabled = 0;
+}
+
+/* Grava os registros do buffer (em ordem cronológica) em um arquivo */
+int trace_dump(const char *path) {
+    if (!trace_ring || !path) return -1;
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    uint64_t head = trace_head;
+    uint64_t count = head < trace_capacity ? head : trace_capacity;
+    trace_file_header_t header = {0};
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(trace_record_t);
+    header.block_size = BLOCK_SIZE;
+    header.count = count;
+    header.dropped = head - count;
+
+    int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    for (uint64_t i = head - count; ok && i < head; i++)
+        ok = fwrite(&trace_ring[i % trace_capacity], sizeof(trace_record_t), 1, f) == 1;
+    if (fclose(f) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+/* ---- E/S posicional no arquivo de disco ---- */
+/* pread/pwrite não dependem da posição do FILE*, então leituras e escritas
+ * de metadados e de dados não interferem entre si */
+static int diskRead(void *buffer, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t r = pread(fileno(disk), (char *)buffer + done, len - done, offset + done);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        done += r;
+    }
+    STAT_ADD(bytes_read, len);
+    return 0;
+}
+
+static int diskWrite(const void *buffer, size_t len, off_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = pwrite(fileno(disk), (const char *)buffer + done, len - done, offset + done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        done += w;
+    }
+    STAT_ADD(bytes_written, len);
+    return 0;
+}
+
+static void diskSync(void) {
+    STAT_ADD(fsyncs, 1);
+    fsync(fileno(disk));
+}
+
+/* ---- Descarte de blocos livres (PUNCH_HOLE) ---- */
+/* Com FS_FEAT_DISCARD, freeBlock enfileira as faixas liberadas e flush_fs,
+ * depois que o bitmap já está no disco, abre buracos nelas no disk.dat para
+ * o host recuperar o espaço. Só páginas do host inteiramente livres são
+ * descartadas; blocos realocados desde a liberação ficam intactos. */
+#define DISCARD_MAX_RANGES 1024
+
+typedef struct {
+    uint32_t start, count;
+} discard_range_t;
+
+static discard_range_t discard_queue[DISCARD_MAX_RANGES];
+static uint32_t discard_pending = 0;
+static int discard_overflow = 0;    /* fila cheia: o próximo flush varre o bitmap */
+
+static void discardQueue(uint32_t block) {
+    if (discard_overflow) return;
+    if (discard_pending) {
+        discard_range_t *last = &discard_queue[discard_pending - 1];
+        if (block == last->start + last->count) { last->count++; return; }
+        if (block + 1 == last->start) { last->start--; last->count++; return; }
+    }
+    if (discard_pending == DISCARD_MAX_RANGES) {
+        discard_overflow = 1;
+        return;
+    }
+    discard_queue[discard_pending].start = block;
+    discard_queue[discard_pending].count = 1;
+    discard_pending++;
+}
+
+/* Granularidade do descarte: o bloco do sistema de arquivos do host */
+static off_t discardPage(void) {
+    struct stat st;
+    if (fstat(fileno(disk), &st) != 0 || st.st_blksize <= BLOCK_SIZE) return BLOCK_SIZE;
+    return (st.st_blksize / BLOCK_SIZE) * BLOCK_SIZE;
+}
+
+static int discardPunch(off_t offset, off_t len) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    return fallocate(fileno(disk), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, len);
+#else
+    (void)offset; (void)len;
+    errno = EOPNOTSUPP;
+    return -1;
+#endif
+}
+
+/* Descarta as páginas do host inteiramente livres que tocam os blocos
+ * [first, end); retorna quantos blocos foram descartados, ou -1 se o
+ * host não suporta buracos */
+static long discardRange(uint32_t first, uint32_t end) {
+    off_t page = discardPage();
+    off_t data_end = off_data_region + (off_t)computed_data_blocks * BLOCK_SIZE;
+    off_t lo = off_data_region + (off_t)first * BLOCK_SIZE;
+    off_t hi = off_data_region + (off_t)end * BLOCK_SIZE;
+    lo -= lo % page;
+    if (lo < off_data_region) lo += page;   // a página tem metadados
+    hi += (page - hi % page) % page;
+    if (hi > data_end) hi = data_end - data_end % page;
+
+    long discarded = 0;
+    off_t run = -1;
+    for (off_t p = lo; p <= hi; p += page) {
+        int free = p + page <= hi;
+        for (uint32_t b = (p - off_data_region) / BLOCK_SIZE;
+             free && b < (p + page - off_data_region) / BLOCK_SIZE; b++)
+            free = !(block_bitmap[b / 8] & (1 << (b % 8)));
+        if (free) {
+            if (run < 0) run = p;
+            continue;
+        }
+        if (run < 0) continue;
+        if (discardPunch(run, p - run) != 0) return -1;
+        discarded += (p - run) / BLOCK_SIZE;
+        run = -1;
+    }
+    STAT_ADD(blocks_discarded, discarded);
+    return discarded;
+}
+
+/* Esvazia a fila; chamado por flush_fs com os metadados já gravados */
+static void discardFlush(void) {
+    if (discard_overflow) {
+        discardRange(1, computed_data_blocks);
+    } else {
+        for (uint32_t i = 0; i < discard_pending; i++) {
+            if (discardRange(discard_queue[i].start,
+                             discard_queue[i].start + discard_queue[i].count) < 0) break;
+        }
+    }
+    discard_pending = 0;
+    discard_overflow = 0;
+}
+
+/* Grava o estado de montagem no header (limpo só após unmount_fs) */
+static void writeState(uint32_t state) {
+    if (!header_has_state) return;
+    diskWrite(&state, sizeof(state), offsetof(fs_header_t, state));
+    diskSync();
+}
+
+static void info(const char *fmt, ...) {
+    if (!fs_verbose) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+}
+
 /* ---- Calcula layout do FS ---- */
 static void compute_layout(void) {
     size_t inode_bmap_bytes = (MAX_INODES + 7) / 8;
@@ -43,55 +334,176 @@ static void compute_layout(void) {
     computed_block_bitmap_bytes = bmap_bytes;
     computed_inode_bitmap_bytes = inode_bmap_bytes;
     computed_inode_table_bytes = inode_tbl_bytes;
+    computed_inode_meta_bytes = MAX_INODES * sizeof(inode_meta_t);
+    computed_user_table_bytes = sizeof(fs_user_table_t);
+    computed_dedup_bytes = MAX_BLOCKS * sizeof(uint16_t) + DEDUP_SLOTS * sizeof(dedup_entry_t);
+    computed_crc_bytes = MAX_BLOCKS * sizeof(uint32_t);
+    computed_usage_bytes = MAX_INODES * sizeof(inode_usage_t);
+    computed_snapshot_bytes = sizeof(fs_snapshot_table_t);
+
+    /* Offsets; a tabela de inodes começa em fronteira de página para
+     * poder ser mapeada e aconselhada (madvise) separadamente */
+    off_block_bitmap = sizeof(fs_header_t);
+    off_inode_bitmap = off_block_bitmap + computed_block_bitmap_bytes;
+    off_user_table = off_inode_bitmap + computed_inode_bitmap_bytes;
+    off_user_table = (off_user_table + 7) & ~(off_t)7;
+    off_inode_table = off_user_table + computed_user_table_bytes;
+    off_inode_table = ((off_inode_table + META_PAGE_SIZE - 1) / META_PAGE_SIZE) * META_PAGE_SIZE;
+    off_inode_meta = off_inode_table + computed_inode_table_bytes;
+    off_dedup = off_inode_meta + computed_inode_meta_bytes;
+    off_dedup = (off_dedup + 7) & ~(off_t)7;
+    off_crc = off_dedup + computed_dedup_bytes;
+    off_usage = off_crc + computed_crc_bytes;
+    off_snapshots = off_usage + computed_usage_bytes;
+    off_data_region = off_snapshots + computed_snapshot_bytes;
+    off_data_region = ((off_data_region + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE;
 
-    /* Número de blocos ocupados pela meta-região */
-    computed_meta_blocks = (computed_block_bitmap_bytes +
-                            computed_inode_bitmap_bytes +
-                            computed_inode_table_bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    /* Número de blocos ocupados pela meta-região (header incluído) */
+    computed_meta_blocks = off_data_region / BLOCK_SIZE;
 
     /* Blocos de dados efetivos */
     computed_data_blocks = MAX_BLOCKS - computed_meta_blocks;
+}
 
-    /* Offsets */
-    off_block_bitmap = sizeof(fs_header_t);
-    off_inode_bitmap = off_block_bitmap + computed_block_bitmap_bytes;
-    off_inode_table = off_inode_bitmap + computed_inode_bitmap_bytes;
-    off_data_region = off_inode_table + computed_inode_table_bytes;
-    off_data_region = ((off_data_region + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE;
+/* ---- Região de metadados ---- */
+/* Header, bitmaps e tabela de inodes são mapeados do disco (MAP_SHARED):
+ * montar não lê nada além do header, as páginas são carregadas no primeiro
+ * acesso e o kernel descarta as frias. Imagens antigas com a tabela de
+ * inodes desalinhada são carregadas inteiras na memória, como antes. */
+static void *meta_map = NULL;
+static size_t meta_map_len = 0;
+
+static void adviseInodeTable(int advice) {
+    if (!meta_map || off_inode_table % META_PAGE_SIZE) return;
+    madvise((char *)meta_map + off_inode_table, computed_inode_table_bytes, advice);
+}
+
+static int mapMetadata(void) {
+    struct stat st;
+    if (off_inode_table % _Alignof(inode_t) != 0 || off_inode_meta % _Alignof(inode_meta_t) != 0 ||
+        off_user_table % _Alignof(fs_user_table_t) != 0 || off_dedup % _Alignof(dedup_entry_t) != 0 ||
+        off_crc % _Alignof(uint32_t) != 0 || off_usage % _Alignof(inode_usage_t) != 0 ||
+        off_snapshots % _Alignof(fs_snapshot_table_t) != 0)
+        return -1;
+    if (fstat(fileno(disk), &st) != 0 || st.st_size < off_data_region) return -1;
+
+    void *map = mmap(NULL, off_data_region, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(disk), 0);
+    if (map == MAP_FAILED) return -1;
+    meta_map = map;
+    meta_map_len = off_data_region;
+    block_bitmap = (unsigned char *)map + off_block_bitmap;
+    inode_bitmap = (unsigned char *)map + off_inode_bitmap;
+    inode_table = (inode_t *)((char *)map + off_inode_table);
+    inode_meta = (inode_meta_t *)((char *)map + off_inode_meta);
+    user_table = (fs_user_table_t *)((char *)map + off_user_table);
+    block_refs = (uint16_t *)((char *)map + off_dedup);
+    dedup_index = (dedup_entry_t *)(block_refs + MAX_BLOCKS);
+    block_crc = (uint32_t *)((char *)map + off_crc);
+    inode_usage = (inode_usage_t *)((char *)map + off_usage);
+    snapshot_table = (fs_snapshot_table_t *)((char *)map + off_snapshots);
+    // buscas por índice: leitura antecipada só traria páginas frias
+    adviseInodeTable(MADV_RANDOM);
+    return 0;
+}
+
+/* Alternativa sem mmap: cópia completa em memória */
+static int loadMetadata(int from_disk) {
+    block_bitmap = calloc(1, computed_block_bitmap_bytes);
+    inode_bitmap = calloc(1, computed_inode_bitmap_bytes);
+    inode_table = calloc(1, computed_inode_table_bytes);
+    inode_meta = calloc(1, computed_inode_meta_bytes);
+    user_table = calloc(1, computed_user_table_bytes);
+    block_refs = calloc(1, computed_dedup_bytes);
+    block_crc = calloc(1, computed_crc_bytes);
+    inode_usage = calloc(1, computed_usage_bytes);
+    snapshot_table = calloc(1, computed_snapshot_bytes);
+    if (!block_bitmap || !inode_bitmap || !inode_table || !inode_meta || !user_table || !block_refs ||
+        !block_crc || !inode_usage || !snapshot_table)
+        return -1;
+    dedup_index = (dedup_entry_t *)(block_refs + MAX_BLOCKS);
+    if (!from_disk) return 0;
+    if (diskRead(block_bitmap, computed_block_bitmap_bytes, off_block_bitmap) != 0 ||
+        diskRead(inode_bitmap, computed_inode_bitmap_bytes, off_inode_bitmap) != 0 ||
+        diskRead(inode_table, computed_inode_table_bytes, off_inode_table) != 0 ||
+        diskRead(inode_meta, computed_inode_meta_bytes, off_inode_meta) != 0 ||
+        diskRead(user_table, computed_user_table_bytes, off_user_table) != 0 ||
+        diskRead(block_refs, computed_dedup_bytes, off_dedup) != 0 ||
+        diskRead(block_crc, computed_crc_bytes, off_crc) != 0 ||
+        diskRead(inode_usage, computed_usage_bytes, off_usage) != 0 ||
+        diskRead(snapshot_table, computed_snapshot_bytes, off_snapshots) != 0)
+        return -1;
+    return 0;
+}
+
+static void releaseMetadata(void) {
+    if (meta_map) {
+        munmap(meta_map, meta_map_len);
+        meta_map = NULL;
+    } else {
+        free(block_bitmap);
+        free(inode_bitmap);
+        free(inode_table);
+        free(inode_meta);
+        free(user_table);
+        free(block_refs);
+        free(block_crc);
+        free(inode_usage);
+        free(snapshot_table);
+    }
+    block_bitmap = NULL;
+    inode_bitmap = NULL;
+    inode_table = NULL;
+    inode_meta = NULL;
+    user_table = NULL;
+    block_refs = NULL;
+    dedup_index = NULL;
+    block_crc = NULL;
+    inode_usage = NULL;
+    snapshot_table = NULL;
+    discard_pending = 0;
+    discard_overflow = 0;
 }
 
 /* ---- Inicializa um novo filesystem ---- */
 int init_fs(void) {
     if (access(DISK_NAME, F_OK) == 0) {
-        printf("[INFO] Disco existente detectado. Montando FS...\n");
+        info("[INFO] Disco existente detectado. Montando FS...\n");
         return mount_fs();
     }
 
-    printf("[INFO] Inicializando novo filesystem...\n");
+    info("[INFO] Inicializando novo filesystem...\n");
     disk = fopen(DISK_NAME, "wb+");
     if (!disk) { perror("Erro ao criar disco"); return -1; }
 
     ftruncate(fileno(disk), DISK_SIZE_MB * 1024 * 1024);
     compute_layout();
 
-    block_bitmap = calloc(1, computed_block_bitmap_bytes);
-    inode_bitmap = calloc(1, computed_inode_bitmap_bytes);
-    inode_table = calloc(MAX_INODES, sizeof(inode_t));
-    if (!block_bitmap || !inode_bitmap || !inode_table) {
+    if (mapMetadata() != 0 && loadMetadata(0) != 0) {
         perror("Erro ao alocar memória para FS");
+        releaseMetadata();
         fclose(disk);
         return -1;
     }
 
+    /* Usuário e grupo root */
+    strcpy(user_table->users[ROOT_UID].name, "root");
+    user_table->users[ROOT_UID].gid = ROOT_GID;
+    strcpy(user_table->groups[ROOT_GID].name, "root");
+
+    /* Bloco 0 fica reservado: nos ponteiros de bloco, 0 significa "sem bloco" */
+    block_bitmap[0] |= 1;
+    groupsRecount();
+
     /* Cria diretório raiz */
     int root_inode = allocateInode();
     inode_table[root_inode].type = FILE_DIRECTORY;
     inode_table[root_inode].size = 0;
-    inode_table[root_inode].creation_date = time(NULL);
-    inode_table[root_inode].modification_date = time(NULL);
+    inode_meta[root_inode].creation_date = time(NULL);
+    inode_meta[root_inode].modification_date = time(NULL);
     inode_table[root_inode].permissions = PERM_ALL;
-    strcpy(inode_table[root_inode].name, "~");
-    strcpy(inode_table[root_inode].owner, "root");
+    strcpy(inode_meta[root_inode].name, "~");
+    inode_table[root_inode].uid = ROOT_UID;
+    inode_table[root_inode].gid = ROOT_GID;
     dirAddEntry(ROOT_INODE, ".", FILE_DIRECTORY, ROOT_INODE);
     dirAddEntry(ROOT_INODE, "..", FILE_DIRECTORY, ROOT_INODE);
     sync_inode(root_inode);
@@ -102,52 +514,64 @@ int init_fs(void) {
     header.block_bitmap_bytes = computed_block_bitmap_bytes;
     header.inode_bitmap_bytes = computed_inode_bitmap_bytes;
     header.inode_table_bytes = computed_inode_table_bytes;
+    header.inode_meta_bytes = computed_inode_meta_bytes;
+    header.user_table_bytes = computed_user_table_bytes;
+    header.dedup_bytes = computed_dedup_bytes;
+    header.crc_bytes = computed_crc_bytes;
+    header.usage_bytes = computed_usage_bytes;
+    header.snapshot_bytes = computed_snapshot_bytes;
     header.meta_blocks = computed_meta_blocks;
     header.data_blocks = computed_data_blocks;
     header.off_block_bitmap = off_block_bitmap;
     header.off_inode_bitmap = off_inode_bitmap;
     header.off_inode_table = off_inode_table;
+    header.off_user_table = off_user_table;
+    header.off_inode_meta = off_inode_meta;
+    header.off_dedup = off_dedup;
+    header.off_crc = off_crc;
+    header.off_usage = off_usage;
+    header.off_snapshots = off_snapshots;
     header.off_data_region = off_data_region;
+    header.state = FS_STATE_DIRTY;
+    header.features = fs_features = 0;
+    header_has_state = 1;
+
+    diskWrite(&header, sizeof(header), 0);
+
+    /* Escreve bitmaps e tabela de inodes (já estão no disco se mapeados) */
+    if (!meta_map) {
+        diskWrite(block_bitmap, computed_block_bitmap_bytes, off_block_bitmap);
+        diskWrite(inode_bitmap, computed_inode_bitmap_bytes, off_inode_bitmap);
+        diskWrite(inode_table, computed_inode_table_bytes, off_inode_table);
+        diskWrite(inode_meta, computed_inode_meta_bytes, off_inode_meta);
+        diskWrite(user_table, computed_user_table_bytes, off_user_table);
+        diskWrite(block_refs, computed_dedup_bytes, off_dedup);
+        diskWrite(block_crc, computed_crc_bytes, off_crc);
+        diskWrite(inode_usage, computed_usage_bytes, off_usage);
+        diskWrite(snapshot_table, computed_snapshot_bytes, off_snapshots);
+    }
+
+    info("[INFO] Filesystem criado com sucesso.\n\n");
 
-    fseek(disk, 0, SEEK_SET);
-    fwrite(&header, sizeof(header), 1, disk);
-    fflush(disk);
-
-    /* Escreve bitmaps e tabela de inodes */
-    // bitmap de blocos
-    fseek(disk, off_block_bitmap, SEEK_SET);
-    fwrite(block_bitmap, 1, computed_block_bitmap_bytes, disk);
-
-    // bitmap de inodes
-    fseek(disk, off_inode_bitmap, SEEK_SET);
-    fwrite(inode_bitmap, 1, computed_inode_bitmap_bytes, disk);
-
-    // tabela de inodes
-    fseek(disk, off_inode_table, SEEK_SET);
-    fwrite(inode_table, 1, computed_inode_table_bytes, disk);
-
-    printf("[INFO] Filesystem criado com sucesso.\n\n");
-
-    printf("[INFO] Disposição do disco:\n");
-    printf("[INFO]   |--Espaço para cabecalho: %ldB\n", sizeof(fs_header_t));
-    printf("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
-    printf("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
-    printf("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
-    printf("         |\n");
-    printf("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
-    printf("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
+    info("[INFO] Disposição do disco:\n");
+    info("[INFO]   |--Espaço para cabecalho: %ldB\n", sizeof(fs_header_t));
+    info("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
+    info("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
+    info("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
+    info("         |\n");
+    info("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
+    info("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
     return 0;
 }
 
 /* ---- Monta filesystem existente ---- */
 int mount_fs(void) {
-    printf("[INFO] Montando filesystem existente...\n");
+    info("[INFO] Montando filesystem existente...\n");
     disk = fopen(DISK_NAME, "rb+");
     if (!disk) { perror("Erro ao abrir disco"); return -1; }
 
     fs_header_t header;
-    fseek(disk, 0, SEEK_SET);
-    if (fread(&header, sizeof(header), 1, disk) != 1) {
+    if (diskRead(&header, sizeof(header), 0) != 0) {
         fprintf(stderr, "Erro ao ler header do FS.\n");
         fclose(disk);
         return -1;
@@ -159,87 +583,170 @@ int mount_fs(void) {
         return -1;
     }
 
+    /* Disco formatado com outra configuração (MAX_INODES, sizeof(inode_t)) */
+    if (header.inode_table_bytes != MAX_INODES * sizeof(inode_t) ||
+        header.inode_meta_bytes != MAX_INODES * sizeof(inode_meta_t) ||
+        header.user_table_bytes != sizeof(fs_user_table_t) ||
+        header.dedup_bytes != MAX_BLOCKS * sizeof(uint16_t) + DEDUP_SLOTS * sizeof(dedup_entry_t) ||
+        header.crc_bytes != MAX_BLOCKS * sizeof(uint32_t) ||
+        header.usage_bytes != MAX_INODES * sizeof(inode_usage_t) ||
+        header.snapshot_bytes != sizeof(fs_snapshot_table_t) ||
+        header.inode_bitmap_bytes != (MAX_INODES + 7) / 8) {
+        fprintf(stderr, "Disco formatado com layout incompatível.\n");
+        fclose(disk);
+        return -1;
+    }
+
     /* Restaura variáveis globais */
     computed_block_bitmap_bytes = header.block_bitmap_bytes;
     computed_inode_bitmap_bytes = header.inode_bitmap_bytes;
     computed_inode_table_bytes = header.inode_table_bytes;
+    computed_inode_meta_bytes = header.inode_meta_bytes;
+    computed_user_table_bytes = header.user_table_bytes;
+    computed_dedup_bytes = header.dedup_bytes;
+    computed_crc_bytes = header.crc_bytes;
+    computed_usage_bytes = header.usage_bytes;
+    computed_snapshot_bytes = header.snapshot_bytes;
     computed_meta_blocks = header.meta_blocks;
     computed_data_blocks = header.data_blocks;
     off_block_bitmap = header.off_block_bitmap;
     off_inode_bitmap = header.off_inode_bitmap;
     off_inode_table = header.off_inode_table;
+    off_user_table = header.off_user_table;
+    off_inode_meta = header.off_inode_meta;
+    off_dedup = header.off_dedup;
+    off_crc = header.off_crc;
+    off_usage = header.off_usage;
+    off_snapshots = header.off_snapshots;
     off_data_region = header.off_data_region;
+    header_has_state = header.off_block_bitmap >= sizeof(fs_header_t);
+    fs_features = header_has_state ? header.features : 0;
 
-    /* Aloca memória */
-    block_bitmap = malloc(computed_block_bitmap_bytes);
-    inode_bitmap = malloc(computed_inode_bitmap_bytes);
-    inode_table = malloc(computed_inode_table_bytes);
-    if (!block_bitmap || !inode_bitmap || !inode_table) {
-        perror("Erro ao alocar memória para FS");
+    /* Mapeia os metadados (ou, se não for possível, lê tudo do disco) */
+    if (mapMetadata() != 0 && loadMetadata(1) != 0) {
+        perror("Erro ao carregar metadados do FS");
+        releaseMetadata();
         fclose(disk);
         return -1;
     }
-
-    /* Lê conteúdo do disco */
-    // bitmap de blocos
-    fseek(disk, off_block_bitmap, SEEK_SET);
-    fread(block_bitmap, 1, computed_block_bitmap_bytes, disk);
-
-    // bitmap de inodes
-    fseek(disk, off_inode_bitmap, SEEK_SET);
-    fread(inode_bitmap, 1, computed_inode_bitmap_bytes, disk);
-
-    // tabela de inodes
-    fseek(disk, off_inode_table, SEEK_SET);
-    fread(inode_table, 1, computed_inode_table_bytes, disk);
-
-
-    printf("[INFO] Filesystem montado com sucesso!\n\n");
-
-    printf("[INFO] Disposição do disco:\n");
-    printf("[INFO]   |--Espaço para cabecalho: %ldB\n", sizeof(fs_header_t));
-    printf("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
-    printf("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
-    printf("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
-    printf("         |\n");
-    printf("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
-    printf("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
+    groupsRecount();
+
+    /* Sem desmontagem limpa registrada: verifica e repara antes de usar */
+    if (!header_has_state || header.state != FS_STATE_CLEAN) {
+        info("[INFO] Desmontagem incompleta detectada. Verificando consistência...\n");
+        fsck_report_t report;
+        int problems = fsck_fs(1, 0, &report);
+        if (problems < 0)
+            fprintf(stderr, "[fsck] verificação não concluída; execute 'fsck -r' depois da montagem\n");
+        if (problems > 0) {
+            fprintf(stderr, "[fsck] %d problema(s) corrigido(s): %u entradas, %u ponteiros, "
+                    "%u inodes órfãos, %u blocos perdidos, %u blocos não marcados, "
+                    "%u contagens de dedup, %u usos de subárvore, %u snapshots\n", problems,
+                    report.bad_entries, report.bad_pointers, report.orphan_inodes,
+                    report.leaked_blocks, report.unmarked_blocks, report.bad_refcounts,
+                    report.bad_usage, report.bad_snapshots);
+        }
+        info("[INFO] Verificação concluída em %.1f ms.\n", report.elapsed_ns / 1e6);
+    }
+    writeState(FS_STATE_DIRTY);
+
+    info("[INFO] Filesystem montado com sucesso!\n\n");
+
+    info("[INFO] Disposição do disco:\n");
+    info("[INFO]   |--Espaço para cabecalho: %ldB\n", sizeof(fs_header_t));
+    info("[INFO]   |--Espaço para bitmap de blocos: %ldB\n", computed_block_bitmap_bytes);
+    info("[INFO]   |--Espaço para bitmap de inodes: %ldB\n", computed_inode_bitmap_bytes);
+    info("[INFO]   |--Espaço para tabela de inodes: %ldB\n", computed_inode_table_bytes);
+    info("         |\n");
+    info("[INFO]   |--Espaço disponivel: %dB\n", computed_data_blocks * BLOCK_SIZE);
+    info("[INFO]   |--Equivalente a: %d blocos\n\n", computed_data_blocks);
     return 0;
 }
 
 /* ---- Sincroniza FS inteiro ---- */
 int sync_fs(void) {
     if (!disk || !block_bitmap || !inode_bitmap || !inode_table) return -1;
-    fseek(disk, off_block_bitmap, SEEK_SET);
-    fwrite(block_bitmap, 1, computed_block_bitmap_bytes, disk);
-
-    fseek(disk, off_inode_bitmap, SEEK_SET);
-    fwrite(inode_bitmap, 1, computed_inode_bitmap_bytes, disk);
-
-    fseek(disk, off_inode_table, SEEK_SET);
-    fwrite(inode_table, 1, computed_inode_table_bytes, disk);
+    if (snapshot_view) return 0;
+    STAT_ADD(sync_fs_calls, 1);
+    if (sync_deferred) {
+        sync_pending = 1;
+        return 0;
+    }
+    return flush_fs();
+}
 
-    fflush(disk);
-    fsync(fileno(disk));
+/* ---- Grava metadados pendentes e força durabilidade ---- */
+int flush_fs(void) {
+    if (!disk || !block_bitmap || !inode_bitmap || !inode_table) return -1;
+    if (snapshot_view) return 0;
+    uint64_t start = trace_enabled ? stats_now() : 0;
+    if (meta_map) {
+        // só as páginas sujas são gravadas
+        msync(meta_map, meta_map_len, MS_SYNC);
+    } else {
+        diskWrite(block_bitmap, computed_block_bitmap_bytes, off_block_bitmap);
+        diskWrite(inode_bitmap, computed_inode_bitmap_bytes, off_inode_bitmap);
+        diskWrite(inode_table, computed_inode_table_bytes, off_inode_table);
+        diskWrite(inode_meta, computed_inode_meta_bytes, off_inode_meta);
+        diskWrite(user_table, computed_user_table_bytes, off_user_table);
+        diskWrite(block_refs, computed_dedup_bytes, off_dedup);
+        diskWrite(block_crc, computed_crc_bytes, off_crc);
+        diskWrite(inode_usage, computed_usage_bytes, off_usage);
+        diskWrite(snapshot_table, computed_snapshot_bytes, off_snapshots);
+    }
 
+    STAT_ADD(metadata_flushes, 1);
+    diskSync();
+    // só agora o bitmap no disco também diz que os blocos estão livres
+    if (discard_pending || discard_overflow) discardFlush();
+    // com mmap o tamanho registrado é um limite superior do que foi gravado
+    if (trace_enabled)
+        trace_record(TRACE_SYNC_FS, 0, computed_block_bitmap_bytes + computed_inode_bitmap_bytes +
+                     computed_inode_table_bytes + computed_inode_meta_bytes + computed_user_table_bytes +
+                     computed_dedup_bytes + computed_crc_bytes + computed_usage_bytes +
+                     computed_snapshot_bytes, start);
+
+    sync_pending = 0;
     return 0;
 }
 
+/* ---- Liga/desliga sincronização adiada ---- */
+/* Com o modo ligado, sync_fs, sync_inode e writeBlock não forçam escrita em
+ * disco; a durabilidade fica a cargo de flush_fs (ou de desligar o modo).
+ * Retorna o estado anterior, para quem precisa restaurá-lo. */
+int set_deferred_sync(int enabled) {
+    int previous = sync_deferred;
+    sync_deferred = enabled;
+    if (!enabled && sync_pending) flush_fs();
+    return previous;
+}
+
 /* ---- Persiste um inode específico no disco ---- */
 void sync_inode(int inode_num) {
-    if (!disk || !inode_table) return;
-    fseek(disk, off_inode_table + inode_num * sizeof(inode_t), SEEK_SET);
-    fwrite(&inode_table[inode_num], sizeof(inode_t), 1, disk);
-    fflush(disk);
+    if (!disk || !inode_table || snapshot_view) return;
+    STAT_ADD(sync_inode_calls, 1);
+    if (sync_deferred) {
+        sync_pending = 1;
+        return;
+    }
+    uint64_t start = trace_enabled ? stats_now() : 0;
+    // mapeado: o inode já está no cache de páginas do arquivo
+    if (!meta_map) {
+        diskWrite(&inode_table[inode_num], sizeof(inode_t),
+                  off_inode_table + (off_t)inode_num * sizeof(inode_t));
+        diskWrite(&inode_meta[inode_num], sizeof(inode_meta_t),
+                  off_inode_meta + (off_t)inode_num * sizeof(inode_meta_t));
+    }
+    if (trace_enabled)
+        trace_record(TRACE_SYNC_INODE, inode_num, sizeof(inode_t) + sizeof(inode_meta_t), start);
 }
 
 
 /* ---- Desmonta FS ---- */
 int unmount_fs(void) {
-    sync_fs();
-    free(block_bitmap); block_bitmap = NULL;
-    free(inode_bitmap); inode_bitmap = NULL;
-    free(inode_table); inode_table = NULL;
+    flush_fs();
+    writeState(FS_STATE_CLEAN);
+    releaseMetadata();
     if (disk) { fclose(disk); disk = NULL; }
     return 0;
 }
@@ -263,9 +770,10 @@ int show_inode_info(int inode_index) {
     if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
 
     inode_t *ino = &inode_table[inode_index];
+    inode_meta_t *meta = &inode_meta[inode_index];
     char ctime_buf[64] = {0}, mtime_buf[64] = {0};
-    format_time(ino->creation_date, ctime_buf, sizeof(ctime_buf));
-    format_time(ino->modification_date, mtime_buf, sizeof(mtime_buf));
+    format_time(meta->creation_date, ctime_buf, sizeof(ctime_buf));
+    format_time(meta->modification_date, mtime_buf, sizeof(mtime_buf));
 
     const char *type_str = "unknown";
     if (ino->type == FILE_REGULAR) type_str = "regular file";
@@ -283,17 +791,25 @@ int show_inode_info(int inode_index) {
     perm_str[9] = '\0';
 
     printf("Inode %d:\n", inode_index);
-    printf("  name: %s\n", ino->name);
+    printf("  name: %s\n", meta->name);
     printf("  type: %s\n", type_str);
-    printf("  creator: %s\n", ino->creator);
-    printf("  owner: %s\n", ino->owner);
+    printf("  creator: %s\n", userName(meta->creator));
+    printf("  owner: %s (uid %u)\n", userName(ino->uid), ino->uid);
+    printf("  group: %s (gid %u)\n", groupName(ino->gid), ino->gid);
     printf("  size: %u bytes\n", ino->size);
     printf("  permissions: %s (0%o)\n", perm_str, (unsigned)ino->permissions);
     printf("  created: %s\n", ctime_buf);
     printf("  modified: %s\n", mtime_buf);
     if (ino->type == FILE_SYMLINK) {
         printf("  symlink -> inode %u\n", ino->link_target_index);
+        return 0;
+    }
+    if (ino->flags & INODE_INLINE) {
+        printf("  blocks: (inline)\n");
+        return 0;
     }
+    if (ino->flags & INODE_COMPRESSED)
+        printf("  compressed: chunks de %d blocos\n", COMPRESS_CHUNK_BLOCKS);
     printf("  blocks:");
     for (int i = 0; i < BLOCKS_PER_INODE; ++i) {
         if (ino->blocks[i] != 0)
@@ -308,46 +824,230 @@ int show_inode_info(int inode_index) {
 
 
 /* ---- alocação ---- */
-/* Aloca novo bloco */
-int allocateBlock(void) {
-    for (uint32_t i = 0; i < computed_data_blocks; i++){
+/* A região de dados é dividida em grupos de BLOCKS_PER_GROUP blocos, e a
+ * tabela de inodes em tantos grupos quantos os de blocos: o inode i
+ * pertence ao grupo i / inodes_per_group. Cada grupo é uma fatia dos
+ * bitmaps, com contagens de livres mantidas em memória (recalculadas na
+ * montagem), que deixam a busca pular grupos cheios. As alocações recebem
+ * um alvo: inodes de arquivo ficam no grupo do diretório pai, blocos de
+ * dados logo depois do bloco anterior do arquivo ou, no primeiro, no
+ * início do grupo do inode. Grupo cheio transborda para o seguinte. */
+static uint32_t group_count = 1;
+static uint32_t inodes_per_group = MAX_INODES;
+static uint32_t group_free_blocks[MAX_BLOCK_GROUPS];
+static uint32_t group_free_inodes[MAX_BLOCK_GROUPS];
+
+/* Recalcula as contagens de livres de todos os grupos a partir dos bitmaps */
+void groupsRecount(void) {
+    group_count = (computed_data_blocks + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP;
+    if (group_count == 0) group_count = 1;
+    inodes_per_group = (MAX_INODES + group_count - 1) / group_count;
+    memset(group_free_blocks, 0, sizeof(group_free_blocks));
+    memset(group_free_inodes, 0, sizeof(group_free_inodes));
+    for (uint32_t b = 0; b < computed_data_blocks; b++)
+        if (!(block_bitmap[b / 8] & (1 << (b % 8)))) group_free_blocks[b / BLOCKS_PER_GROUP]++;
+    for (uint32_t i = 0; i < MAX_INODES; i++)
+        if (!(inode_bitmap[i / 8] & (1 << (i % 8)))) group_free_inodes[i / inodes_per_group]++;
+}
+
+uint32_t blockGroupCount(void) {
+    return group_count;
+}
+
+/* Livres do grupo g (blocos e inodes); -1 se o grupo não existe */
+int blockGroupInfo(uint32_t g, uint32_t *free_blocks, uint32_t *free_inodes) {
+    if (g >= group_count) return -1;
+    *free_blocks = group_free_blocks[g];
+    *free_inodes = group_free_inodes[g];
+    return 0;
+}
+
+/* Primeiro bloco do grupo do inode: alvo do primeiro bloco de dados dele */
+static uint32_t inodeBlockGoal(int inode_index) {
+    uint32_t g = (uint32_t)inode_index / inodes_per_group;
+    return g < group_count ? g * BLOCKS_PER_GROUP : 0;
+}
+
+/* Marca um bloco como usado; o checksum do dono anterior não vale mais */
+static void blockMark(uint32_t b) {
+    block_bitmap[b / 8] |= (1 << (b % 8));
+    group_free_blocks[b / BLOCKS_PER_GROUP]--;
+    if (block_crc) block_crc[b] = 0;
+}
+
+/* Procura count blocos livres seguidos em [from, to); uma faixa pode
+ * atravessar grupos, mas grupos sem nenhum livre são pulados inteiros */
+static int blockRunScan(uint32_t from, uint32_t to, uint32_t count) {
+    uint32_t run_start = 0, run_len = 0;
+    uint32_t i = from;
+    while (i < to) {
+        if (i % BLOCKS_PER_GROUP == 0 && group_free_blocks[i / BLOCKS_PER_GROUP] == 0) {
+            run_len = 0;
+            i += BLOCKS_PER_GROUP;
+            continue;
+        }
+
+        // pula bytes totalmente ocupados de uma vez
         uint32_t byte = i / 8;
         uint8_t bit = i % 8;
+        if (bit == 0 && block_bitmap[byte] == 0xFF) {
+            run_len = 0;
+            i += 8;
+            continue;
+        }
+
+        if (block_bitmap[byte] & (1 << bit)) {
+            run_len = 0;
+            i++;
+            continue;
+        }
 
-        if ((block_bitmap[byte] & (1 << bit)) == 0) {
-            block_bitmap[byte] |= (1 << bit);
-            return i;
+        if (run_len == 0) run_start = i;
+        if (++run_len == count) {
+            STAT_ADD(alloc_bits_scanned, i + 1 - from);
+            return run_start;
         }
+        i++;
     }
+    STAT_ADD(alloc_bits_scanned, to > from ? to - from : 0);
     return -1;
 }
 
+/* Aloca uma faixa de blocos contíguos o mais perto possível depois de
+ * 'goal' (volta ao início do disco se não houver); retorna o primeiro ou -1 */
+int allocateBlockRunNear(uint32_t goal, uint32_t count) {
+    if (count == 0) return -1;
+    if (goal >= computed_data_blocks) goal = 0;
+    STAT_ADD(block_allocs, count);
+
+    int first = blockRunScan(goal, computed_data_blocks, count);
+    if (first < 0 && goal > 0) {
+        uint32_t to = goal + count - 1 < computed_data_blocks ? goal + count - 1 : computed_data_blocks;
+        first = blockRunScan(0, to, count);
+    }
+    if (first < 0) return -1;
+    for (uint32_t b = first; b < (uint32_t)first + count; b++) blockMark(b);
+    return first;
+}
+
+/* Aloca um bloco o mais perto possível depois de 'goal' */
+int allocateBlockNear(uint32_t goal) {
+    return allocateBlockRunNear(goal, 1);
+}
+
+/* Aloca novo bloco */
+int allocateBlock(void) {
+    return allocateBlockRunNear(0, 1);
+}
+
+/* Aloca uma faixa de blocos contíguos; retorna o primeiro ou -1 */
+int allocateBlockRun(uint32_t count) {
+    return allocateBlockRunNear(0, count);
+}
+
+/* Aloca até 'count' blocos livres a partir de 'start' (para estender uma
+ * faixa que já termina em start - 1); retorna quantos conseguiu */
+uint32_t allocateBlockRunAt(uint32_t start, uint32_t count) {
+    uint32_t got = 0;
+    while (got < count && start + got < computed_data_blocks) {
+        uint32_t b = start + got;
+        if (block_bitmap[b / 8] & (1 << (b % 8))) break;
+        blockMark(b);
+        got++;
+    }
+    STAT_ADD(block_allocs, got);
+    STAT_ADD(alloc_bits_scanned, got + 1);
+    return got;
+}
+
 /* Libera bloco existente */
 void freeBlock(int block_index) {
     if (block_index >= 0 && block_index < (int)computed_data_blocks) {
         uint32_t byte = block_index / 8;
         uint8_t bit = block_index % 8;
         if ((block_bitmap[byte] & (1 << bit)) == 0) return;
+        // bloco deduplicado: só é liberado quando perde a última referência
+        if (block_refs && block_refs[block_index] > 1) {
+            block_refs[block_index]--;
+            return;
+        }
+        if (block_refs) block_refs[block_index] = 0;
+        if (block_crc) block_crc[block_index] = 0;   // sem checksum até ser regravado
         block_bitmap[byte] &= ~(1 << bit);
+        group_free_blocks[block_index / BLOCKS_PER_GROUP]++;
+        if (fs_features & FS_FEAT_DISCARD) discardQueue(block_index);
+        STAT_ADD(block_frees, 1);
     }
 }
 
-/* Aoca novo inode */
-int allocateInode(void) {
-    for (uint32_t i = 0; i < MAX_INODES; i++) {
-        uint32_t byte = i / 8;
-        uint8_t bit = i % 8;
-
-        if ((inode_bitmap[byte] & (1 << bit)) == 0) {
-            inode_bitmap[byte] |= (1 << bit);
-            memset(&inode_table[i], 0, sizeof(inode_t));
-            inode_table[i].next_inode = 0;
-            return i;
+/* Primeiro inode livre a partir do grupo g, seguindo para os próximos */
+static int inodeScanFrom(uint32_t g) {
+    for (uint32_t k = 0; k < group_count; k++) {
+        uint32_t group = (g + k) % group_count;
+        if (group_free_inodes[group] == 0) continue;
+        uint32_t end = (group + 1) * inodes_per_group;
+        if (end > MAX_INODES) end = MAX_INODES;
+        for (uint32_t i = group * inodes_per_group; i < end; i++) {
+            if (i % 8 == 0 && inode_bitmap[i / 8] == 0xFF) {
+                i += 7;
+                continue;
+            }
+            if (!(inode_bitmap[i / 8] & (1 << (i % 8)))) {
+                STAT_ADD(inode_bits_scanned, i + 1 - group * inodes_per_group);
+                return i;
+            }
         }
     }
     return -1;
 }
 
+/* Grupo para um diretório novo: os filhos da raiz são espalhados (grupo com
+ * mais blocos livres entre os que têm ao menos a média de inodes livres),
+ * para cada subárvore ter espaço para crescer perto de si; os demais ficam
+ * no grupo do pai enquanto ele tiver mais de 1/8 dos blocos livres. */
+static uint32_t directoryGroup(int parent_inode) {
+    uint32_t parent_group = (uint32_t)parent_inode / inodes_per_group;
+    if (parent_group >= group_count) parent_group = 0;
+    if (parent_inode != ROOT_INODE && group_free_inodes[parent_group] > 0 &&
+        group_free_blocks[parent_group] > BLOCKS_PER_GROUP / 8)
+        return parent_group;
+
+    uint64_t total_inodes = 0;
+    for (uint32_t g = 0; g < group_count; g++) total_inodes += group_free_inodes[g];
+    uint32_t avg_inodes = total_inodes / group_count;
+
+    uint32_t best = parent_group, best_blocks = 0;
+    for (uint32_t k = 1; k <= group_count; k++) {
+        uint32_t g = (parent_group + k) % group_count;
+        if (group_free_inodes[g] == 0 || group_free_inodes[g] < avg_inodes) continue;
+        if (group_free_blocks[g] > best_blocks) {
+            best = g;
+            best_blocks = group_free_blocks[g];
+        }
+    }
+    return best;
+}
+
+/* Aloca um inode perto de parent_inode: no grupo dele (arquivos, inodes de
+ * extensão) ou, para diretórios, no grupo de directoryGroup */
+int allocateInodeNear(int parent_inode, int is_directory) {
+    STAT_ADD(inode_allocs, 1);
+    if (parent_inode < 0 || parent_inode >= MAX_INODES) parent_inode = ROOT_INODE;
+    uint32_t g = is_directory ? directoryGroup(parent_inode) : (uint32_t)parent_inode / inodes_per_group;
+    int i = inodeScanFrom(g < group_count ? g : 0);
+    if (i < 0) return -1;
+    inode_bitmap[i / 8] |= (1 << (i % 8));
+    group_free_inodes[i / inodes_per_group]--;
+    memset(&inode_table[i], 0, sizeof(inode_t));
+    memset(&inode_meta[i], 0, sizeof(inode_meta_t));
+    return i;
+}
+
+/* Aoca novo inode */
+int allocateInode(void) {
+    return allocateInodeNear(ROOT_INODE, 0);
+}
+
 /* Libera inode existent */
 void freeInode(int inode_index) {
     if (inode_index < 0 || inode_index >= MAX_INODES)
@@ -355,7 +1055,8 @@ void freeInode(int inode_index) {
 
     inode_t *inode = &inode_table[inode_index];
 
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+    // symlinks e arquivos inline usam o espaço dos blocos para outra coisa
+    for (int i = 0; inodeHasBlocks(inode) && i < BLOCKS_PER_INODE; i++) {
         int block = inode->blocks[i];
         if (block > 0)
             freeBlock(block);
@@ -366,30 +1067,297 @@ void freeInode(int inode_index) {
 
     uint32_t byte = inode_index / 8;
     uint8_t bit = inode_index % 8;
+    if (inode_bitmap[byte] & (1 << bit)) group_free_inodes[inode_index / inodes_per_group]++;
     inode_bitmap[byte] &= ~(1 << bit);
 
     memset(inode, 0, sizeof(inode_t));
+    memset(&inode_meta[inode_index], 0, sizeof(inode_meta_t));
+    memset(&inode_usage[inode_index], 0, sizeof(inode_usage_t));
+}
+
+/* ---- Uso de espaço por subárvore (du) ---- */
+/* Soma (ou subtrai) bytes e blocos no inode e em todos os diretórios acima
+ * dele, seguindo o pai registrado em inode_usage até a raiz */
+static void usageAdd(int inode_index, int64_t bytes, int32_t blocks) {
+    if (bytes == 0 && blocks == 0) return;
+    for (int hops = 0; hops < MAX_INODES; hops++) {
+        inode_usage[inode_index].bytes += bytes;
+        inode_usage[inode_index].blocks += blocks;
+        if (inode_index == ROOT_INODE) break;
+        inode_index = inode_usage[inode_index].parent;
+    }
+}
+
+/* Blocos referenciados por um inode e sua cadeia next_inode */
+static uint32_t inodeBlockCount(int inode_index) {
+    uint32_t count = 0;
+    for (int hops = 0; hops < MAX_INODES; hops++) {
+        inode_t *node = &inode_table[inode_index];
+        for (int i = 0; inodeHasBlocks(node) && i < BLOCKS_PER_INODE; i++)
+            if (node->blocks[i]) count++;
+        if (node->next_inode == 0) break;
+        inode_index = node->next_inode;
+    }
+    return count;
+}
+
+/* Recalcula o uso de um arquivo após alterar seu conteúdo e propaga a
+ * diferença para os diretórios acima */
+static void usageRefresh(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->type != FILE_REGULAR) return;
+    inode_usage_t *u = &inode_usage[inode_index];
+    usageAdd(inode_index, (int64_t)inode->size - (int64_t)u->bytes,
+             (int32_t)(inodeBlockCount(inode_index) - u->blocks));
+}
+
+/* Descarta o conteúdo de um arquivo (blocos, cadeia e dados inline) */
+static void clearInodeContent(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->next_inode) freeInode(inode->next_inode);
+    inode->next_inode = 0;
+    for (int i = 0; inodeHasBlocks(inode) && i < BLOCKS_PER_INODE; i++) {
+        if (inode->blocks[i]) freeBlock(inode->blocks[i]);
+    }
+    memset(inode->blocks, 0, sizeof(inode->blocks));
+    inode->flags &= ~INODE_INLINE;
+    inode->size = 0;
+    usageRefresh(inode_index);
+}
+
+/* Libera os blocos a partir do bloco lógico first_logical, e os inodes de
+ * extensão que ficarem inteiros além dele (para encolher um arquivo) */
+static void blocksFreeFrom(int inode_index, uint32_t first_logical) {
+    uint32_t base = 0;
+    for (int hops = 0; hops < MAX_INODES; hops++) {
+        inode_t *node = &inode_table[inode_index];
+        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+            if (base + i < first_logical || node->blocks[i] == 0) continue;
+            freeBlock(node->blocks[i]);
+            node->blocks[i] = 0;
+        }
+        if (node->next_inode == 0) return;
+        base += BLOCKS_PER_INODE;
+        if (base >= first_logical) {
+            freeInode(node->next_inode);
+            node->next_inode = 0;
+            return;
+        }
+        inode_index = node->next_inode;
+    }
+}
+
+/* ---- Checksums (CRC32C) ---- */
+/* Cada bloco de dados tem seu CRC32C em block_crc[], atualizado em
+ * writeBlocks e conferido em readBlocks. O valor 0 marca bloco sem
+ * checksum (nunca gravado desde a alocação, ou livre), e a leitura dele
+ * não é conferida. Em x86 com SSE4.2 usa a instrução crc32 em três
+ * faixas independentes (a latência da instrução é de 3 ciclos), combinadas
+ * por tabelas de deslocamento; senão, tabelas slicing-by-8. */
+#define CRC32C_POLY 0x82F63B78u   /* Castagnoli, refletido */
+#define CRC32C_LANE 168           /* bytes por faixa; 3 faixas = 504 bytes */
+#define CRC32C_BATCH 48           /* blocos conferidos por vez em readBlocks */
+
+static uint32_t crc32c_table[8][256];
+static uint32_t crc32c_shift[2][4][256]; /* avança o CRC por LANE e 2 * LANE zeros */
+static uint32_t (*crc32c_impl)(uint32_t crc, const uint8_t *p, size_t len);
+static void (*crc32c_blocks_impl)(const uint8_t *p, uint32_t count, uint32_t *out);
+static const char *crc32c_impl_name = "software";
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *p, size_t len) {
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        w ^= crc;
+        crc = crc32c_table[7][w & 0xFF] ^ crc32c_table[6][(w >> 8) & 0xFF] ^
+              crc32c_table[5][(w >> 16) & 0xFF] ^ crc32c_table[4][(w >> 24) & 0xFF] ^
+              crc32c_table[3][(w >> 32) & 0xFF] ^ crc32c_table[2][(w >> 40) & 0xFF] ^
+              crc32c_table[1][(w >> 48) & 0xFF] ^ crc32c_table[0][w >> 56];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static void crc32cBlocksSoftware(const uint8_t *p, uint32_t count, uint32_t *out) {
+    for (uint32_t i = 0; i < count; i++)
+        out[i] = ~crc32cSoftware(~0u, p + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+static uint32_t crc32cShift(uint32_t t[4][256], uint32_t crc) {
+    return t[0][crc & 0xFF] ^ t[1][(crc >> 8) & 0xFF] ^ t[2][(crc >> 16) & 0xFF] ^ t[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    // CRC é linear: crc(A|B|C) = desloca(crc(A), 2L) ^ desloca(crc(B), L) ^ crc(C)
+    while (len >= 3 * CRC32C_LANE) {
+        uint64_t a = c, b = 0, d = 0;
+        for (int i = 0; i < CRC32C_LANE; i += 8) {
+            uint64_t wa, wb, wd;
+            memcpy(&wa, p + i, 8);
+            memcpy(&wb, p + CRC32C_LANE + i, 8);
+            memcpy(&wd, p + 2 * CRC32C_LANE + i, 8);
+            a = __builtin_ia32_crc32di(a, wa);
+            b = __builtin_ia32_crc32di(b, wb);
+            d = __builtin_ia32_crc32di(d, wd);
+        }
+        c = crc32cShift(crc32c_shift[1], (uint32_t)a) ^ crc32cShift(crc32c_shift[0], (uint32_t)b) ^ d;
+        p += 3 * CRC32C_LANE;
+        len -= 3 * CRC32C_LANE;
+    }
+    while (len >= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        c = __builtin_ia32_crc32di(c, w);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+
+/* Vários blocos: três por vez, cada um na sua cadeia, sem combinar faixas */
+__attribute__((target("sse4.2")))
+static void crc32cBlocksSse42(const uint8_t *p, uint32_t count, uint32_t *out) {
+    uint32_t i = 0;
+    for (; i + 3 <= count; i += 3) {
+        const uint8_t *a = p + (size_t)i * BLOCK_SIZE;
+        uint64_t ca = 0xFFFFFFFFu, cb = 0xFFFFFFFFu, cd = 0xFFFFFFFFu;
+        for (int k = 0; k < BLOCK_SIZE; k += 8) {
+            uint64_t wa, wb, wd;
+            memcpy(&wa, a + k, 8);
+            memcpy(&wb, a + BLOCK_SIZE + k, 8);
+            memcpy(&wd, a + 2 * BLOCK_SIZE + k, 8);
+            ca = __builtin_ia32_crc32di(ca, wa);
+            cb = __builtin_ia32_crc32di(cb, wb);
+            cd = __builtin_ia32_crc32di(cd, wd);
+        }
+        out[i] = ~(uint32_t)ca;
+        out[i + 1] = ~(uint32_t)cb;
+        out[i + 2] = ~(uint32_t)cd;
+    }
+    for (; i < count; i++) out[i] = ~crc32cSse42(~0u, p + (size_t)i * BLOCK_SIZE, BLOCK_SIZE);
+}
+#endif
+
+static void crc32cInit(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (c & 1 ? CRC32C_POLY : 0);
+        crc32c_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++)
+        for (int t = 1; t < 8; t++)
+            crc32c_table[t][i] = (crc32c_table[t - 1][i] >> 8) ^ crc32c_table[0][crc32c_table[t - 1][i] & 0xFF];
+
+    // tabelas de deslocamento: a imagem de cada bit, e as demais por linearidade
+    static const uint8_t zeros[2 * CRC32C_LANE];
+    for (int s = 0; s < 2; s++) {
+        uint32_t basis[32];
+        for (int bit = 0; bit < 32; bit++)
+            basis[bit] = crc32cSoftware(1u << bit, zeros, (s + 1) * CRC32C_LANE);
+        for (int k = 0; k < 4; k++) {
+            crc32c_shift[s][k][0] = 0;
+            for (uint32_t b = 1; b < 256; b++)
+                crc32c_shift[s][k][b] = crc32c_shift[s][k][b & (b - 1)] ^ basis[8 * k + __builtin_ctz(b)];
+        }
+    }
+
+    crc32c_impl = crc32cSoftware;
+    crc32c_blocks_impl = crc32cBlocksSoftware;
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_impl = crc32cSse42;
+        crc32c_blocks_impl = crc32cBlocksSse42;
+        crc32c_impl_name = "sse4.2";
+    }
+#endif
+}
+
+/* CRC32C de data, continuando de crc (0 para começar) */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc32c_once, crc32cInit);
+    return ~crc32c_impl(~crc, data, len);
+}
+
+const char *crc32c_backend(void) {
+    pthread_once(&crc32c_once, crc32cInit);
+    return crc32c_impl_name;
+}
+
+/* Checksums guardados para 'count' blocos consecutivos; nunca 0, que
+ * significa "sem checksum" */
+static void blockChecksums(const void *data, uint32_t count, uint32_t *out) {
+    pthread_once(&crc32c_once, crc32cInit);
+    crc32c_blocks_impl(data, count, out);
+    for (uint32_t i = 0; i < count; i++)
+        if (out[i] == 0) out[i] = 1;
 }
 
 /* ---- leitura e escrita ---- */
 /* Le bloco */
 int readBlock(uint32_t block_index, void *buffer){
-    if (!disk || block_index >= computed_data_blocks) return -1;
-    off_t offset = off_data_region + (off_t)block_index * BLOCK_SIZE;
-    fseek(disk, offset, SEEK_SET);
-    size_t read_bytes = fread(buffer, 1, BLOCK_SIZE, disk);
-    return (read_bytes == BLOCK_SIZE) ? 0 : -1;
+    return readBlocks(block_index, 1, buffer);
 }
 
 /* Escreve bloco */
 int writeBlock(uint32_t block_index, const void *buffer){
-    if (!disk || block_index >= computed_data_blocks) return -1;
-    off_t offset = off_data_region + (off_t)block_index * BLOCK_SIZE;
-    fseek(disk, offset, SEEK_SET);
-    size_t written_bytes = fwrite(buffer, 1, BLOCK_SIZE, disk);
-    fflush(disk);
-    fsync(fileno(disk));
-    return (written_bytes == BLOCK_SIZE) ? 0 : -1;
+    return writeBlocks(block_index, 1, buffer);
+}
+
+/* Le 'count' blocos fisicamente contíguos com uma única chamada */
+int readBlocks(uint32_t first_block, uint32_t count, void *buffer){
+    if (!disk || count == 0 || first_block >= computed_data_blocks ||
+        count > computed_data_blocks - first_block) return -1;
+    off_t offset = off_data_region + (off_t)first_block * BLOCK_SIZE;
+    STAT_ADD(block_reads, count);
+    uint64_t start = trace_enabled ? stats_now() : 0;
+    int res = diskRead(buffer, (size_t)count * BLOCK_SIZE, offset);
+    if (trace_enabled) trace_record(TRACE_READ, first_block, count * BLOCK_SIZE, start);
+    if (res != 0 || !fs_verify_checksums || !block_crc) return res;
+
+    // em lotes, com o contador global atualizado uma vez só
+    uint32_t sums[CRC32C_BATCH];
+    uint64_t verified = 0;
+    for (uint32_t i = 0; i < count; i += CRC32C_BATCH) {
+        uint32_t n = count - i < CRC32C_BATCH ? count - i : CRC32C_BATCH;
+        blockChecksums((const char *)buffer + (size_t)i * BLOCK_SIZE, n, sums);
+        for (uint32_t k = 0; k < n; k++) {
+            uint32_t expected = block_crc[first_block + i + k];
+            if (expected == 0) continue;
+            verified++;
+            if (sums[k] != expected) {
+                STAT_ADD(checksums_verified, verified);
+                STAT_ADD(checksum_errors, 1);
+                fprintf(stderr, "[ERRO] bloco %u corrompido (checksum não confere)\n", first_block + i + k);
+                return -1;
+            }
+        }
+    }
+    STAT_ADD(checksums_verified, verified);
+    return 0;
+}
+
+/* Escreve 'count' blocos fisicamente contíguos com uma única chamada */
+int writeBlocks(uint32_t first_block, uint32_t count, const void *buffer){
+    if (!disk || count == 0 || first_block >= computed_data_blocks ||
+        count > computed_data_blocks - first_block) return -1;
+    off_t offset = off_data_region + (off_t)first_block * BLOCK_SIZE;
+    STAT_ADD(block_writes, count);
+    if (block_crc) blockChecksums(buffer, count, block_crc + first_block);
+    uint64_t start = trace_enabled ? stats_now() : 0;
+    if (diskWrite(buffer, (size_t)count * BLOCK_SIZE, offset) != 0) return -1;
+    if (sync_deferred) sync_pending = 1;
+    else diskSync();
+    if (trace_enabled) trace_record(TRACE_WRITE, first_block, count * BLOCK_SIZE, start);
+    return 0;
 }
 
 /* ---- diretórios ---- */
@@ -405,6 +1373,7 @@ int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_in
     }
 
     int current_inode = dir_inode;
+    STAT_ADD(dir_lookups, 1);
 
     while (current_inode >= 0) {
         inode_t *dir = &inode_table[current_inode];
@@ -428,10 +1397,12 @@ int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_in
                     (inode_table[buffer[j].inode_index].type == type || type == FILE_SYMLINK || type == FILE_ANY)) {
                         
                     *out_inode = buffer[j].inode_index;
+                    STAT_ADD(dir_entries_scanned, j + 1);
                     free(buffer);
                     return 0;
                 }
             }
+            STAT_ADD(dir_entries_scanned, entries);
             free(buffer);
         }
         if (dir->next_inode == 0)
@@ -443,6 +1414,8 @@ int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_in
     return -1;
 }
 
+static int blockMakePrivate(uint32_t *slot);
+
 /* Adiciona elemento a um diretorio */
 int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_index) {
     if (dir_inode < 0 || dir_inode >= MAX_INODES || !name)
@@ -473,14 +1446,15 @@ int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_in
         // tenta colocar em todos os blocos existentes
         for (int i = 2; i < BLOCKS_PER_INODE; i++) {
             if (dir->blocks[i] == 0) {
-                // se bloco não existe, aloca
-                int new_block = allocateBlock();
+                // se bloco não existe, aloca (logo depois do anterior, se houver)
+                int new_block = allocateBlockNear(dir->blocks[i - 1] ? dir->blocks[i - 1] + 1 : inodeBlockGoal(dir_inode));
                 if (new_block < 0) {
                     free(buffer);
                     free(empty);
                     return -1;
                 }
                 dir->blocks[i] = new_block;
+                usageAdd(dir_inode, 0, 1);
                 if (writeBlock(new_block, empty) != 0) {
                     free(buffer);
                     free(empty);
@@ -500,14 +1474,21 @@ int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_in
                     buffer[j].name[sizeof(buffer[j].name) - 1] = '\0';
                     buffer[j].inode_index = inode_index;
 
-                    if (writeBlock(dir->blocks[i], buffer) != 0) {
+                    // bloco compartilhado com um snapshot: grava numa cópia
+                    if (blockMakePrivate(&dir->blocks[i]) != 0 || writeBlock(dir->blocks[i], buffer) != 0) {
                         free(buffer);
                         free(empty);
                         return -1;
                     }
 
                     dir->size += sizeof(dir_entry_t);
-                    dir->modification_date = time(NULL);
+                    inode_meta[current_inode].modification_date = time(NULL);
+
+                    // a entrada passa a contar no uso deste diretório e dos acima
+                    if (inode_index != dir_inode && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                        inode_usage[inode_index].parent = dir_inode;
+                        usageAdd(dir_inode, inode_usage[inode_index].bytes, inode_usage[inode_index].blocks);
+                    }
 
                     free(buffer);
                     free(empty);
@@ -518,7 +1499,7 @@ int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_in
 
         // todos os blocos do inode cheio → cria next_inode
         if (dir->next_inode == 0) {
-            int next = allocateInode();
+            int next = allocateInodeNear(dir_inode, 0);
             if (next < 0) {
                 free(buffer);
                 free(empty);
@@ -527,9 +1508,10 @@ int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_in
 
             inode_t *next_inode = &inode_table[next];
             memset(next_inode, 0, sizeof(inode_t));
+            memset(&inode_meta[next], 0, sizeof(inode_meta_t));
             next_inode->type = FILE_DIRECTORY;
 
-            int new_block = allocateBlock();
+            int new_block = allocateBlockNear(inodeBlockGoal(next));
             if (new_block < 0) {
                 free(buffer);
                 free(empty);
@@ -537,6 +1519,7 @@ int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_in
             }
 
             next_inode->blocks[0] = new_block;
+            usageAdd(dir_inode, 0, 1);
             if (writeBlock(new_block, empty) != 0) {
                 free(buffer);
                 free(empty);
@@ -589,14 +1572,17 @@ int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type) {
                     buffer[j].inode_index = 0;
                     buffer[j].name[0] = '\0';
 
-                    if (writeBlock(block_index, buffer) != 0) {
+                    if (blockMakePrivate(&dir->blocks[i]) != 0 || writeBlock(dir->blocks[i], buffer) != 0) {
                         free(buffer);
                         return -1;
                     }
 
+                    usageAdd(dir_inode, -(int64_t)inode_usage[target_inode].bytes,
+                             -(int32_t)inode_usage[target_inode].blocks);
+
                     // limpa dados do inode alvo
                     inode_t *target = &inode_table[target_inode];
-                    for (int k = 0; k < BLOCKS_PER_INODE; k++) {
+                    for (int k = 0; inodeHasBlocks(target) && k < BLOCKS_PER_INODE; k++) {
                         if (target->blocks[k] != 0) {
                             freeBlock(target->blocks[k]);
                             target->blocks[k] = 0;
@@ -605,7 +1591,7 @@ int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type) {
                     freeInode(target_inode);
 
                     inode_table[dir_inode].size -= sizeof(dir_entry_t);
-                    inode_table[dir_inode].modification_date = time(NULL);
+                    inode_meta[dir_inode].modification_date = time(NULL);
 
                     free(buffer);
                     return 0;
@@ -620,49 +1606,108 @@ int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type) {
     return -1;
 }
 
-/* Verifica permissoes */
-int hasPermission(const inode_t *inode, const char *username, permission_t perm) {
-    if (strcmp(inode->owner, username) == 0) {
-        return ((inode->permissions >> 6) & PERM_RWX) & perm;
-    } else {
-        return (inode->permissions & PERM_RWX) & perm;
-    }
+/* ---- Usuários e grupos ---- */
+/* Nomes só são resolvidos na entrada (su, useradd) e na exibição; todo o
+ * resto trabalha com uid/gid */
+static int validUid(int uid) {
+    return user_table && uid >= 0 && uid < MAX_USERS && user_table->users[uid].name[0];
 }
 
-/* Cria diretorio */
-int createDirectory(int parent_inode, const char *name, const char *user){
-    if (parent_inode < 0 || parent_inode >= MAX_INODES || !name || !user) return -1;
-    int dummy_output;
-    if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &dummy_output) == 0) return -1;
+int userLookup(const char *name) {
+    if (!user_table || !name || !*name) return -1;
+    for (int i = 0; i < MAX_USERS; i++)
+        if (strncmp(user_table->users[i].name, name, MAX_NAMESIZE) == 0) return i;
+    return -1;
+}
 
-    inode_t *parent= &inode_table[parent_inode];
-    if (parent_inode != ROOT_INODE){
-    if (!hasPermission(parent, user, PERM_WRITE)) return -1;
+int groupLookup(const char *name) {
+    if (!user_table || !name || !*name) return -1;
+    for (int i = 0; i < MAX_GROUPS; i++)
+        if (strncmp(user_table->groups[i].name, name, MAX_NAMESIZE) == 0) return i;
+    return -1;
+}
+
+/* Cria um usuário (e o grupo, se ainda não existir; sem grupo, usa um
+ * com o nome do usuário). Retorna o uid, ou -1. */
+int userAdd(const char *name, const char *group) {
+    if (!user_table || !name || !*name || strlen(name) >= MAX_NAMESIZE) return -1;
+    if (!group) group = name;
+    if (strlen(group) >= MAX_NAMESIZE || userLookup(name) >= 0) return -1;
+
+    int gid = groupLookup(group);
+    if (gid < 0) {
+        for (gid = 0; gid < MAX_GROUPS && user_table->groups[gid].name[0]; gid++);
+        if (gid == MAX_GROUPS) return -1;
     }
+    int uid;
+    for (uid = 0; uid < MAX_USERS && user_table->users[uid].name[0]; uid++);
+    if (uid == MAX_USERS) return -1;
 
-    int new_inode_index = allocateInode();
-    if (new_inode_index < 0) return -1;
+    strcpy(user_table->groups[gid].name, group);
+    strcpy(user_table->users[uid].name, name);
+    user_table->users[uid].gid = gid;
+    sync_fs();
+    return uid;
+}
+
+int userGid(int uid) {
+    return validUid(uid) ? (int)user_table->users[uid].gid : -1;
+}
+
+const char *userName(int uid) {
+    return validUid(uid) ? user_table->users[uid].name : "?";
+}
+
+const char *groupName(int gid) {
+    if (!user_table || gid < 0 || gid >= MAX_GROUPS || !user_table->groups[gid].name[0]) return "?";
+    return user_table->groups[gid].name;
+}
+
+/* Verifica permissoes (dono, grupo primário do usuário ou outros) */
+int hasPermission(const inode_t *inode, int uid, permission_t perm) {
+    if (inode->uid == uid) {
+        return ((inode->permissions >> 6) & PERM_RWX) & perm;
+    } else if (inode->gid == userGid(uid)) {
+        return ((inode->permissions >> 3) & PERM_RWX) & perm;
+    } else {
+        return (inode->permissions & PERM_RWX) & perm;
+    }
+}
+
+/* Cria diretorio */
+int createDirectory(int parent_inode, const char *name, int uid){
+    if (parent_inode < 0 || parent_inode >= MAX_INODES || !name || !validUid(uid)) return -1;
+    int dummy_output;
+    if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &dummy_output) == 0) return -1;
+
+    inode_t *parent= &inode_table[parent_inode];
+    if (parent_inode != ROOT_INODE){
+    if (!hasPermission(parent, uid, PERM_WRITE)) return -1;
+    }
+
+    int new_inode_index = allocateInodeNear(parent_inode, 1);
+    if (new_inode_index < 0) return -1;
 
     inode_t *new_inode = &inode_table[new_inode_index];
 
     time_t now = time(NULL);
 
+    inode_meta_t *new_meta = &inode_meta[new_inode_index];
     new_inode->type = FILE_DIRECTORY;
-    strncpy(new_inode->name, name, MAX_NAMESIZE-1);
-    new_inode->name[MAX_NAMESIZE-1] = '\0';
-    new_inode->creation_date = now;
-    new_inode->modification_date = now;
+    strncpy(new_meta->name, name, MAX_NAMESIZE-1);
+    new_meta->name[MAX_NAMESIZE-1] = '\0';
+    new_meta->creation_date = now;
+    new_meta->modification_date = now;
     new_inode->size = 0;
-    strncpy(new_inode->creator, user, MAX_NAMESIZE-1);
-    new_inode->creator[MAX_NAMESIZE-1] = '\0';
-    strncpy(new_inode->owner, user, MAX_NAMESIZE-1);
-    new_inode->owner[MAX_NAMESIZE-1] = '\0';
+    new_meta->creator = uid;
+    new_inode->uid = uid;
+    new_inode->gid = userGid(uid);
     new_inode->permissions = PERM_RWX << 6 | PERM_RX << 3 | PERM_RX;
-    new_inode->link_target_index = -1;
 
-    int block = allocateBlock();
+    int block = allocateBlockNear(inodeBlockGoal(new_inode_index));
     if (block < 0) return -1;
     new_inode->blocks[0] = block;
+    inode_usage[new_inode_index].blocks = 1;
 
     dir_entry_t entries[BLOCK_SIZE / sizeof(dir_entry_t)] = {0};
 
@@ -679,8 +1724,8 @@ int createDirectory(int parent_inode, const char *name, const char *user){
 }
 
 /* Cria diretorios recursivamente s*/
-int createDirectoriesRecursively(const char *path, int current_inode, const char *user) {
-    if (!path || !user) return -1;
+int createDirectoriesRecursively(const char *path, int current_inode, int uid) {
+    if (!path || !validUid(uid)) return -1;
     if (path[0] == '\0') return -1;
 
     // Se path == "." nada a fazer
@@ -717,7 +1762,7 @@ int createDirectoriesRecursively(const char *path, int current_inode, const char
         // tentamos achar token no diretório atual (aceitamos FILE_DIRECTORY ou FILE_SYMLINK -> seguido)
         if (dirFindEntry(cur, token, FILE_DIRECTORY, &next_inode) != 0) {
             // não existe -> criar diretório aqui
-            if (createDirectory(cur, token, user) != 0) {
+            if (createDirectory(cur, token, uid) != 0) {
                 return -1;
             }
             // recuperar inode do diretório criado
@@ -738,14 +1783,14 @@ int createDirectoriesRecursively(const char *path, int current_inode, const char
 }
 
 /* Deleta diretorio existente */
-int deleteDirectory(int parent_inode, const char *name, const char *user){
+int deleteDirectory(int parent_inode, const char *name, int uid){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
 
     int target_inode;
     if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &target_inode) != 0) return -1;
 
     inode_t *target = &inode_table[target_inode];
-    if (!hasPermission(target, user, PERM_WRITE)) return -1;
+    if (!hasPermission(target, uid, PERM_WRITE)) return -1;
     if (target->type != FILE_DIRECTORY) return -1;
 
     for (int i = 0; i < BLOCKS_PER_INODE; i++) {
@@ -781,34 +1826,34 @@ int deleteDirectory(int parent_inode, const char *name, const char *user){
 }
 
 /* Cria arquivo */
-int createFile(int parent_inode, const char *name, const char *user){
+int createFile(int parent_inode, const char *name, int uid){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
     int dummy_output;
     if (dirFindEntry(parent_inode, name, FILE_REGULAR, &dummy_output) == 0) return -1;
 
     inode_t *parent= &inode_table[parent_inode];
     if (parent_inode != ROOT_INODE){
-    if (!hasPermission(parent, user, PERM_WRITE)) return -1;
+    if (!hasPermission(parent, uid, PERM_WRITE)) return -1;
     }
 
-    int new_inode_index = allocateInode();
+    int new_inode_index = allocateInodeNear(parent_inode, 0);
     if (new_inode_index < 0) return -1;
     inode_t *new_inode = &inode_table[new_inode_index];
 
     time_t now = time(NULL);
 
+    inode_meta_t *new_meta = &inode_meta[new_inode_index];
     new_inode->type = FILE_REGULAR;
-    strncpy(new_inode->name, name, MAX_NAMESIZE-1);
-    new_inode->name[MAX_NAMESIZE-1] = '\0';
-    new_inode->creation_date = now;
-    new_inode->modification_date = now;
+    strncpy(new_meta->name, name, MAX_NAMESIZE-1);
+    new_meta->name[MAX_NAMESIZE-1] = '\0';
+    new_meta->creation_date = now;
+    new_meta->modification_date = now;
     new_inode->size = 0;
-    strncpy(new_inode->creator, user, MAX_NAMESIZE-1);
-    new_inode->creator[MAX_NAMESIZE-1] = '\0';
-    strncpy(new_inode->owner, user, MAX_NAMESIZE-1);
-    new_inode->owner[MAX_NAMESIZE-1] = '\0';
+    new_meta->creator = uid;
+    new_inode->uid = uid;
+    new_inode->gid = userGid(uid);
     new_inode->permissions = PERM_RWX << 6 | PERM_RX << 3 | PERM_RX;
-    new_inode->link_target_index = -1;
+    if (fs_features & FS_FEAT_COMPRESS) new_inode->flags |= INODE_COMPRESSED;
 
     if (dirAddEntry(parent_inode, name, FILE_REGULAR, new_inode_index) != 0) return -1;
     sync_fs();
@@ -816,795 +1861,4612 @@ int createFile(int parent_inode, const char *name, const char *user){
 }
 
 /* Deleta arquivo */
-int deleteFile(int parent_inode, const char *name, const char *user){
+int deleteFile(int parent_inode, const char *name, int uid){
     if (parent_inode < 0 || parent_inode >= MAX_INODES || !name) return -1;
     int target_inode;
     if (dirFindEntry(parent_inode, name, FILE_REGULAR, &target_inode) == -1) return -1;
 
     inode_t *target = &inode_table[target_inode];
-    if (!hasPermission(target, user, PERM_WRITE)) return -1;
+    if (!hasPermission(target, uid, PERM_WRITE)) return -1;
 
     if (target->type != FILE_REGULAR && target->type != FILE_SYMLINK) return -1;
 
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-        if (target->blocks[i] != 0)
-            freeBlock(target->blocks[i]);
-    }
-
+    // dirRemoveEntry libera os blocos e o inode
     if (dirRemoveEntry(parent_inode, name, target->type) == -1) return -1;
     freeInode(target_inode);
     sync_fs();
     return 0;
 }
 
-/* Adiciona conteudo a um inode */
-int addContentToInode(int inode_index, const char *data, size_t data_size, const char *user) {
-    if (!data || !user) return -1;
-    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
-
-    inode_t *inode = &inode_table[inode_index];
-
-    // Permissão de escrita
-    if (!hasPermission(inode, user, PERM_WRITE)) return -1;
+/* ---- Deduplicação ---- */
+/* Com FS_FEAT_DEDUP, cada bloco novo de arquivo é procurado no índice pelo
+ * hash do conteúdo; se um bloco idêntico já existe, ele é compartilhado
+ * (block_refs++) em vez de gravado. block_refs[b] == 0 marca blocos fora
+ * do esquema (dono único, podem ser reescritos no lugar); blocos
+ * deduplicados têm block_refs >= 1 e são copiados antes de reescritos. */
+static uint32_t blockHash(const char *data) {
+    uint64_t h = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < BLOCK_SIZE; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, data + i, sizeof(w));
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    return (uint32_t)(h ^ (h >> 29));
+}
 
-    size_t written = 0;
+static int blockAllocated(uint32_t block) {
+    return block < computed_data_blocks && (block_bitmap[block / 8] & (1 << (block % 8)));
+}
 
-    // Vai até o último inode encadeado
-    inode_t *current = inode;
-    int current_idx = inode_index;
-    while (current->next_inode != 0) {
-        current_idx = current->next_inode;
-        current = &inode_table[current_idx];
+/* Procura um bloco com o mesmo conteúdo de data; se achar, ele ganha uma
+ * referência e é retornado. Retorna -1 se não houver. */
+static int dedupFind(const char *data, uint32_t h) {
+    uint32_t home = h & (DEDUP_SLOTS - 1);
+    char existing[BLOCK_SIZE];
+    STAT_ADD(dedup_lookups, 1);
+
+    for (uint32_t p = 0; p < DEDUP_PROBES; p++) {
+        dedup_entry_t *e = &dedup_index[(home + p) & (DEDUP_SLOTS - 1)];
+        if (e->block == 0) break;
+        // obsoleta: bloco liberado ou que saiu do esquema ao ser reescrito
+        if (!blockAllocated(e->block) || block_refs[e->block] == 0) continue;
+        if (e->hash != h || block_refs[e->block] >= DEDUP_MAX_REFS) continue;
+        if (readBlock(e->block, existing) != 0 || memcmp(existing, data, BLOCK_SIZE) != 0) continue;
+
+        block_refs[e->block]++;
+        STAT_ADD(dedup_hits, 1);
+        return e->block;
     }
+    return -1;
+}
 
-    // Determina onde está o último bloco parcialmente preenchido (se existir)
-    int last_block_slot = -1;
-    for (int i = BLOCKS_PER_INODE - 1; i >= 0; --i) {
-        if (current->blocks[i] != 0) {
-            last_block_slot = i;
+/* Registra no índice um bloco recém-gravado (dono único) */
+static void dedupInsert(uint32_t block, uint32_t h) {
+    uint32_t home = h & (DEDUP_SLOTS - 1);
+    dedup_entry_t *insert = &dedup_index[home]; // janela cheia: substitui a entrada da casa
+    for (uint32_t p = 0; p < DEDUP_PROBES; p++) {
+        dedup_entry_t *e = &dedup_index[(home + p) & (DEDUP_SLOTS - 1)];
+        if (e->block == 0 || !blockAllocated(e->block) || block_refs[e->block] == 0) {
+            insert = e;
             break;
         }
     }
+    block_refs[block] = 1;
+    insert->hash = h;
+    insert->block = block;
+}
 
-    size_t file_offset = inode->size;
-    size_t inner_offset = file_offset % BLOCK_SIZE;
+/* Grava um bloco novo de arquivo, compartilhando um idêntico se houver;
+ * senão o grava perto de 'goal'. Retorna o número do bloco ou -1. */
+static int dedupStore(const char *data, uint32_t goal) {
+    uint32_t h = blockHash(data);
+    int block = dedupFind(data, h);
+    if (block >= 0) return block;
 
-    // Se não há nenhum bloco no inode atual, ou último bloco está cheio -> precisamos criar novo bloco
-    if (last_block_slot == -1 || (inner_offset == 0 && inode->size != 0)) {
-        last_block_slot = -1; // forçar alocação abaixo
-        inner_offset = 0;
+    block = allocateBlockNear(goal);
+    if (block < 0) return -1;
+    if (writeBlock(block, data) != 0) {
+        freeBlock(block);
+        return -1;
     }
+    dedupInsert(block, h);
+    return block;
+}
 
-    // --- Preencha bloco parcialmente usado (se houver) ---
-    if (last_block_slot != -1 && inner_offset > 0) {
-        uint32_t block_num = current->blocks[last_block_slot];
-        char block_buffer[BLOCK_SIZE];
+/* Prepara o bloco do slot para ser reescrito no lugar: um bloco
+ * compartilhado é trocado por uma cópia nova (o chamador grava o conteúdo)
+ * e um deduplicado de dono único sai do esquema */
+static int blockMakePrivate(uint32_t *slot) {
+    uint32_t block = *slot;
+    if (!block_refs || block == 0 || block >= computed_data_blocks || block_refs[block] == 0) return 0;
+    if (block_refs[block] == 1) {
+        block_refs[block] = 0;
+        return 0;
+    }
+    int copy = allocateBlockNear(block);
+    if (copy < 0) return -1;
+    block_refs[block]--;
+    *slot = copy;
+    STAT_ADD(dedup_cow, 1);
+    return 0;
+}
 
-        if (readBlock(block_num, block_buffer) != 0) return -1;
+/* ---- Snapshots ---- */
+/* Um snapshot congela a tabela de inodes do momento em que foi criado: a
+ * imagem (bitmap de inodes seguido de um registro por inode alocado) é
+ * gravada em blocos contíguos da região de dados, e cada bloco referenciado
+ * pelos inodes ganha uma referência em block_refs, como na deduplicação.
+ * Daí em diante o sistema vivo copia antes de reescrever um bloco
+ * compartilhado (blockMakePrivate), e apagar um arquivo só decrementa a
+ * contagem. O custo de criar e de apagar é proporcional aos metadados,
+ * nunca aos dados. */
+typedef struct {
+    inode_t inode;
+    inode_meta_t meta;
+    inode_usage_t usage;
+} snapshot_record_t;
+
+typedef struct {
+    unsigned char *inode_bitmap;
+    inode_t *inode_table;
+    inode_meta_t *inode_meta;
+    inode_usage_t *inode_usage;
+} snapshot_image_t;
+
+static snapshot_image_t snapshot_live;     /* tabelas vivas durante snapshotEnter */
+static snapshot_image_t snapshot_open;
+
+static int snapshotInodeAllocated(const unsigned char *bitmap, uint32_t index) {
+    return (bitmap[index / 8] >> (index % 8)) & 1;
+}
 
-        size_t can_write = BLOCK_SIZE - inner_offset;
-        size_t to_write = (data_size - written < can_write) ? (data_size - written) : can_write;
+static void snapshotFreeImage(snapshot_image_t *img) {
+    free(img->inode_bitmap);
+    free(img->inode_table);
+    free(img->inode_meta);
+    free(img->inode_usage);
+    memset(img, 0, sizeof(*img));
+}
 
-        memcpy(block_buffer + inner_offset, data + written, to_write);
+/* Lê a imagem do snapshot para tabelas completas (mesmos índices das vivas) */
+static int snapshotLoad(const fs_snapshot_t *snap, snapshot_image_t *img) {
+    memset(img, 0, sizeof(*img));
+    size_t bytes = (size_t)snap->image_blocks * BLOCK_SIZE;
+    if (snap->image_blocks == 0 || snap->first_block == 0 ||
+        computed_inode_bitmap_bytes + (size_t)snap->inodes * sizeof(snapshot_record_t) > bytes)
+        return -1;
 
-        if (writeBlock(block_num, block_buffer) != 0) return -1;
+    char *raw = malloc(bytes);
+    img->inode_bitmap = malloc(computed_inode_bitmap_bytes);
+    img->inode_table = calloc(MAX_INODES, sizeof(inode_t));
+    img->inode_meta = calloc(MAX_INODES, sizeof(inode_meta_t));
+    img->inode_usage = calloc(MAX_INODES, sizeof(inode_usage_t));
+    if (!raw || !img->inode_bitmap || !img->inode_table || !img->inode_meta || !img->inode_usage ||
+        readBlocks(snap->first_block, snap->image_blocks, raw) != 0) {
+        free(raw);
+        snapshotFreeImage(img);
+        return -1;
+    }
 
-        written += to_write;
-        file_offset += to_write;
-        inner_offset = file_offset % BLOCK_SIZE;
+    memcpy(img->inode_bitmap, raw, computed_inode_bitmap_bytes);
+    const char *p = raw + computed_inode_bitmap_bytes;
+    uint32_t found = 0;
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (!snapshotInodeAllocated(img->inode_bitmap, i)) continue;
+        if (++found > snap->inodes) break;
+        snapshot_record_t rec;
+        memcpy(&rec, p, sizeof(rec));
+        p += sizeof(rec);
+        img->inode_table[i] = rec.inode;
+        img->inode_meta[i] = rec.meta;
+        img->inode_usage[i] = rec.usage;
+    }
+    free(raw);
+    if (found != snap->inodes) {
+        snapshotFreeImage(img);
+        return -1;
     }
+    return 0;
+}
 
-    // --- Agora escreva blocos completos / novos --- 
-    while (written < data_size) {
-        // encontra slot de bloco livre no inode atual
-        int slot = -1;
-        for (int i = 0; i < BLOCKS_PER_INODE; ++i) {
-            if (current->blocks[i] == 0) { slot = i; break; }
-        }
+int snapshotLookup(const char *name) {
+    if (!snapshot_table || !name || !name[0]) return -1;
+    for (int s = 0; s < MAX_SNAPSHOTS; s++)
+        if (strncmp(snapshot_table->snapshots[s].name, name, MAX_NAMESIZE) == 0) return s;
+    return -1;
+}
 
-        // se inode atual cheio, alocar novo inode e usar seu slot 0
-        if (slot == -1) {
-            int new_inode_idx = allocateInode();
-            if (new_inode_idx < 0) return -1;
-            current->next_inode = new_inode_idx;
-            current = &inode_table[new_inode_idx];
-            current_idx = new_inode_idx;
-            // garantir tipo do inode encadeado (arquivo regular)
-            current->type = FILE_REGULAR;
-            slot = 0;
-        }
+/* Cria o snapshot 'name' do estado atual. Retorna 0, ou -1 se o nome for
+ * inválido ou repetido, o catálogo estiver cheio ou faltar espaço contíguo
+ * para a imagem. */
+int snapshotCreate(const char *name) {
+    if (!snapshot_table || snapshot_view || !name || !name[0] || strlen(name) >= MAX_NAMESIZE ||
+        snapshotLookup(name) >= 0)
+        return -1;
+    int slot = -1;
+    for (int s = 0; s < MAX_SNAPSHOTS && slot < 0; s++)
+        if (!snapshot_table->snapshots[s].name[0]) slot = s;
+    if (slot < 0) return -1;
+
+    // cada referência do snapshot soma 1 à contagem; um bloco com k donos
+    // pode chegar a 2k, então contagens acima da metade do limite recusam
+    uint32_t inodes = 0;
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (!snapshotInodeAllocated(inode_bitmap, i)) continue;
+        inodes++;
+        inode_t *inode = &inode_table[i];
+        for (int k = 0; inodeHasBlocks(inode) && k < BLOCKS_PER_INODE; k++)
+            if (inode->blocks[k] && block_refs[inode->blocks[k]] > DEDUP_MAX_REFS / 2) return -1;
+    }
+
+    size_t bytes = computed_inode_bitmap_bytes + (size_t)inodes * sizeof(snapshot_record_t);
+    uint32_t nblocks = (bytes + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    char *raw = calloc(nblocks, BLOCK_SIZE);
+    if (!raw) return -1;
+    memcpy(raw, inode_bitmap, computed_inode_bitmap_bytes);
+    char *p = raw + computed_inode_bitmap_bytes;
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (!snapshotInodeAllocated(inode_bitmap, i)) continue;
+        snapshot_record_t rec = { inode_table[i], inode_meta[i], inode_usage[i] };
+        memcpy(p, &rec, sizeof(rec));
+        p += sizeof(rec);
+    }
+
+    int first = allocateBlockRun(nblocks);
+    if (first < 0 || writeBlocks(first, nblocks, raw) != 0) {
+        if (first >= 0)
+            for (uint32_t b = 0; b < nblocks; b++) freeBlock(first + b);
+        free(raw);
+        return -1;
+    }
+    free(raw);
 
-        // aloca bloco para esse slot
-        if (current->blocks[slot] == 0) {
-            int new_block = allocateBlock();
-            if (new_block < 0) return -1;
-            current->blocks[slot] = new_block;
+    // a partir daqui os blocos são compartilhados: o dono único (0) vira 2
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (!snapshotInodeAllocated(inode_bitmap, i)) continue;
+        inode_t *inode = &inode_table[i];
+        for (int k = 0; inodeHasBlocks(inode) && k < BLOCKS_PER_INODE; k++) {
+            uint32_t b = inode->blocks[k];
+            if (b) block_refs[b] = block_refs[b] ? block_refs[b] + 1 : 2;
         }
+    }
 
-        // escrever até encher o bloco (ou o que sobrar)
-        size_t to_write = (data_size - written >= BLOCK_SIZE) ? BLOCK_SIZE : (data_size - written);
-        char block_buffer[BLOCK_SIZE] = {0};
-        // se estiver escrevendo menos que um bloco completo, copiamos só os bytes a escrever
-        memcpy(block_buffer, data + written, to_write);
+    fs_snapshot_t *snap = &snapshot_table->snapshots[slot];
+    memset(snap, 0, sizeof(*snap));
+    strcpy(snap->name, name);
+    snap->creation_date = time(NULL);
+    snap->first_block = first;
+    snap->image_blocks = nblocks;
+    snap->inodes = inodes;
+    sync_fs();
+    return 0;
+}
 
-        if (writeBlock(current->blocks[slot], block_buffer) != 0) return -1;
+/* Apaga o snapshot: solta as referências dos blocos que ele congelou (os
+ * que só ele usava são liberados) e a própria imagem */
+int snapshotDelete(const char *name) {
+    int slot = snapshotLookup(name);
+    if (slot < 0 || snapshot_view) return -1;
+    fs_snapshot_t *snap = &snapshot_table->snapshots[slot];
 
-        written += to_write;
-        file_offset += to_write;
+    snapshot_image_t img;
+    if (snapshotLoad(snap, &img) != 0) return -1;
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (!snapshotInodeAllocated(img.inode_bitmap, i)) continue;
+        inode_t *inode = &img.inode_table[i];
+        for (int k = 0; inodeHasBlocks(inode) && k < BLOCKS_PER_INODE; k++)
+            if (inode->blocks[k] && inode->blocks[k] < computed_data_blocks) freeBlock(inode->blocks[k]);
     }
+    snapshotFreeImage(&img);
 
-    // atualiza metadados do inode raiz (tamanho e timestamp)
-    inode->size = file_offset;
-    inode->modification_date = time(NULL);
+    for (uint32_t b = 0; b < snap->image_blocks; b++) freeBlock(snap->first_block + b);
+    memset(snap, 0, sizeof(*snap));
+    sync_fs();
+    return 0;
+}
 
-    // persiste mudanças
-    return sync_fs();
+/* Troca as tabelas globais pelas do snapshot, para navegar nele com os
+ * comandos de leitura; snapshotLeave restaura as vivas. Enquanto aberto,
+ * sync_fs, flush_fs e sync_inode não gravam nada. */
+int snapshotEnter(int index) {
+    if (snapshot_view || index < 0 || index >= MAX_SNAPSHOTS || !snapshot_table->snapshots[index].name[0])
+        return -1;
+    if (snapshotLoad(&snapshot_table->snapshots[index], &snapshot_open) != 0) return -1;
+    snapshot_live.inode_bitmap = inode_bitmap;
+    snapshot_live.inode_table = inode_table;
+    snapshot_live.inode_meta = inode_meta;
+    snapshot_live.inode_usage = inode_usage;
+    inode_bitmap = snapshot_open.inode_bitmap;
+    inode_table = snapshot_open.inode_table;
+    inode_meta = snapshot_open.inode_meta;
+    inode_usage = snapshot_open.inode_usage;
+    snapshot_view = 1;
+    return 0;
 }
 
-/* Le conteudo de um inode */
-int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, const char *user) {
-    if (!buffer || !out_bytes || !user) return -1;
+void snapshotLeave(void) {
+    if (!snapshot_view) return;
+    inode_bitmap = snapshot_live.inode_bitmap;
+    inode_table = snapshot_live.inode_table;
+    inode_meta = snapshot_live.inode_meta;
+    inode_usage = snapshot_live.inode_usage;
+    snapshotFreeImage(&snapshot_open);
+    snapshot_view = 0;
+}
 
-    int target_inode = inode_number;
-    int depth = 0;
+/* Cursor sobre os blocos lógicos de um arquivo. Guarda a posição na cadeia
+ * next_inode para que acessos sequenciais não percorram a cadeia desde o
+ * início a cada bloco. */
+typedef struct {
+    int head;        /* inode inicial do arquivo */
+    int current;     /* inode da cadeia onde o cursor está */
+    uint32_t base;   /* primeiro bloco lógico coberto por 'current' */
+} block_cursor_t;
+
+static void cursorInit(block_cursor_t *cur, int inode_index) {
+    cur->head = inode_index;
+    cur->current = inode_index;
+    cur->base = 0;
+}
 
-    // Segue links simbólicos, com limite de 16
-    while (inode_table[target_inode].type == FILE_SYMLINK) {
-        target_inode = inode_table[target_inode].link_target_index;
-        if (++depth > 16) return -1; // evita loop infinito
+/* Retorna o slot de blocks[] correspondente ao bloco lógico 'logical'.
+ * Com create != 0, os inodes de extensão que faltarem são alocados. */
+static uint32_t *cursorSlot(block_cursor_t *cur, uint32_t logical, int create) {
+    if (logical < cur->base) {
+        cur->current = cur->head;
+        cur->base = 0;
+    }
+    while (logical >= cur->base + BLOCKS_PER_INODE) {
+        if (inode_table[cur->current].next_inode == 0) {
+            if (!create) return NULL;
+            int next = allocateInodeNear(cur->head, 0);
+            if (next < 0) return NULL;
+            inode_table[next].type = inode_table[cur->head].type;
+            inode_table[cur->current].next_inode = next;
+        }
+        cur->current = inode_table[cur->current].next_inode;
+        cur->base += BLOCKS_PER_INODE;
     }
+    return &inode_table[cur->current].blocks[logical - cur->base];
+}
 
-    inode_t *inode = &inode_table[target_inode];
-    if (!inode || !hasPermission(inode, user, PERM_READ)) return -1;
+/* Le ou escreve 'count' blocos lógicos a partir da posição do cursor,
+ * agrupando os blocos fisicamente contíguos em uma única operação */
+static int cursorBlocksIO(block_cursor_t *cur, uint32_t first_logical, uint32_t count, void *buffer, int write) {
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t *slot = cursorSlot(cur, first_logical + i, 0);
+        if (!slot || *slot == 0) {
+            if (write) return -1;
+            // bloco não alocado é lido como zeros
+            memset((char *)buffer + (size_t)i * BLOCK_SIZE, 0, BLOCK_SIZE);
+            i++;
+            continue;
+        }
 
-    size_t total_size = inode->size;
-    if (buffer_size < total_size + 1) return -1; // espaço para '\0'
+        uint32_t start = *slot, run = 1;
+        while (i + run < count) {
+            uint32_t *next = cursorSlot(cur, first_logical + i + run, 0);
+            if (!next || *next != start + run) break;
+            run++;
+        }
 
-    size_t offset = 0;
-    inode_t *current = inode;
+        char *p = (char *)buffer + (size_t)i * BLOCK_SIZE;
+        int res = write ? writeBlocks(start, run, p) : readBlocks(start, run, p);
+        if (res != 0) return -1;
+        i += run;
+    }
+    return 0;
+}
 
-    while (current) {
-        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
-            if (current->blocks[i] == 0) continue;
+/* ---- Compressão (LZ) ---- */
+/* Arquivos com INODE_COMPRESSED são gravados em chunks de COMPRESS_CHUNK_BLOCKS
+ * blocos lógicos, cada um comprimido de forma independente. O chunk c ocupa
+ * os slots [c * COMPRESS_CHUNK_BLOCKS, ...) do mapa de blocos: os primeiros n
+ * slots guardam o chunk e os demais ficam vazios. Assim o próprio mapa serve
+ * de índice e uma leitura posicional só descomprime os chunks que toca.
+ * Um chunk que não economiza ao menos um bloco é gravado sem compressão
+ * (n == blocos necessários para os dados crus). */
+#define COMPRESS_CHUNK_BYTES (COMPRESS_CHUNK_BLOCKS * BLOCK_SIZE)
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+/* Formato de sequência no estilo LZ4: token (4 bits de literais, 4 bits de
+ * match - LZ_MIN_MATCH), extensões de 255, literais, offset de 16 bits LE,
+ * extensão do match. A última sequência só tem literais. */
+static uint32_t lzHash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
 
-            char block_buffer[BLOCK_SIZE];
-            if (readBlock(current->blocks[i], block_buffer) != 0) return -1;
+static uint8_t *lzPutLength(uint8_t *op, const uint8_t *oend, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+/* Comprime src em dst; retorna o tamanho comprimido ou 0 se não couber em cap */
+static size_t lzCompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    int32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + cap;
+
+    while (end - ip >= LZ_MIN_MATCH) {
+        uint32_t h = lzHash(ip);
+        int32_t ref = table[h];
+        table[h] = (int32_t)(ip - src);
+        if (ref < 0 || (ip - src) - ref > 0xFFFF || memcmp(src + ref, ip, LZ_MIN_MATCH) != 0) {
+            ip++;
+            continue;
+        }
 
-            size_t to_copy = BLOCK_SIZE;
-            if (offset + to_copy > total_size) to_copy = total_size - offset;
+        const uint8_t *match = src + ref;
+        size_t mlen = LZ_MIN_MATCH;
+        while (ip + mlen < end && match[mlen] == ip[mlen]) mlen++;
+
+        size_t lit = ip - anchor;
+        if (op >= oend) return 0;
+        uint8_t *token = op++;
+        *token = (uint8_t)((lit < 15 ? lit : 15) << 4 | (mlen - LZ_MIN_MATCH < 15 ? mlen - LZ_MIN_MATCH : 15));
+        if (lit >= 15 && !(op = lzPutLength(op, oend, lit - 15))) return 0;
+        if ((size_t)(oend - op) < lit + 2) return 0;
+        memcpy(op, anchor, lit);
+        op += lit;
+        uint16_t offset = (uint16_t)(ip - match);
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+        if (mlen - LZ_MIN_MATCH >= 15 && !(op = lzPutLength(op, oend, mlen - LZ_MIN_MATCH - 15))) return 0;
+
+        ip += mlen;
+        anchor = ip;
+    }
 
-            memcpy(buffer + offset, block_buffer, to_copy);
-            offset += to_copy;
+    size_t lit = end - anchor;
+    if (op >= oend) return 0;
+    uint8_t *token = op++;
+    *token = (uint8_t)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15 && !(op = lzPutLength(op, oend, lit - 15))) return 0;
+    if ((size_t)(oend - op) < lit) return 0;
+    memcpy(op, anchor, lit);
+    op += lit;
+    return op - dst;
+}
 
-            if (offset >= total_size) break; // já leu todo o arquivo
+/* Descomprime exatamente dst_len bytes; o resto de src (padding) é ignorado */
+static int lzDecompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len) {
+    const uint8_t *ip = src, *iend = src + src_len;
+    uint8_t *op = dst, *oend = dst + dst_len;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (op == oend) return 0;
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15) {
+            uint8_t b;
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                mlen += b;
+            } while (b == 255);
         }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || mlen > (size_t)(oend - op)) return -1;
 
-        if (offset >= total_size) break;
+        // cópia byte a byte: o match pode sobrepor a saída
+        const uint8_t *m = op - offset;
+        while (mlen--) *op++ = *m++;
+    }
+    return op == oend ? 0 : -1;
+}
 
-        if (current->next_inode != 0) {
-            current = &inode_table[current->next_inode];
-        } else {
-            current = NULL;
-        }
+/* Le o chunk 'chunk' (chunk_len bytes lógicos) para out; scratch precisa
+ * de COMPRESS_CHUNK_BYTES */
+static int chunkRead(block_cursor_t *cur, uint32_t chunk, size_t chunk_len, char *out, char *scratch) {
+    uint32_t base = chunk * COMPRESS_CHUNK_BLOCKS;
+    uint32_t raw_blocks = (chunk_len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t used = 0;
+    while (used < COMPRESS_CHUNK_BLOCKS) {
+        uint32_t *slot = cursorSlot(cur, base + used, 0);
+        if (!slot || *slot == 0) break;
+        used++;
+    }
+    if (used == 0) {
+        // chunk nunca gravado (buraco): lido como zeros
+        memset(out, 0, chunk_len);
+        return 0;
     }
 
-    buffer[offset] = '\0';
-    *out_bytes = offset;
-    return 0;
+    if (cursorBlocksIO(cur, base, used, scratch, 0) != 0) return -1;
+    if (used >= raw_blocks) {
+        memcpy(out, scratch, chunk_len);
+        return 0;
+    }
+    STAT_ADD(chunks_decompressed, 1);
+    return lzDecompress((uint8_t *)scratch, (size_t)used * BLOCK_SIZE, (uint8_t *)out, chunk_len);
 }
 
-/* Cria link simbolico */
-int createSymlink(int parent_inode, int target_index, const char *link_name, const char *user) {
-    // 1. Verifica se link_name já existe
-    int dummy_output;
-    if (!dirFindEntry(parent_inode, link_name, FILE_SYMLINK, &dummy_output)) return -1; // erro, já existe
-    
+/* Grava o chunk 'chunk', comprimido quando isso economiza blocos. Reaproveita
+ * os blocos que o chunk já tinha e libera os que sobrarem. */
+static int chunkWrite(block_cursor_t *cur, uint32_t chunk, const char *data, size_t chunk_len, char *scratch) {
+    uint32_t base = chunk * COMPRESS_CHUNK_BLOCKS;
+    uint32_t raw_blocks = (chunk_len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t used = raw_blocks;
+
+    size_t clen = 0;
+    if (raw_blocks > 1)
+        clen = lzCompress((const uint8_t *)data, chunk_len, (uint8_t *)scratch, (size_t)(raw_blocks - 1) * BLOCK_SIZE);
+    if (clen > 0) {
+        used = (clen + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        memset(scratch + clen, 0, (size_t)used * BLOCK_SIZE - clen);
+        STAT_ADD(chunks_compressed, 1);
+    } else {
+        memcpy(scratch, data, chunk_len);
+        memset(scratch + chunk_len, 0, (size_t)used * BLOCK_SIZE - chunk_len);
+    }
 
-    inode_t *parent = &inode_table[parent_inode];
-    if (!hasPermission(parent, user, PERM_WRITE)) return -1;
+    // chunk novo: tenta uma faixa contígua; senão, bloco a bloco
+    uint32_t *first = cursorSlot(cur, base, 1);
+    if (!first) return -1;
+    uint32_t goal = inodeBlockGoal(cur->head);
+    int run = *first == 0 ? allocateBlockRunNear(goal, used) : -1;
+    for (uint32_t k = 0; k < COMPRESS_CHUNK_BLOCKS; k++) {
+        uint32_t *slot = cursorSlot(cur, base + k, k < used);
+        if (!slot) {
+            if (k < used) return -1;
+            break;
+        }
+        if (k >= used) {
+            if (*slot) freeBlock(*slot);
+            *slot = 0;
+        } else if (*slot != 0) {
+            if (blockMakePrivate(slot) != 0) return -1;
+        } else {
+            int block = run >= 0 ? run + (int)k : allocateBlockNear(goal);
+            if (block < 0) return -1;
+            *slot = block;
+        }
+    }
+    return cursorBlocksIO(cur, base, used, scratch, 1);
+}
+
+/* Anexa dados a um arquivo comprimido: o último chunk, se incompleto, é
+ * descomprimido, completado e gravado de novo */
+static int compressedAppend(int inode_index, const char *data, size_t data_size) {
+    char *chunk = malloc(COMPRESS_CHUNK_BYTES);
+    char *scratch = malloc(COMPRESS_CHUNK_BYTES);
+    if (!chunk || !scratch) {
+        free(chunk);
+        free(scratch);
+        return -1;
+    }
 
-    // 2. Aloca um novo i-node
-    int inode_index = allocateInode();
     inode_t *inode = &inode_table[inode_index];
-    if (!inode) return -1;
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    size_t written = 0;
+    int res = 0;
 
-    // 3. Preenche campos
-    strncpy(inode->name, link_name, MAX_NAMESIZE-1);
-    inode->name[MAX_NAMESIZE-1] = '\0';
-    inode->type = FILE_SYMLINK;
-    inode->size = 0;
-    inode->link_target_index = target_index;
-    inode->creation_date = time(NULL);
-    inode->modification_date = inode->creation_date;
-    strncpy(inode->creator, user, MAX_NAMESIZE-1);
-    inode->creator[MAX_NAMESIZE-1] = '\0';
-    strncpy(inode->owner, user, MAX_NAMESIZE-1);
-    inode->owner[MAX_NAMESIZE-1] = '\0';
-    inode->permissions = inode_table[target_index].permissions;
+    while (written < data_size) {
+        uint32_t c = inode->size / COMPRESS_CHUNK_BYTES;
+        size_t fill = inode->size % COMPRESS_CHUNK_BYTES;
+        if (fill > 0 && chunkRead(&cur, c, fill, chunk, scratch) != 0) { res = -1; break; }
 
-    if (dirAddEntry(parent_inode, link_name, FILE_SYMLINK, inode_index) != 0){
-        freeInode(inode_index);
-        return -1;
+        size_t n = COMPRESS_CHUNK_BYTES - fill;
+        if (n > data_size - written) n = data_size - written;
+        memcpy(chunk + fill, data + written, n);
+        if (chunkWrite(&cur, c, chunk, fill + n, scratch) != 0) { res = -1; break; }
+
+        written += n;
+        inode->size += n;
     }
 
-    sync_inode(inode_index);
-    return 0;
+    free(chunk);
+    free(scratch);
+    return res;
 }
 
-int deleteSymlink(int parent_inode, int target_inode_idx, const char *user){
-    if (parent_inode < 0 || parent_inode >= MAX_INODES || !target_inode_idx) return -1;
+/* Le [offset, offset + len) de um arquivo comprimido, um chunk por vez */
+static int compressedRead(int inode_index, size_t offset, char *buffer, size_t len) {
+    char *chunk = malloc(COMPRESS_CHUNK_BYTES);
+    char *scratch = malloc(COMPRESS_CHUNK_BYTES);
+    if (!chunk || !scratch) {
+        free(chunk);
+        free(scratch);
+        return -1;
+    }
 
-    inode_t *target = &inode_table[target_inode_idx];
-    if (!hasPermission(target, user, PERM_WRITE)) return -1;
+    size_t size = inode_table[inode_index].size;
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    size_t done = 0;
+    int res = 0;
+
+    while (done < len) {
+        size_t pos = offset + done;
+        uint32_t c = pos / COMPRESS_CHUNK_BYTES;
+        size_t inner = pos % COMPRESS_CHUNK_BYTES;
+        size_t chunk_start = (size_t)c * COMPRESS_CHUNK_BYTES;
+        size_t chunk_len = size - chunk_start < COMPRESS_CHUNK_BYTES ? size - chunk_start : COMPRESS_CHUNK_BYTES;
+
+        // chunk inteiro pedido: descomprime direto no buffer do chamador
+        char *out = (inner == 0 && len - done >= chunk_len) ? buffer + done : chunk;
+        if (chunkRead(&cur, c, chunk_len, out, scratch) != 0) { res = -1; break; }
+
+        size_t n = chunk_len - inner;
+        if (n > len - done) n = len - done;
+        if (out == chunk) memcpy(buffer + done, chunk + inner, n);
+        done += n;
+    }
 
-    if (target->type != FILE_SYMLINK) return -1;
+    free(chunk);
+    free(scratch);
+    return res;
+}
 
-    if (dirRemoveEntry(parent_inode, target->name, target->type) == -1) return -1;
-    freeInode(target_inode_idx);
-    sync_fs();
+/* Muda o tamanho de um arquivo comprimido. O último chunk, se incompleto,
+ * é regravado com o novo comprimento (completado com zeros ao crescer,
+ * cortado ao encolher); os chunks além do fim são liberados e os que o
+ * arquivo ganha ficam como buracos. */
+static int compressedResize(int inode_index, size_t size) {
+    inode_t *inode = &inode_table[inode_index];
+    size_t old = inode->size;
+    size_t edge = size < old ? size : old;
+    uint32_t c = edge / COMPRESS_CHUNK_BYTES;
+    size_t chunk_start = (size_t)c * COMPRESS_CHUNK_BYTES;
+    size_t old_len = old - chunk_start < COMPRESS_CHUNK_BYTES ? old - chunk_start : COMPRESS_CHUNK_BYTES;
+    size_t new_len = size - chunk_start < COMPRESS_CHUNK_BYTES ? size - chunk_start : COMPRESS_CHUNK_BYTES;
+
+    if (edge % COMPRESS_CHUNK_BYTES != 0 && old_len != new_len) {
+        char *chunk = malloc(COMPRESS_CHUNK_BYTES);
+        char *scratch = malloc(COMPRESS_CHUNK_BYTES);
+        block_cursor_t cur;
+        cursorInit(&cur, inode_index);
+        int res = chunk && scratch ? chunkRead(&cur, c, old_len, chunk, scratch) : -1;
+        if (res == 0) {
+            if (new_len > old_len) memset(chunk + old_len, 0, new_len - old_len);
+            res = chunkWrite(&cur, c, chunk, new_len, scratch);
+        }
+        free(chunk);
+        free(scratch);
+        if (res != 0) return -1;
+    }
+
+    if (size < old) {
+        uint32_t chunks = (size + COMPRESS_CHUNK_BYTES - 1) / COMPRESS_CHUNK_BYTES;
+        blocksFreeFrom(inode_index, chunks * COMPRESS_CHUNK_BLOCKS);
+    }
+    inode->size = size;
     return 0;
 }
 
-/* Encontra inode a partir de um path */
-int resolvePath(const char *path, int current_inode, int *inode_out) {
-    if (!path || !inode_out) return -1;
+/* Grava [offset, offset + len) de um arquivo comprimido: cada chunk tocado é
+ * descomprimido, alterado e gravado de novo. Escrever além do fim primeiro
+ * estende o arquivo até offset, deixando buracos no meio. */
+static int compressedWriteAt(int inode_index, size_t offset, const char *data, size_t len) {
+    inode_t *inode = &inode_table[inode_index];
+    if (offset > inode->size && compressedResize(inode_index, offset) != 0) return -1;
 
-    int current = current_inode;
+    char *chunk = malloc(COMPRESS_CHUNK_BYTES);
+    char *scratch = malloc(COMPRESS_CHUNK_BYTES);
+    if (!chunk || !scratch) {
+        free(chunk);
+        free(scratch);
+        return -1;
+    }
 
-    // Caminho absoluto
-    if (path[0] == '~') {
-        current = ROOT_INODE;
-        path++; // pula o '~'
-        if (*path == '/') path++; // pula barra inicial
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    size_t done = 0;
+    int res = 0;
+
+    while (done < len) {
+        size_t pos = offset + done;
+        uint32_t c = pos / COMPRESS_CHUNK_BYTES;
+        size_t inner = pos % COMPRESS_CHUNK_BYTES;
+        size_t chunk_start = (size_t)c * COMPRESS_CHUNK_BYTES;
+        size_t old_len = inode->size > chunk_start ? inode->size - chunk_start : 0;
+        if (old_len > COMPRESS_CHUNK_BYTES) old_len = COMPRESS_CHUNK_BYTES;
+
+        size_t n = COMPRESS_CHUNK_BYTES - inner;
+        if (n > len - done) n = len - done;
+        size_t new_len = inner + n > old_len ? inner + n : old_len;
+
+        // chunk inteiramente sobrescrito dispensa a leitura
+        if (old_len > 0 && !(inner == 0 && n >= old_len) &&
+            chunkRead(&cur, c, old_len, chunk, scratch) != 0) { res = -1; break; }
+        memcpy(chunk + inner, data + done, n);
+        if (chunkWrite(&cur, c, chunk, new_len, scratch) != 0) { res = -1; break; }
+
+        done += n;
+        if (chunk_start + new_len > inode->size) inode->size = chunk_start + new_len;
     }
-    
-    char token[256];
-    const char *p = path;
-    while (*p) {
-        int i = 0;
-        while (*p && *p != '/') token[i++] = *p++;
-        token[i] = '\0';
-        if (*p == '/') p++; // pula barra
 
-        if (strcmp(token, ".") == 0 || token[0] == '\0') continue;
+    free(chunk);
+    free(scratch);
+    return res;
+}
 
-        if (strcmp(token, "..") == 0) {
-            int parent_inode;
-            if (dirFindEntry(current, "..", FILE_DIRECTORY, &parent_inode) != 0) return -1;
-            current = parent_inode;
-            continue;
-        }
-        
-        int next_inode;
-        const char *next_slash = strchr(p, '/');
-        int type = next_slash ? FILE_DIRECTORY : FILE_ANY;
+/* Liga ou desliga a compressão de um arquivo, regravando o conteúdo */
+int setFileCompression(int inode_index, int enable, int uid) {
+    if (inode_index < 0 || inode_index >= MAX_INODES || !validUid(uid)) return -1;
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->type != FILE_REGULAR) return -1;
+    if (!hasPermission(inode, uid, PERM_WRITE)) return -1;
+    if (!(inode->flags & INODE_COMPRESSED) == !enable) return 0;
+
+    size_t size = inode->size, got = 0;
+    char *content = malloc(size + 1);
+    if (!content) return -1;
+    if (readContentFromInode(inode_index, content, size + 1, &got, uid) != 0) {
+        free(content);
+        return -1;
+    }
 
-        if (dirFindEntry(current, token, type, &next_inode) != 0) return -1;
+    clearInodeContent(inode_index);
+    if (enable) inode->flags |= INODE_COMPRESSED;
+    else inode->flags &= ~INODE_COMPRESSED;
 
-        int depth = 0;
-        while (inode_table[next_inode].type == FILE_SYMLINK) {
-            next_inode = inode_table[next_inode].link_target_index;
-            if (++depth > 16) return -1; // evita loops
-        }
+    int res = got ? addContentToInode(inode_index, content, got, uid) : sync_fs();
+    free(content);
+    return res;
+}
 
-        current = next_inode;
+/* Liga ou desliga uma opção FS_FEAT_* do volume (persistida no header) */
+int setVolumeFeature(uint32_t feature, int enable) {
+    if (!header_has_state) return -1;
+    if (enable) fs_features |= feature;
+    else fs_features &= ~feature;
+    if (diskWrite(&fs_features, sizeof(fs_features), offsetof(fs_header_t, features)) != 0) return -1;
+    diskSync();
+    return 0;
+}
+
+/* Move o conteúdo inline para um bloco de dados (ou para o primeiro chunk,
+ * se o arquivo é comprimido), para o arquivo crescer */
+static int inlinePromote(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    char block_buffer[BLOCK_SIZE] = {0};
+    memcpy(block_buffer, inode->inline_data, inode->size);
+
+    if (inode->flags & INODE_COMPRESSED) {
+        size_t size = inode->size;
+        memset(inode->blocks, 0, sizeof(inode->blocks));
+        inode->flags &= ~INODE_INLINE;
+        inode->size = 0;
+        return compressedAppend(inode_index, block_buffer, size);
     }
 
-    *inode_out = current;
+    int block = allocateBlockNear(inodeBlockGoal(inode_index));
+    if (block < 0) return -1;
+    if (writeBlock(block, block_buffer) != 0) {
+        freeBlock(block);
+        return -1;
+    }
+    memset(inode->blocks, 0, sizeof(inode->blocks));
+    inode->blocks[0] = block;
+    inode->flags &= ~INODE_INLINE;
     return 0;
 }
 
-/* Separa path entre caminho do pai e o nome do arquivo */
-static void splitPath(const char *full_path, char *dir_path, char *base_name) {
-    const char *last_slash = strrchr(full_path, '/');
-    if (last_slash) {
-        size_t dir_len = last_slash - full_path;
-        strncpy(dir_path, full_path, dir_len);
-        dir_path[dir_len] = '\0';
-        strcpy(base_name, last_slash + 1);
-    } else {
-        strcpy(dir_path, "."); // diretório atual
-        strcpy(base_name, full_path);
+/* Devolve os blocos reservados (alocados além do fim, por fallocate) nos
+ * slots [first, end): o arquivo vai passar a cobri-los sem gravá-los, e o
+ * conteúdo deles não vale nada. Viram buracos. */
+static void reservationDrop(int inode_index, uint32_t first, uint32_t end) {
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    for (uint32_t logical = first; logical < end; logical++) {
+        uint32_t *slot = cursorSlot(&cur, logical, 0);
+        if (!slot) return;
+        if (*slot == 0) continue;
+        freeBlock(*slot);
+        *slot = 0;
     }
 }
 
+/* Grava len bytes a partir de offset nos blocos do arquivo, pela posição
+ * lógica: slots vazios (buracos ou além do fim) recebem blocos novos, com o
+ * que não foi escrito zerado; blocos existentes são lidos, alterados e
+ * regravados (copiados antes, se compartilhados). Blocos reservados além do
+ * fim são usados como estão, sem leitura. Com dedup, blocos novos e blocos
+ * que ficam completos podem ser compartilhados. Soma em *new_blocks os
+ * blocos alocados. Não mexe no tamanho do arquivo. */
+static int blocksWriteAt(int inode_index, size_t offset, const char *data, size_t len, uint32_t *new_blocks) {
+    int dedup = fs_features & FS_FEAT_DEDUP;
+    uint32_t eof_blocks = (inode_table[inode_index].size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    char block_buffer[BLOCK_SIZE];
+
+    size_t done = 0;
+    while (done < len) {
+        size_t pos = offset + done;
+        uint32_t logical = pos / BLOCK_SIZE;
+        size_t inner = pos % BLOCK_SIZE;
+        size_t n = BLOCK_SIZE - inner < len - done ? BLOCK_SIZE - inner : len - done;
+
+        uint32_t *slot = cursorSlot(&cur, logical, 1);
+        if (!slot) return -1;
+
+        if (*slot == 0) {
+            // alvo: logo depois do bloco lógico anterior, ou o grupo do inode
+            uint32_t *prev = logical > 0 ? cursorSlot(&cur, logical - 1, 0) : NULL;
+            uint32_t goal = prev && *prev ? *prev + 1 : inodeBlockGoal(inode_index);
+            memset(block_buffer, 0, BLOCK_SIZE);
+            memcpy(block_buffer + inner, data + done, n);
+            // bloco idêntico já gravado: só ganha uma referência
+            int block = dedup ? dedupStore(block_buffer, goal) : allocateBlockNear(goal);
+            if (block < 0) return -1;
+            if (!dedup && writeBlock(block, block_buffer) != 0) {
+                freeBlock(block);
+                return -1;
+            }
+            *slot = block;
+            (*new_blocks)++;
+        } else {
+            // bloco reservado além do fim: nunca foi gravado
+            if (logical >= eof_blocks) memset(block_buffer, 0, BLOCK_SIZE);
+            else if (n < BLOCK_SIZE && readBlock(*slot, block_buffer) != 0) return -1;
+            memcpy(block_buffer + inner, data + done, n);
+
+            // bloco que ficou completo não muda mais: com dedup, pode ser
+            // compartilhado (o reservado fica, para manter a faixa contígua)
+            int full = dedup && inner + n == BLOCK_SIZE;
+            uint32_t h = full ? blockHash(block_buffer) : 0;
+            int shared = full && logical < eof_blocks ? dedupFind(block_buffer, h) : -1;
+            if (shared >= 0) {
+                freeBlock(*slot);
+                *slot = shared;
+            } else {
+                // bloco compartilhado (dedup ou snapshot): grava numa cópia
+                if (blockMakePrivate(slot) != 0 || writeBlock(*slot, block_buffer) != 0) return -1;
+                if (full) dedupInsert(*slot, h);
+            }
+        }
+        done += n;
+    }
+    return 0;
+}
 
-/* ---- Comandos de FS ---- */
+/* Adiciona conteudo a um inode */
+int addContentToInode(int inode_index, const char *data, size_t data_size, int uid) {
+    if (!data || !validUid(uid)) return -1;
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
 
-// cd (muda diretorio)
-int cmd_cd(int *current_inode, const char *path) {
-    if (!current_inode || !path) return -1;
+    inode_t *inode = &inode_table[inode_index];
 
-    int target_inode;
-    if (resolvePath(path, *current_inode, &target_inode) != 0) return -1;
-
-    inode_t *inode = &inode_table[target_inode];
-    if (inode->type != FILE_DIRECTORY) return -1;
-
-    *current_inode = target_inode;
-    return 0;
-}
-
-// mkdir (cria diretorio) com criação recursiva
-int cmd_mkdir(int current_inode, const char *full_path, const char *user) {
-    if (!full_path || !user) return -1;
-
-    char dir_path[256], name[256];
-    splitPath(full_path, dir_path, name);
-
-    int parent_inode;
-    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
-        if (createDirectoriesRecursively(dir_path, current_inode, user) != 0) return -1;
-        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    // Permissão de escrita
+    if (!hasPermission(inode, uid, PERM_WRITE)) return -1;
+    if (trace_enabled) trace_record(TRACE_LOGICAL_WRITE, inode_index, data_size, stats_now());
+
+    // Arquivos pequenos ficam no próprio inode, sem alocar nem escrever blocos
+    int is_inline = inode->flags & INODE_INLINE;
+    if (inode->type == FILE_REGULAR && inode->next_inode == 0 &&
+        (is_inline || (inode->size == 0 && inode->blocks[0] == 0)) &&
+        inode->size + data_size <= INODE_INLINE_MAX) {
+        if (!is_inline) {
+            memset(inode->inline_data, 0, INODE_INLINE_MAX);
+            inode->flags |= INODE_INLINE;
+        }
+        memcpy(inode->inline_data + inode->size, data, data_size);
+        inode->size += data_size;
+        inode_meta[inode_index].modification_date = time(NULL);
+        usageAdd(inode_index, data_size, 0);
+        sync_inode(inode_index);
+        return 0;
+    }
+    if (is_inline && inlinePromote(inode_index) != 0) return -1;
+
+    if (inode->flags & INODE_COMPRESSED) {
+        int res = compressedAppend(inode_index, data, data_size);
+        inode_meta[inode_index].modification_date = time(NULL);
+        usageRefresh(inode_index);
+        if (sync_fs() != 0) return -1;
+        return res;
     }
 
-    return createDirectory(parent_inode, name, user);
-}
-
-// touch (cria arquivo) com criação recursiva
-int cmd_touch(int current_inode, const char *full_path, const char *user) {
-    if (!full_path || !user) return -1;
-
-    char dir_path[256], name[256];
-    splitPath(full_path, dir_path, name);
+    // o bloco de um arquivo recém-promovido de inline também é novo
+    uint32_t new_blocks = is_inline ? 1 : 0;
+    size_t file_offset = inode->size + data_size;
+    if (blocksWriteAt(inode_index, inode->size, data, data_size, &new_blocks) != 0) return -1;
 
-    int parent_inode;
-    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
-        if (createDirectoriesRecursively(dir_path, current_inode, user) != 0) return -1;
-        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
-    }
+    // atualiza metadados do inode raiz (tamanho e timestamp)
+    usageAdd(inode_index, (int64_t)file_offset - inode->size, new_blocks);
+    inode->size = file_offset;
+    inode_meta[inode_index].modification_date = time(NULL);
 
-    return createFile(parent_inode, name, user);
+    // persiste mudanças
+    return sync_fs();
 }
 
-// echo > (sobrescreve conteúdo) com criação recursiva
-int cmd_echo_arrow(int current_inode, const char *full_path, const char *content, const char *user) {
-    if (!full_path || !content || !user) return -1;
+/* Le conteudo de um inode */
+int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, int uid) {
+    if (!buffer || !out_bytes || !validUid(uid)) return -1;
 
-    char dir_path[256], name[256];
-    splitPath(full_path, dir_path, name);
+    int target_inode = inode_number;
+    int depth = 0;
 
-    int parent_inode;
-    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
-        if (createDirectoriesRecursively(dir_path, current_inode, user) != 0) return -1;
-        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    // Segue links simbólicos, com limite de 16
+    while (inode_table[target_inode].type == FILE_SYMLINK) {
+        target_inode = inode_table[target_inode].link_target_index;
+        if (++depth > 16) return -1; // evita loop infinito
     }
 
-    int inode_index;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
-        if (createFile(parent_inode, name, user) != 0) return -1;
-        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
-    }
+    inode_t *inode = &inode_table[target_inode];
+    if (!inode || !hasPermission(inode, uid, PERM_READ)) return -1;
 
-    inode_t *inode = &inode_table[inode_index];
-    inode->size = 0;  
-    if (inode->next_inode) freeInode(inode->next_inode);
-    inode->next_inode = 0;
-    for (int i = 0; i < BLOCKS_PER_INODE; i++) inode->blocks[i] = 0;
+    size_t total_size = inode->size;
+    if (buffer_size < total_size + 1) return -1; // espaço para '\0'
 
-    return addContentToInode(inode_index, content, strlen(content), user);
+    // lê por posição: buracos de arquivos esparsos voltam como zeros
+    if (readContentAt(target_inode, 0, buffer, total_size, out_bytes, uid) != 0) return -1;
+    buffer[*out_bytes] = '\0';
+    return 0;
 }
 
-// echo >> (anexa conteúdo) com criação recursiva
-int cmd_echo_arrow_arrow(int current_inode, const char *full_path, const char *content, const char *user) {
-    if (!full_path || !content || !user) return -1;
+/* Reserva blocos para os slots vazios em [first, first + count) do mapa de
+ * blocos, em faixas contíguas sempre que possível; cada faixa tenta
+ * continuar fisicamente o bloco lógico anterior */
+static int preallocateRange(int inode_index, uint32_t first, uint32_t count) {
+    uint32_t logical = first, end = first + count;
+    block_cursor_t cur, scan;
+    cursorInit(&cur, inode_index);
+    uint32_t prev = 0;
+    if (first > 0) {
+        uint32_t *slot = cursorSlot(&cur, first - 1, 0);
+        if (slot) prev = *slot;
+    }
 
+    while (logical < end) {
+        uint32_t *slot = cursorSlot(&cur, logical, 1);
+        if (!slot) return -1;
+        if (*slot != 0) {
+            prev = *slot;
+            logical++;
+            continue;
+        }
 
-    char dir_path[256], name[256];
-    splitPath(full_path, dir_path, name);
+        // quantos slots vazios seguidos a partir daqui
+        uint32_t run = 0;
+        scan = cur;
+        while (logical + run < end) {
+            slot = cursorSlot(&scan, logical + run, 1);
+            if (!slot) return -1;
+            if (*slot != 0) break;
+            run++;
+        }
 
-    int parent_inode;
-    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
-        if (createDirectoriesRecursively(dir_path, current_inode, user) != 0) return -1;
-        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
-    }
+        // primeiro, logo depois do bloco anterior do arquivo
+        int first_block = -1;
+        uint32_t got = prev ? allocateBlockRunAt(prev + 1, run) : 0;
+        if (got > 0) {
+            first_block = prev + 1;
+            run = got;
+        } else {
+            // senão, a faixa inteira em outro lugar; se o disco estiver fragmentado, faixas menores
+            uint32_t goal = prev ? prev + 1 : inodeBlockGoal(inode_index);
+            while (run > 0 && (first_block = allocateBlockRunNear(goal, run)) < 0) run /= 2;
+            if (first_block < 0) return -1;
+        }
 
-    int inode_index;
-    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
-        if (createFile(parent_inode, name, user) != 0) return -1;
-        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
+        for (uint32_t k = 0; k < run; k++)
+            *cursorSlot(&cur, logical + k, 0) = first_block + k;
+        logical += run;
+        prev = first_block + run - 1;
     }
-
-    return addContentToInode(inode_index, content, strlen(content), user);
+    return 0;
 }
 
+/* Reserva blocos para os primeiros 'size' bytes do inode antes da escrita,
+ * alocando faixas contíguas sempre que possível. Se faltar espaço no meio,
+ * devolve tudo o que ficou reservado além do fim atual do arquivo. */
+int preallocateInode(int inode_index, size_t size) {
+    if (inode_index < 0 || inode_index >= MAX_INODES) return -1;
+    if (preallocateRange(inode_index, 0, (size + BLOCK_SIZE - 1) / BLOCK_SIZE) == 0) return 0;
+    blocksFreeFrom(inode_index, (inode_table[inode_index].size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    return -1;
+}
 
-// cat (le conteudo de arquivo)
-int cmd_cat(int current_inode, const char *path, const char *user) {
-    if (!path || !user) return -1;
-    // resolve o inode do arquivo
-    int target_inode;
-    if (resolvePath(path, current_inode, &target_inode) != 0)
-        return -1;
+/* Le ou escreve 'count' blocos lógicos do arquivo, agrupando os blocos
+ * fisicamente contíguos em uma única operação */
+static int inodeBlocksIO(int inode_index, uint32_t first_logical, uint32_t count, void *buffer, int write) {
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    return cursorBlocksIO(&cur, first_logical, count, buffer, write);
+}
 
-    // procura o inode pelo indice
-    inode_t *inode = &inode_table[target_inode];
-    if (!inode || inode->type != FILE_REGULAR) {
-        fprintf(stderr, "Erro: %s não é um arquivo regular.\n", path);
-        return -1;
-    }
+/* Le até 'len' bytes do arquivo a partir de 'offset', em blocos contíguos */
+int readContentAt(int inode_number, size_t offset, char *buffer, size_t len, size_t *out_bytes, int uid) {
+    if (!buffer || !out_bytes || !validUid(uid)) return -1;
+    if (inode_number < 0 || inode_number >= MAX_INODES) return -1;
 
-    // assegura que há permissão para leitura
-    if (!hasPermission(inode, user, PERM_READ)) {
-        fprintf(stderr, "Erro: permissão negada para %s.\n", path);
-        return -1;
+    int target_inode = inode_number;
+    int depth = 0;
+    while (inode_table[target_inode].type == FILE_SYMLINK) {
+        target_inode = inode_table[target_inode].link_target_index;
+        if (++depth > 16) return -1;
     }
 
-    size_t filesize = inode->size;
-    if (filesize == 0) return 0; // arquivo vazio
+    inode_t *inode = &inode_table[target_inode];
+    if (!hasPermission(inode, uid, PERM_READ)) return -1;
 
-    char *buffer = malloc(filesize + 1);
-    if (!buffer) return -1;
+    *out_bytes = 0;
+    if (offset >= inode->size) return 0;
+    if (len > inode->size - offset) len = inode->size - offset;
 
-    // Lê arquivo
-    size_t bytes_read = 0;
-    if (readContentFromInode(target_inode, buffer, filesize + 1, &bytes_read, user) != 0) {
-        free(buffer);
-        return -1;
+    if (inode->flags & INODE_INLINE) {
+        memcpy(buffer, inode->inline_data + offset, len);
+        *out_bytes = len;
+        return 0;
+    }
+    if (inode->flags & INODE_COMPRESSED) {
+        if (compressedRead(target_inode, offset, buffer, len) != 0) return -1;
+        *out_bytes = len;
+        return 0;
     }
 
-    buffer[bytes_read] = '\0';
-    printf("%s\n", buffer);
+    char bounce[BLOCK_SIZE];
+    size_t done = 0;
+    while (done < len) {
+        size_t pos = offset + done;
+        uint32_t logical = pos / BLOCK_SIZE;
+        size_t inner = pos % BLOCK_SIZE;
+
+        if (inner == 0 && len - done >= BLOCK_SIZE) {
+            // blocos inteiros vão direto para o buffer do chamador
+            uint32_t count = (len - done) / BLOCK_SIZE;
+            if (inodeBlocksIO(target_inode, logical, count, buffer + done, 0) != 0) return -1;
+            done += (size_t)count * BLOCK_SIZE;
+        } else {
+            // início ou fim parcial passa por um bloco intermediário
+            if (inodeBlocksIO(target_inode, logical, 1, bounce, 0) != 0) return -1;
+            size_t n = BLOCK_SIZE - inner;
+            if (n > len - done) n = len - done;
+            memcpy(buffer + done, bounce + inner, n);
+            done += n;
+        }
+    }
 
-    free(buffer);
+    *out_bytes = done;
     return 0;
 }
 
-// cp 9copia arquivo) com criaçãp recursiva
-int cmd_cp(int current_inode, const char *src_path, const char *src_name,
-           const char *dst_path, const char *dst_name, const char *user) {
-    if (!src_name || !dst_name || !user) return -1;
-
-    int src_parent_inode = current_inode;
-    int dst_parent_inode = current_inode;
-    const char *src_base = src_name;
-    const char *dst_base = dst_name;
-
-    // Se src_name contem '/', separe dir e base
-    char tmpbuf[256];
-    const char *slash = strrchr(src_name, '/');
-    if (slash) {
-        size_t dirlen = slash - src_name;
-        if (dirlen >= sizeof(tmpbuf)) return -1;
-        strncpy(tmpbuf, src_name, dirlen);
-        tmpbuf[dirlen] = '\0';
-        src_base = slash + 1;
-        if (resolvePath(tmpbuf, current_inode, &src_parent_inode) != 0) return -1;
-    } else {
-        // se foi passado um src_path != "." resolva-o
-        if (src_path && src_path[0] != '\0' && strcmp(src_path, ".") != 0) {
-            if (resolvePath(src_path, current_inode, &src_parent_inode) != 0) return -1;
-        }
+/* Segue links simbólicos até um arquivo regular em que uid pode escrever */
+static int writableTarget(int inode_number, int uid) {
+    if (inode_number < 0 || inode_number >= MAX_INODES || !validUid(uid)) return -1;
+    int target_inode = inode_number;
+    int depth = 0;
+    while (inode_table[target_inode].type == FILE_SYMLINK) {
+        target_inode = inode_table[target_inode].link_target_index;
+        if (++depth > 16) return -1;
     }
+    inode_t *inode = &inode_table[target_inode];
+    if (inode->type != FILE_REGULAR || !hasPermission(inode, uid, PERM_WRITE)) return -1;
+    return target_inode;
+}
 
-    // Processa dst: se dst_name contem '/', separe dir e base
-    slash = strrchr(dst_name, '/');
-    if (slash) {
-        size_t dirlen = slash - dst_name;
-        if (dirlen >= sizeof(tmpbuf)) return -1;
-        strncpy(tmpbuf, dst_name, dirlen);
-        tmpbuf[dirlen] = '\0';
-        dst_base = slash + 1;
+/* Grava len bytes na posição offset do arquivo (como pwrite). Gravar além
+ * do fim estende o arquivo: o intervalo entre o fim antigo e offset vira
+ * buraco, sem blocos alocados, e é lido como zeros. */
+int writeContentAt(int inode_number, size_t offset, const char *data, size_t len, int uid) {
+    if (!data) return -1;
+    int target_inode = writableTarget(inode_number, uid);
+    if (target_inode < 0) return -1;
+    inode_t *inode = &inode_table[target_inode];
 
-        // tenta resolver o diretório; se não existir, tenta criar recursivamente
-        if (resolvePath(tmpbuf, current_inode, &dst_parent_inode) != 0) {
-            if (createDirectoriesRecursively(tmpbuf, current_inode, user) != 0) return -1;
-            if (resolvePath(tmpbuf, current_inode, &dst_parent_inode) != 0) return -1;
-        }
-    } else {
-        // se foi passado um dst_path != "." resolva-o (p.ex.: cp arq dir/arq2 onde dst_path veio como "dir")
-        if (dst_path && dst_path[0] != '\0' && strcmp(dst_path, ".") != 0) {
-            if (resolvePath(dst_path, current_inode, &dst_parent_inode) != 0) {
-                // tentar criar o caminho de destino
-                if (createDirectoriesRecursively(dst_path, current_inode, user) != 0) return -1;
-                if (resolvePath(dst_path, current_inode, &dst_parent_inode) != 0) return -1;
+    if (len == 0) return 0;
+    if (offset > UINT32_MAX || len > UINT32_MAX - offset) return -1;
+    if (offset == inode->size) return addContentToInode(target_inode, data, len, uid);
+    if (trace_enabled) trace_record(TRACE_LOGICAL_WRITE, target_inode, len, stats_now());
+
+    size_t end = offset + len;
+    if (inode->flags & INODE_INLINE) {
+        if (end <= INODE_INLINE_MAX) {
+            // o que passa do tamanho atual já é zero
+            memcpy(inode->inline_data + offset, data, len);
+            if (end > inode->size) {
+                usageAdd(target_inode, end - inode->size, 0);
+                inode->size = end;
             }
+            inode_meta[target_inode].modification_date = time(NULL);
+            sync_inode(target_inode);
+            return 0;
         }
+        if (inlinePromote(target_inode) != 0) return -1;
     }
 
-    // Agora temos src_parent_inode + src_base e dst_parent_inode + dst_base
-    int src_file_inode;
-    if (dirFindEntry(src_parent_inode, src_base, FILE_REGULAR, &src_file_inode) != 0) {
-        // tenta também aceitar symlink/any (se quiser copiar links) → mas por enquanto requer arquivo regular
-        return -1;
+    int res;
+    if (inode->flags & INODE_COMPRESSED) {
+        res = compressedWriteAt(target_inode, offset, data, len);
+    } else {
+        uint32_t new_blocks = 0;
+        if (offset > inode->size)
+            reservationDrop(target_inode, (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE, offset / BLOCK_SIZE);
+        res = blocksWriteAt(target_inode, offset, data, len, &new_blocks);
+        if (res == 0 && end > inode->size) inode->size = end;
     }
+    inode_meta[target_inode].modification_date = time(NULL);
+    usageRefresh(target_inode);
+    if (sync_fs() != 0) return -1;
+    return res;
+}
 
-    inode_t *src_inode = &inode_table[src_file_inode];
-    if (!src_inode) return -1;
+/* Muda o tamanho do arquivo (como truncate). Crescer só muda o tamanho: o
+ * trecho novo é um buraco. Encolher libera os blocos além do novo fim e
+ * zera o resto do último bloco, para um crescimento posterior ler zeros. */
+int truncateInode(int inode_number, size_t size, int uid) {
+    int target_inode = writableTarget(inode_number, uid);
+    if (target_inode < 0) return -1;
+    inode_t *inode = &inode_table[target_inode];
 
-    // Lê o conteúdo diretamente por inode
-    char *buffer = malloc(src_inode->size + 1);
-    if (!buffer) return -1;
-    size_t bytes_read = 0;
-    if (readContentFromInode(src_file_inode, buffer, src_inode->size + 1, &bytes_read, user) != 0) {
-        free(buffer);
-        return -1;
+    if (size > UINT32_MAX) return -1;
+    if (size == inode->size) return 0;
+
+    if (inode->flags & INODE_INLINE) {
+        if (size <= INODE_INLINE_MAX) {
+            if (size < inode->size) memset(inode->inline_data + size, 0, inode->size - size);
+            inode->size = size;
+            inode_meta[target_inode].modification_date = time(NULL);
+            usageRefresh(target_inode);
+            sync_inode(target_inode);
+            return 0;
+        }
+        if (inlinePromote(target_inode) != 0) return -1;
     }
 
-    // Cria arquivo destino se necessário
-    int dst_file_inode;
-    if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
-        if (createFile(dst_parent_inode, dst_base, user) != 0) {
-            free(buffer);
-            return -1;
-        }
-        if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
-            free(buffer);
-            return -1;
-        }
+    int res = 0;
+    if (inode->flags & INODE_COMPRESSED) {
+        res = compressedResize(target_inode, size);
     } else {
-        // Se o arquivo já existe, precisamos sobrescrever: zera inode antes de escrever
-        inode_t *dst_inode = &inode_table[dst_file_inode];
-        dst_inode->size = 0;
-        dst_inode->next_inode = 0;
-        for (int i = 0; i < BLOCKS_PER_INODE; ++i) dst_inode->blocks[i] = 0;
+        if (size < inode->size) {
+            blocksFreeFrom(target_inode, (size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+
+            block_cursor_t cur;
+            cursorInit(&cur, target_inode);
+            uint32_t *slot = size % BLOCK_SIZE ? cursorSlot(&cur, size / BLOCK_SIZE, 0) : NULL;
+            if (slot && *slot) {
+                char block_buffer[BLOCK_SIZE];
+                size_t inner = size % BLOCK_SIZE;
+                if (readBlock(*slot, block_buffer) != 0) res = -1;
+                memset(block_buffer + inner, 0, BLOCK_SIZE - inner);
+                // bloco compartilhado (dedup ou snapshot): grava numa cópia
+                if (res == 0 && (blockMakePrivate(slot) != 0 || writeBlock(*slot, block_buffer) != 0)) res = -1;
+            }
+        } else {
+            // o trecho novo é buraco, mesmo onde havia reserva
+            reservationDrop(target_inode, (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE,
+                            (size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        }
+        if (res == 0) inode->size = size;
     }
-
-    // Escreve no inode destino usando addContentToInode
-    int res = addContentToInode(dst_file_inode, buffer, bytes_read, user);
-    free(buffer);
+    inode_meta[target_inode].modification_date = time(NULL);
+    usageRefresh(target_inode);
+    if (sync_fs() != 0) return -1;
     return res;
 }
 
+/* Reserva blocos contíguos para os próximos 'length' bytes do arquivo
+ * (como fallocate com FALLOC_FL_KEEP_SIZE): nada é gravado e o tamanho não
+ * muda. Os appends seguintes ocupam a reserva em vez de alocar blocos onde
+ * houver espaço, então um arquivo que cresce aos poucos continua contíguo.
+ * Arquivos comprimidos não aceitam reserva. */
+int fallocateInode(int inode_number, size_t length, int uid) {
+    int target_inode = writableTarget(inode_number, uid);
+    if (target_inode < 0) return -1;
+    inode_t *inode = &inode_table[target_inode];
 
+    if (inode->flags & INODE_COMPRESSED) return -1;
+    if (length == 0) return 0;
+    if (length > UINT32_MAX - inode->size) return -1;
+    if ((inode->flags & INODE_INLINE) && inlinePromote(target_inode) != 0) return -1;
 
-// mv (move)
-int cmd_mv(int current_inode, const char *src_path, const char *src_name,
-           const char *dst_path, const char *dst_name, const char *user) {
-    // Copia o arquivo
-    if (cmd_cp(current_inode, src_path, src_name, dst_path, dst_name, user) != 0) return -1;
-
-    // Apaga o arquivo de origem
-    int src_parent_inode;
-    if (resolvePath(src_path, current_inode, &src_parent_inode) != 0) return -1;
-
-    return deleteFile(src_parent_inode, src_name, user);
+    uint32_t first = (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t end = (inode->size + length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int res = preallocateRange(target_inode, first, end - first);
+    usageRefresh(target_inode);
+    if (sync_fs() != 0) return -1;
+    return res;
 }
 
-
-// ln -s (cria link simbolico)
-int cmd_ln_s(int current_inode,
-             const char *target_path,
-             const char *link_path,
-             const char *user) {
-    if (!target_path || !link_path || !user)
-        return -1;
-
-    int target_index;
-    if (resolvePath(target_path, current_inode, &target_index) != 0) return -1;
+/* Cria link simbolico */
+int createSymlink(int parent_inode, int target_index, const char *link_name, int uid) {
+    // 1. Verifica se link_name já existe
+    int dummy_output;
+    if (!dirFindEntry(parent_inode, link_name, FILE_SYMLINK, &dummy_output)) return -1; // erro, já existe
     
 
+    inode_t *parent = &inode_table[parent_inode];
+    if (!hasPermission(parent, uid, PERM_WRITE)) return -1;
 
-    char link_dir[256];
-    char link_name[256];
-    splitPath(link_path, link_dir, link_name);
-
-    int link_dir_index;
+    // 2. Aloca um novo i-node (no grupo do diretório)
+    int inode_index = allocateInodeNear(parent_inode, 0);
+    if (inode_index < 0) return -1;
+    inode_t *inode = &inode_table[inode_index];
+    if (!inode) return -1;
 
-    // --- 2. Garante que o diretório do link exista ---
-    // Tenta resolver o link_path normalmente
-    if (resolvePath(link_dir, current_inode, &link_dir_index) != 0) {
-        // Se falhar, cria diretórios recursivamente
-        if (createDirectoriesRecursively(link_dir, current_inode, user) != 0)
-            return -1;
+    // 3. Preenche campos
+    inode_meta_t *meta = &inode_meta[inode_index];
+    strncpy(meta->name, link_name, MAX_NAMESIZE-1);
+    meta->name[MAX_NAMESIZE-1] = '\0';
+    inode->type = FILE_SYMLINK;
+    inode->size = 0;
+    inode->link_target_index = target_index;
+    meta->creation_date = time(NULL);
+    meta->modification_date = meta->creation_date;
+    meta->creator = uid;
+    inode->uid = uid;
+    inode->gid = userGid(uid);
+    inode->permissions = inode_table[target_index].permissions;
 
-        // Tenta resolver novamente agora que o caminho existe
-        if (resolvePath(link_dir, current_inode, &link_dir_index) != 0)
-            return -1;
+    if (dirAddEntry(parent_inode, link_name, FILE_SYMLINK, inode_index) != 0){
+        freeInode(inode_index);
+        return -1;
     }
 
-    // --- 3. Cria o link simbólico ---
-    createSymlink(link_dir_index, target_index, link_name, user);
+    sync_inode(inode_index);
+    return 0;
 }
 
+int deleteSymlink(int parent_inode, int target_inode_idx, int uid){
+    if (parent_inode < 0 || parent_inode >= MAX_INODES || !target_inode_idx) return -1;
 
-// ls (lista elementos)
-int cmd_ls(int current_inode, const char *path, const char *user, int info_arg) {
-    if (!user) return -1;
+    inode_t *target = &inode_table[target_inode_idx];
+    if (!hasPermission(target, uid, PERM_WRITE)) return -1;
 
-    // checa se o caminho existe
-    int target_inode = current_inode;
-    if (path && strlen(path) > 0) {
-        if (resolvePath(path, current_inode, &target_inode) != 0) {
-            printf("ls: caminho não encontrado: %s\n", path);
-            return -1;
-        }
+    if (target->type != FILE_SYMLINK) return -1;
+
+    if (dirRemoveEntry(parent_inode, inode_meta[target_inode_idx].name, target->type) == -1) return -1;
+    freeInode(target_inode_idx);
+    sync_fs();
+    return 0;
+}
+
+/* Encontra inode a partir de um path */
+int resolvePath(const char *path, int current_inode, int *inode_out) {
+    if (!path || !inode_out) return -1;
+
+    int current = current_inode;
+
+    // Caminho absoluto
+    if (path[0] == '~') {
+        current = ROOT_INODE;
+        path++; // pula o '~'
+        if (*path == '/') path++; // pula barra inicial
+    }
+    
+    char token[256];
+    const char *p = path;
+    while (*p) {
+        int i = 0;
+        while (*p && *p != '/') token[i++] = *p++;
+        token[i] = '\0';
+        if (*p == '/') p++; // pula barra
+
+        if (strcmp(token, ".") == 0 || token[0] == '\0') continue;
+
+        if (strcmp(token, "..") == 0) {
+            int parent_inode;
+            if (dirFindEntry(current, "..", FILE_DIRECTORY, &parent_inode) != 0) return -1;
+            current = parent_inode;
+            continue;
+        }
+        
+        int next_inode;
+        const char *next_slash = strchr(p, '/');
+        int type = next_slash ? FILE_DIRECTORY : FILE_ANY;
+
+        if (dirFindEntry(current, token, type, &next_inode) != 0) return -1;
+
+        int depth = 0;
+        while (inode_table[next_inode].type == FILE_SYMLINK) {
+            next_inode = inode_table[next_inode].link_target_index;
+            if (++depth > 16) return -1; // evita loops
+        }
+
+        current = next_inode;
+    }
+
+    *inode_out = current;
+    return 0;
+}
+
+/* Separa path entre caminho do pai e o nome do arquivo */
+static void splitPath(const char *full_path, char *dir_path, char *base_name) {
+    const char *last_slash = strrchr(full_path, '/');
+    if (last_slash) {
+        size_t dir_len = last_slash - full_path;
+        strncpy(dir_path, full_path, dir_len);
+        dir_path[dir_len] = '\0';
+        strcpy(base_name, last_slash + 1);
+    } else {
+        strcpy(dir_path, "."); // diretório atual
+        strcpy(base_name, full_path);
+    }
+}
+
+
+/* ---- Listagem de diretórios (readdir-plus) ---- */
+/* dirList devolve uma página de entradas já com os dados do inode, numa
+ * passada pela cadeia do diretório: os blocos são lidos em lotes de
+ * DIR_BATCH_BLOCKS slots lógicos (contíguos numa só leitura) e o resto vem
+ * de inode_table e inode_meta, sem outra busca por entrada. '.' e '..' não
+ * são listados. O cursor é opaco: 0 na primeira chamada e depois o
+ * next_cursor da página anterior. Sem ordenação ele é a posição da entrada
+ * no diretório, e a leitura recomeça direto no bloco dela; com
+ * DIR_LIST_SORTED é a posição na ordem por nome, o que exige ler tudo. */
+#define DIR_BATCH_BLOCKS 64
+#define DIR_ENTRIES_PER_BLOCK ((uint32_t)(BLOCK_SIZE / sizeof(dir_entry_t)))
+
+static void dirFillEntry(fs_entry_t *e, const dir_entry_t *d) {
+    inode_t *inode = &inode_table[d->inode_index];
+    inode_meta_t *meta = &inode_meta[d->inode_index];
+    memcpy(e->name, d->name, MAX_NAMESIZE);
+    e->name[MAX_NAMESIZE - 1] = '\0';
+    e->type = inode->type;
+    e->inode_index = d->inode_index;
+    e->uid = inode->uid;
+    e->gid = inode->gid;
+    e->permissions = inode->permissions;
+    e->flags = inode->flags;
+    e->creator = meta->creator;
+    e->size = inode->size;
+    e->creation_date = meta->creation_date;
+    e->modification_date = meta->modification_date;
+    e->link_target_index = inode->type == FILE_SYMLINK ? inode->link_target_index : 0;
+}
+
+static int dirEntryCompare(const void *a, const void *b) {
+    return strcmp(((const fs_entry_t *)a)->name, ((const fs_entry_t *)b)->name);
+}
+
+/* Lista até 'limit' entradas (0 = todas) de dir_inode a partir de 'cursor'.
+ * Retorna 0 e preenche *out (liberar com dirListFree), ou -1. */
+int dirList(int dir_inode, uint32_t cursor, int limit, int flags, fs_dir_list_t *out) {
+    if (!out || dir_inode < 0 || dir_inode >= MAX_INODES) return -1;
+    memset(out, 0, sizeof(*out));
+    if (inode_table[dir_inode].type != FILE_DIRECTORY || limit < 0) return -1;
+
+    int sorted = flags & DIR_LIST_SORTED;
+    uint32_t first_slot = sorted ? 0 : cursor;    // em entradas, não em blocos
+    int page = sorted ? 0 : limit;                // com ordenação, corta depois
+
+    uint32_t blocks = BLOCKS_PER_INODE;
+    for (int cur = dir_inode; inode_table[cur].next_inode; cur = inode_table[cur].next_inode)
+        blocks += BLOCKS_PER_INODE;
+
+    int cap = page ? page : 64;
+    fs_entry_t *entries = malloc(cap * sizeof(fs_entry_t));
+    char *batch = malloc((size_t)DIR_BATCH_BLOCKS * BLOCK_SIZE);
+    if (!entries || !batch) { free(entries); free(batch); return -1; }
+
+    block_cursor_t cur;
+    cursorInit(&cur, dir_inode);
+    int n = 0, done = 0;
+    for (uint32_t first = first_slot / DIR_ENTRIES_PER_BLOCK; first < blocks && !done; first += DIR_BATCH_BLOCKS) {
+        uint32_t nblocks = blocks - first < DIR_BATCH_BLOCKS ? blocks - first : DIR_BATCH_BLOCKS;
+        if (cursorBlocksIO(&cur, first, nblocks, batch, 0) != 0) {
+            free(entries); free(batch);
+            return -1;
+        }
+        for (uint32_t b = 0; b < nblocks && !done; b++) {
+            dir_entry_t *block = (dir_entry_t *)(batch + (size_t)b * BLOCK_SIZE);
+            for (uint32_t j = 0; j < DIR_ENTRIES_PER_BLOCK; j++) {
+                uint32_t slot = (first + b) * DIR_ENTRIES_PER_BLOCK + j;
+                if (slot < first_slot || block[j].inode_index == 0) continue;
+                if (strcmp(block[j].name, ".") == 0 || strcmp(block[j].name, "..") == 0) continue;
+                if (page && n == page) {
+                    // há mais entradas: a próxima página começa nesta
+                    out->next_cursor = slot;
+                    done = 1;
+                    break;
+                }
+                if (n == cap) {
+                    cap *= 2;
+                    fs_entry_t *grown = realloc(entries, cap * sizeof(fs_entry_t));
+                    if (!grown) { free(entries); free(batch); return -1; }
+                    entries = grown;
+                }
+                dirFillEntry(&entries[n++], &block[j]);
+            }
+        }
+    }
+    free(batch);
+
+    if (sorted) {
+        qsort(entries, n, sizeof(fs_entry_t), dirEntryCompare);
+        uint32_t start = cursor < (uint32_t)n ? cursor : (uint32_t)n;
+        uint32_t end = n;
+        if (limit && start + (uint32_t)limit < end) {
+            end = start + limit;
+            out->next_cursor = end;
+        }
+        memmove(entries, entries + start, (end - start) * sizeof(fs_entry_t));
+        n = end - start;
+    }
+
+    out->entries = entries;
+    out->count = n;
+    return 0;
+}
+
+void dirListFree(fs_dir_list_t *list) {
+    if (!list) return;
+    free(list->entries);
+    list->entries = NULL;
+    list->count = 0;
+    list->next_cursor = 0;
+}
+
+/* ---- Percurso paralelo de subárvores ---- */
+/* Base de rm -r e cp -r: a subárvore é lida nível a nível, com as threads
+ * dividindo os diretórios de cada nível (a leitura dos blocos de diretório
+ * é o que custa). O resultado é um vetor em ordem de nível, em que o pai
+ * sempre aparece antes dos filhos. Nada é alterado durante o percurso. */
+typedef struct {
+    void *ctx;
+    int id;
+    int threads;
+} parallel_worker_t;
+
+/* Número de threads padrão: uma por CPU, até FSCK_MAX_THREADS */
+static int parallelThreads(void) {
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    if (threads > FSCK_MAX_THREADS) threads = FSCK_MAX_THREADS;
+    return threads;
+}
+
+/* Executa fn em 'threads' workers; o primeiro roda na thread chamadora */
+static void parallelRun(int threads, void *(*fn)(void *), void *ctx) {
+    pthread_t tids[FSCK_MAX_THREADS];
+    parallel_worker_t workers[FSCK_MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t].ctx = ctx;
+        workers[t].id = t;
+        workers[t].threads = threads;
+        if (t > 0 && pthread_create(&tids[t], NULL, fn, &workers[t]) == 0) started |= 1 << t;
+    }
+    fn(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started & (1 << t)) pthread_join(tids[t], NULL);
+        else fn(&workers[t]);   // sem thread: executa a parte dela aqui
+    }
+}
+
+/* Lista as entradas válidas de um diretório (sem '.' e '..'), seguindo a
+ * cadeia next_inode. Lê em lotes como dirList, mas devolve só nome e inode.
+ * O vetor retornado deve ser liberado pelo chamador. */
+static int dirCollectEntries(int dir_inode, dir_entry_t **out, int *count) {
+    uint32_t slots = BLOCKS_PER_INODE;
+    for (int cur = dir_inode; inode_table[cur].next_inode; cur = inode_table[cur].next_inode)
+        slots += BLOCKS_PER_INODE;
+
+    int cap = 64, n = 0;
+    dir_entry_t *list = malloc(cap * sizeof(dir_entry_t));
+    char *batch = malloc((size_t)DIR_BATCH_BLOCKS * BLOCK_SIZE);
+    if (!list || !batch) { free(list); free(batch); return -1; }
+
+    block_cursor_t cur;
+    cursorInit(&cur, dir_inode);
+    for (uint32_t first = 0; first < slots; first += DIR_BATCH_BLOCKS) {
+        uint32_t nblocks = slots - first < DIR_BATCH_BLOCKS ? slots - first : DIR_BATCH_BLOCKS;
+        // slots vazios voltam zerados e são descartados pelo inode_index 0
+        if (cursorBlocksIO(&cur, first, nblocks, batch, 0) != 0) {
+            free(list); free(batch);
+            return -1;
+        }
+        for (uint32_t b = 0; b < nblocks; b++) {
+            dir_entry_t *block = (dir_entry_t *)(batch + (size_t)b * BLOCK_SIZE);
+            for (uint32_t j = 0; j < DIR_ENTRIES_PER_BLOCK; j++) {
+                if (block[j].inode_index == 0) continue;
+                if (strcmp(block[j].name, ".") == 0 || strcmp(block[j].name, "..") == 0) continue;
+                if (n == cap) {
+                    cap *= 2;
+                    dir_entry_t *grown = realloc(list, cap * sizeof(dir_entry_t));
+                    if (!grown) { free(list); free(batch); return -1; }
+                    list = grown;
+                }
+                list[n++] = block[j];
+            }
+        }
+    }
+
+    free(batch);
+    *out = list;
+    *count = n;
+    return 0;
+}
+
+typedef struct {
+    int inode;
+    int parent;                 /* posição do pai em nodes[]; -1 na raiz */
+    char name[MAX_NAMESIZE];
+} walk_node_t;
+
+typedef struct {
+    int uid;
+    permission_t perm;          /* exigida em cada entrada (0 = nenhuma) */
+    walk_node_t *nodes;
+    int count;
+    int level_start, level_end;
+    int cursor;
+    walk_node_t *next;          /* filhos encontrados no nível corrente */
+    int next_count, next_cap;
+    int denied, errors, dirs;
+    pthread_mutex_t lock;
+} tree_walk_t;
+
+static void *walkWorker(void *arg) {
+    tree_walk_t *w = ((parallel_worker_t *)arg)->ctx;
+    for (;;) {
+        int i = w->level_start + __atomic_fetch_add(&w->cursor, 1, __ATOMIC_RELAXED);
+        if (i >= w->level_end) break;
+        if (inode_table[w->nodes[i].inode].type != FILE_DIRECTORY) continue;
+
+        dir_entry_t *entries;
+        int n;
+        if (dirCollectEntries(w->nodes[i].inode, &entries, &n) != 0) {
+            __atomic_fetch_add(&w->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        __atomic_fetch_add(&w->dirs, 1, __ATOMIC_RELAXED);
+        for (int j = 0; j < n && w->perm; j++) {
+            inode_t *child = &inode_table[entries[j].inode_index];
+            if (child->type != FILE_SYMLINK && !hasPermission(child, w->uid, w->perm))
+                __atomic_fetch_add(&w->denied, 1, __ATOMIC_RELAXED);
+        }
+
+        // uma ida à trava por diretório
+        pthread_mutex_lock(&w->lock);
+        if (w->next_count + n > w->next_cap) {
+            int cap = w->next_cap ? w->next_cap : 256;
+            while (cap < w->next_count + n) cap *= 2;
+            walk_node_t *grown = realloc(w->next, cap * sizeof(walk_node_t));
+            if (!grown) {
+                pthread_mutex_unlock(&w->lock);
+                free(entries);
+                __atomic_fetch_add(&w->errors, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            w->next = grown;
+            w->next_cap = cap;
+        }
+        for (int j = 0; j < n; j++) {
+            walk_node_t *node = &w->next[w->next_count++];
+            node->inode = entries[j].inode_index;
+            node->parent = i;
+            memcpy(node->name, entries[j].name, MAX_NAMESIZE);
+        }
+        pthread_mutex_unlock(&w->lock);
+        free(entries);
+    }
+    return NULL;
+}
+
+/* Lista a subárvore de 'root' em w->nodes (nodes[0] é a própria raiz).
+ * Com perm != 0, conta em w->denied as entradas sem essa permissão para uid.
+ * Retorna 0, ou -1 se algum diretório não pôde ser lido. */
+static int treeWalk(tree_walk_t *w, int root, const char *name, int uid, permission_t perm) {
+    memset(w, 0, sizeof(*w));
+    w->uid = uid;
+    w->perm = perm;
+    w->nodes = malloc(sizeof(walk_node_t));
+    if (!w->nodes) return -1;
+    w->nodes[0].inode = root;
+    w->nodes[0].parent = -1;
+    strncpy(w->nodes[0].name, name, MAX_NAMESIZE - 1);
+    w->nodes[0].name[MAX_NAMESIZE - 1] = '\0';
+    w->count = 1;
+    if (perm && !hasPermission(&inode_table[root], uid, perm)) w->denied++;
+
+    pthread_mutex_init(&w->lock, NULL);
+    int threads = parallelThreads();
+    w->level_end = 1;
+    while (w->level_start < w->level_end && !w->errors) {
+        w->cursor = 0;
+        parallelRun(threads, walkWorker, w);
+
+        walk_node_t *grown = realloc(w->nodes, (w->count + w->next_count) * sizeof(walk_node_t));
+        if (!grown) { w->errors++; break; }
+        w->nodes = grown;
+        memcpy(w->nodes + w->count, w->next, w->next_count * sizeof(walk_node_t));
+        w->level_start = w->count;
+        w->count += w->next_count;
+        w->level_end = w->count;
+        w->next_count = 0;
+    }
+    pthread_mutex_destroy(&w->lock);
+    free(w->next);
+    w->next = NULL;
+    return w->errors ? -1 : 0;
+}
+
+/* ---- Comandos de FS ---- */
+
+// cd (muda diretorio)
+static int do_cd(int *current_inode, const char *path) {
+    if (!current_inode || !path) return -1;
+
+    int target_inode;
+    if (resolvePath(path, *current_inode, &target_inode) != 0) return -1;
+
+    inode_t *inode = &inode_table[target_inode];
+    if (inode->type != FILE_DIRECTORY) return -1;
+
+    *current_inode = target_inode;
+    return 0;
+}
+
+// mkdir (cria diretorio) com criação recursiva
+static int do_mkdir(int current_inode, const char *full_path, int uid) {
+    if (!full_path || !validUid(uid)) return -1;
+
+    char dir_path[256], name[256];
+    splitPath(full_path, dir_path, name);
+
+    int parent_inode;
+    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
+        if (createDirectoriesRecursively(dir_path, current_inode, uid) != 0) return -1;
+        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    }
+
+    return createDirectory(parent_inode, name, uid);
+}
+
+// touch (cria arquivo) com criação recursiva
+static int do_touch(int current_inode, const char *full_path, int uid) {
+    if (!full_path || !validUid(uid)) return -1;
+
+    char dir_path[256], name[256];
+    splitPath(full_path, dir_path, name);
+
+    int parent_inode;
+    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
+        if (createDirectoriesRecursively(dir_path, current_inode, uid) != 0) return -1;
+        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    }
+
+    return createFile(parent_inode, name, uid);
+}
+
+// echo > (sobrescreve conteúdo) com criação recursiva
+static int do_echo_arrow(int current_inode, const char *full_path, const char *content, int uid) {
+    if (!full_path || !content || !validUid(uid)) return -1;
+
+    char dir_path[256], name[256];
+    splitPath(full_path, dir_path, name);
+
+    int parent_inode;
+    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
+        if (createDirectoriesRecursively(dir_path, current_inode, uid) != 0) return -1;
+        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    }
+
+    int inode_index;
+    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
+        if (createFile(parent_inode, name, uid) != 0) return -1;
+        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
+    }
+
+    clearInodeContent(inode_index);
+    return addContentToInode(inode_index, content, strlen(content), uid);
+}
+
+// echo >> (anexa conteúdo) com criação recursiva
+static int do_echo_arrow_arrow(int current_inode, const char *full_path, const char *content, int uid) {
+    if (!full_path || !content || !validUid(uid)) return -1;
+
+
+    char dir_path[256], name[256];
+    splitPath(full_path, dir_path, name);
+
+    int parent_inode;
+    if (resolvePath(dir_path, current_inode, &parent_inode) != 0) {
+        if (createDirectoriesRecursively(dir_path, current_inode, uid) != 0) return -1;
+        if (resolvePath(dir_path, current_inode, &parent_inode) != 0) return -1;
+    }
+
+    int inode_index;
+    if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) {
+        if (createFile(parent_inode, name, uid) != 0) return -1;
+        if (dirFindEntry(parent_inode, name, FILE_REGULAR, &inode_index) != 0) return -1;
+    }
+
+    return addContentToInode(inode_index, content, strlen(content), uid);
+}
+
+
+// cat (le conteudo de arquivo)
+static int do_cat(int current_inode, const char *path, int uid) {
+    if (!path || !validUid(uid)) return -1;
+    // resolve o inode do arquivo
+    int target_inode;
+    if (resolvePath(path, current_inode, &target_inode) != 0)
+        return -1;
+
+    // procura o inode pelo indice
+    inode_t *inode = &inode_table[target_inode];
+    if (!inode || inode->type != FILE_REGULAR) {
+        fprintf(stderr, "Erro: %s não é um arquivo regular.\n", path);
+        return -1;
+    }
+
+    // assegura que há permissão para leitura
+    if (!hasPermission(inode, uid, PERM_READ)) {
+        fprintf(stderr, "Erro: permissão negada para %s.\n", path);
+        return -1;
+    }
+
+    size_t filesize = inode->size;
+    if (filesize == 0) return 0; // arquivo vazio
+
+    char *buffer = malloc(filesize + 1);
+    if (!buffer) return -1;
+
+    // Lê arquivo
+    size_t bytes_read = 0;
+    if (readContentFromInode(target_inode, buffer, filesize + 1, &bytes_read, uid) != 0) {
+        free(buffer);
+        return -1;
+    }
+
+    buffer[bytes_read] = '\0';
+    printf("%s\n", buffer);
+
+    free(buffer);
+    return 0;
+}
+
+// cp 9copia arquivo) com criaçãp recursiva
+/* Arquivo em blocos simples com buracos (menos blocos que o tamanho pede) */
+static int inodeIsSparse(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    if (!inodeHasBlocks(inode) || (inode->flags & INODE_COMPRESSED)) return 0;
+    return inodeBlockCount(inode_index) < (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+/* Copia um arquivo esparso para dst (vazio e não comprimido) só com os
+ * blocos alocados: os buracos da origem continuam buracos na cópia */
+static int copySparse(int src, int dst) {
+    uint32_t blocks = (inode_table[src].size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t new_blocks = 0;
+    char block_buffer[BLOCK_SIZE];
+    block_cursor_t cur;
+    cursorInit(&cur, src);
+
+    for (uint32_t logical = 0; logical < blocks; logical++) {
+        uint32_t *slot = cursorSlot(&cur, logical, 0);
+        if (!slot) break;
+        if (*slot == 0) continue;
+        if (readBlock(*slot, block_buffer) != 0 ||
+            blocksWriteAt(dst, (size_t)logical * BLOCK_SIZE, block_buffer, BLOCK_SIZE, &new_blocks) != 0)
+            return -1;
+    }
+    inode_table[dst].size = inode_table[src].size;
+    inode_meta[dst].modification_date = time(NULL);
+    usageRefresh(dst);
+    return 0;
+}
+
+static int do_cp(int current_inode, const char *src_path, const char *src_name,
+           const char *dst_path, const char *dst_name, int uid) {
+    if (!src_name || !dst_name || !validUid(uid)) return -1;
+
+    int src_parent_inode = current_inode;
+    int dst_parent_inode = current_inode;
+    const char *src_base = src_name;
+    const char *dst_base = dst_name;
+
+    // Se src_name contem '/', separe dir e base
+    char tmpbuf[256];
+    const char *slash = strrchr(src_name, '/');
+    if (slash) {
+        size_t dirlen = slash - src_name;
+        if (dirlen >= sizeof(tmpbuf)) return -1;
+        strncpy(tmpbuf, src_name, dirlen);
+        tmpbuf[dirlen] = '\0';
+        src_base = slash + 1;
+        if (resolvePath(tmpbuf, current_inode, &src_parent_inode) != 0) return -1;
+    } else {
+        // se foi passado um src_path != "." resolva-o
+        if (src_path && src_path[0] != '\0' && strcmp(src_path, ".") != 0) {
+            if (resolvePath(src_path, current_inode, &src_parent_inode) != 0) return -1;
+        }
+    }
+
+    // Processa dst: se dst_name contem '/', separe dir e base
+    slash = strrchr(dst_name, '/');
+    if (slash) {
+        size_t dirlen = slash - dst_name;
+        if (dirlen >= sizeof(tmpbuf)) return -1;
+        strncpy(tmpbuf, dst_name, dirlen);
+        tmpbuf[dirlen] = '\0';
+        dst_base = slash + 1;
+
+        // tenta resolver o diretório; se não existir, tenta criar recursivamente
+        if (resolvePath(tmpbuf, current_inode, &dst_parent_inode) != 0) {
+            if (createDirectoriesRecursively(tmpbuf, current_inode, uid) != 0) return -1;
+            if (resolvePath(tmpbuf, current_inode, &dst_parent_inode) != 0) return -1;
+        }
+    } else {
+        // se foi passado um dst_path != "." resolva-o (p.ex.: cp arq dir/arq2 onde dst_path veio como "dir")
+        if (dst_path && dst_path[0] != '\0' && strcmp(dst_path, ".") != 0) {
+            if (resolvePath(dst_path, current_inode, &dst_parent_inode) != 0) {
+                // tentar criar o caminho de destino
+                if (createDirectoriesRecursively(dst_path, current_inode, uid) != 0) return -1;
+                if (resolvePath(dst_path, current_inode, &dst_parent_inode) != 0) return -1;
+            }
+        }
+    }
+
+    // Agora temos src_parent_inode + src_base e dst_parent_inode + dst_base
+    int src_file_inode;
+    if (dirFindEntry(src_parent_inode, src_base, FILE_REGULAR, &src_file_inode) != 0) {
+        // tenta também aceitar symlink/any (se quiser copiar links) → mas por enquanto requer arquivo regular
+        return -1;
+    }
+
+    inode_t *src_inode = &inode_table[src_file_inode];
+    if (!src_inode) return -1;
+    int sparse = inodeIsSparse(src_file_inode) && hasPermission(src_inode, uid, PERM_READ);
+
+    // Lê o conteúdo diretamente por inode (o de arquivos esparsos vai bloco a bloco)
+    char *buffer = malloc(sparse ? 1 : src_inode->size + 1);
+    if (!buffer) return -1;
+    size_t bytes_read = 0;
+    if (!sparse && readContentFromInode(src_file_inode, buffer, src_inode->size + 1, &bytes_read, uid) != 0) {
+        free(buffer);
+        return -1;
+    }
+
+    // Cria arquivo destino se necessário
+    int dst_file_inode;
+    if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
+        if (createFile(dst_parent_inode, dst_base, uid) != 0) {
+            free(buffer);
+            return -1;
+        }
+        if (dirFindEntry(dst_parent_inode, dst_base, FILE_REGULAR, &dst_file_inode) != 0) {
+            free(buffer);
+            return -1;
+        }
+    } else if (dst_file_inode == src_file_inode) {
+        // cópia sobre si mesmo: nada a fazer
+        free(buffer);
+        return 0;
+    } else {
+        // Se o arquivo já existe, precisamos sobrescrever: libera o conteúdo antes de escrever
+        clearInodeContent(dst_file_inode);
+    }
+
+    if (sparse) {
+        free(buffer);
+        if (!(inode_table[dst_file_inode].flags & INODE_COMPRESSED) &&
+            hasPermission(&inode_table[dst_file_inode], uid, PERM_WRITE))
+            return copySparse(src_file_inode, dst_file_inode) == 0 ? sync_fs() : -1;
+
+        // destino comprimido: lê o conteúdo inteiro, com os buracos como zeros
+        buffer = malloc(src_inode->size + 1);
+        if (!buffer || readContentFromInode(src_file_inode, buffer, src_inode->size + 1, &bytes_read, uid) != 0) {
+            free(buffer);
+            return -1;
+        }
+    }
+
+    // Escreve no inode destino usando addContentToInode
+    int res = addContentToInode(dst_file_inode, buffer, bytes_read, uid);
+    free(buffer);
+    return res;
+}
+
+
+
+/* ---- cp -r ---- */
+#define COPY_CHUNK_BLOCKS 256   /* 128 KiB por leitura em cada worker */
+
+typedef struct {
+    int src, dst;
+    uint32_t blocks;
+} copy_job_t;
+
+typedef struct {
+    copy_job_t *jobs;
+    int count;
+    int cursor;
+    int errors;
+} copy_ctx_t;
+
+/* Copia os blocos de arquivos já pré-alocados; cada worker pega um arquivo
+ * por vez. Só lê a tabela de inodes, então dispensa trava. */
+static void *copyWorker(void *arg) {
+    copy_ctx_t *ctx = ((parallel_worker_t *)arg)->ctx;
+    char *buffer = malloc((size_t)COPY_CHUNK_BLOCKS * BLOCK_SIZE);
+    if (!buffer) {
+        __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    for (;;) {
+        int i = __atomic_fetch_add(&ctx->cursor, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->count) break;
+        copy_job_t *job = &ctx->jobs[i];
+        for (uint32_t logical = 0; logical < job->blocks; logical += COPY_CHUNK_BLOCKS) {
+            uint32_t n = job->blocks - logical < COPY_CHUNK_BLOCKS ? job->blocks - logical : COPY_CHUNK_BLOCKS;
+            if (inodeBlocksIO(job->src, logical, n, buffer, 0) != 0 ||
+                inodeBlocksIO(job->dst, logical, n, buffer, 1) != 0) {
+                __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/* Cria a cópia de uma entrada em dst_parent. Arquivos em blocos simples
+ * só têm os blocos reservados aqui (em faixas contíguas) e entram na lista
+ * de cópia paralela; os esparsos são copiados na hora, só com os blocos
+ * alocados, e os demais (inline, comprimidos, com dedup) pelo caminho
+ * normal. Retorna o inode criado ou -1. */
+static int copyEntry(const walk_node_t *node, int dst_parent, int uid, copy_ctx_t *copy) {
+    inode_t *src = &inode_table[node->inode];
+    int dst;
+
+    if (src->type == FILE_DIRECTORY) {
+        if (createDirectory(dst_parent, node->name, uid) != 0 ||
+            dirFindEntry(dst_parent, node->name, FILE_DIRECTORY, &dst) != 0) return -1;
+        return dst;
+    }
+
+    if (createFile(dst_parent, node->name, uid) != 0 ||
+        dirFindEntry(dst_parent, node->name, FILE_REGULAR, &dst) != 0) return -1;
+    if (src->size == 0) return dst;
+
+    int plain = inodeHasBlocks(src) && !(src->flags & INODE_COMPRESSED) &&
+                !(inode_table[dst].flags & INODE_COMPRESSED) && !(fs_features & FS_FEAT_DEDUP) &&
+                src->size > INODE_INLINE_MAX;
+    // origem esparsa: só os blocos alocados são copiados, na hora
+    if (plain && inodeIsSparse(node->inode)) return copySparse(node->inode, dst) == 0 ? dst : -1;
+    if (plain) {
+        if (preallocateInode(dst, src->size) != 0) return -1;
+        inode_table[dst].size = src->size;
+        usageRefresh(dst);
+        copy->jobs[copy->count].src = node->inode;
+        copy->jobs[copy->count].dst = dst;
+        copy->jobs[copy->count].blocks = (src->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        copy->count++;
+        return dst;
+    }
+
+    char *buffer = malloc(src->size + 1);
+    size_t bytes_read = 0;
+    int res = buffer ? readContentFromInode(node->inode, buffer, src->size + 1, &bytes_read, uid) : -1;
+    if (res == 0) res = addContentToInode(dst, buffer, bytes_read, uid);
+    free(buffer);
+    return res == 0 ? dst : -1;
+}
+
+/* Inodes que a cópia de um nó pode consumir: o próprio mais os de extensão
+ * da cadeia, tantos quanto os da origem ou quantos o tamanho exige (a cópia
+ * de um arquivo comprimido pode não sair comprimida) */
+static int copyInodesNeeded(int inode_index) {
+    inode_t *inode = &inode_table[inode_index];
+    if (inode->type == FILE_SYMLINK) return 1;
+    int chain = 1;
+    for (int next = inode->next_inode; next && chain < MAX_INODES; next = inode_table[next].next_inode)
+        chain++;
+    if (inode->type == FILE_REGULAR) {
+        uint32_t slots = (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        int by_size = slots ? (int)((slots + BLOCKS_PER_INODE - 1) / BLOCKS_PER_INODE) : 1;
+        if (by_size > chain) chain = by_size;
+    }
+    return chain;
+}
+
+// cp -r (copia diretório com todo o conteúdo)
+// A subárvore de origem é listada em paralelo; os inodes e blocos de
+// destino são criados em sequência (o alocador não é concorrente), os
+// dados são copiados em paralelo e os metadados gravados uma vez no fim.
+static int do_cp_r(int current_inode, const char *src_path, const char *dst_path, int uid) {
+    if (!src_path || !dst_path || !validUid(uid)) return -1;
+
+    int src_inode;
+    if (resolvePath(src_path, current_inode, &src_inode) != 0) {
+        printf("cp: origem não encontrada: %s\n", src_path);
+        return -1;
+    }
+    if (inode_table[src_inode].type != FILE_DIRECTORY)
+        return do_cp(current_inode, ".", src_path, ".", dst_path, uid);
+
+    // destino existente: copia para dentro dele, com o nome da origem
+    char parent_path[1024], name[256];
+    int dst_parent, existing;
+    if (resolvePath(dst_path, current_inode, &existing) == 0) {
+        if (inode_table[existing].type != FILE_DIRECTORY) {
+            printf("cp: destino não é um diretório: %s\n", dst_path);
+            return -1;
+        }
+        dst_parent = existing;
+        strcpy(name, inode_meta[src_inode].name);
+    } else {
+        splitPath(dst_path, parent_path, name);
+        if (resolvePath(parent_path, current_inode, &dst_parent) != 0) {
+            if (createDirectoriesRecursively(parent_path, current_inode, uid) != 0) return -1;
+            if (resolvePath(parent_path, current_inode, &dst_parent) != 0) return -1;
+        }
+    }
+    if (strlen(name) >= MAX_NAMESIZE || dirFindEntry(dst_parent, name, FILE_ANY, &existing) == 0) {
+        printf("cp: destino já existe: %s\n", name);
+        return -1;
+    }
+
+    // o destino não pode ficar dentro da origem
+    for (int dir = dst_parent, hops = 0; hops < MAX_INODES; hops++) {
+        if (dir == src_inode) {
+            printf("cp: não é possível copiar '%s' para dentro dele mesmo\n", src_path);
+            return -1;
+        }
+        if (dir == ROOT_INODE || dirFindEntry(dir, "..", FILE_DIRECTORY, &dir) != 0) break;
+    }
+
+    tree_walk_t walk;
+    if (treeWalk(&walk, src_inode, name, uid, PERM_READ) != 0 || walk.denied) {
+        if (walk.denied) printf("cp: permissão negada em %d entrada(s) de '%s'\n", walk.denied, src_path);
+        else printf("cp: falha ao ler '%s'\n", src_path);
+        free(walk.nodes);
+        return -1;
+    }
+
+    // falta de inodes no meio deixaria uma cópia parcial; contam também os
+    // de extensão das cadeias de blocos e de entradas de diretório
+    int free_inodes = 0, needed = 0;
+    for (uint32_t i = 0; i < computed_inode_bitmap_bytes; i++)
+        free_inodes += 8 - __builtin_popcount(inode_bitmap[i]);
+    for (int i = 0; i < walk.count; i++) needed += copyInodesNeeded(walk.nodes[i].inode);
+    if (free_inodes < needed) {
+        printf("cp: inodes livres insuficientes (%d para %d entradas, %d inodes)\n",
+               free_inodes, walk.count, needed);
+        free(walk.nodes);
+        return -1;
+    }
+
+    int *created = malloc(walk.count * sizeof(int));   // inode de destino de cada nó
+    int *map = calloc(MAX_INODES, sizeof(int));        // origem -> destino + 1
+    copy_ctx_t copy = {0};
+    copy.jobs = malloc(walk.count * sizeof(copy_job_t));
+    if (!created || !map || !copy.jobs) {
+        free(created); free(map); free(copy.jobs); free(walk.nodes);
+        return -1;
+    }
+
+    int was_deferred = set_deferred_sync(1);
+    int errors = 0;
+    for (int i = 0; i < walk.count; i++) {
+        walk_node_t *node = &walk.nodes[i];
+        created[i] = -1;
+        if (inode_table[node->inode].type == FILE_SYMLINK) continue;
+        int parent = node->parent < 0 ? dst_parent : created[node->parent];
+        if (parent < 0 || (created[i] = copyEntry(node, parent, uid, &copy)) < 0) {
+            errors++;
+            continue;
+        }
+        map[node->inode] = created[i] + 1;
+    }
+
+    // links apontam para inodes: alvos dentro da árvore passam para a cópia
+    for (int i = 0; i < walk.count; i++) {
+        walk_node_t *node = &walk.nodes[i];
+        if (inode_table[node->inode].type != FILE_SYMLINK || created[node->parent] < 0) continue;
+        int target = inode_table[node->inode].link_target_index;
+        if (map[target]) target = map[target] - 1;
+        if (createSymlink(created[node->parent], target, node->name, uid) != 0) errors++;
+    }
+
+    parallelRun(parallelThreads(), copyWorker, &copy);
+    errors += copy.errors;
+
+    sync_fs();
+    set_deferred_sync(was_deferred);
+    if (errors) printf("cp: %d de %d entradas não copiadas\n", errors, walk.count);
+
+    free(created);
+    free(map);
+    free(copy.jobs);
+    free(walk.nodes);
+    return errors ? -1 : 0;
+}
+
+
+// mv (move)
+static int do_mv(int current_inode, const char *src_path, const char *src_name,
+           const char *dst_path, const char *dst_name, int uid) {
+    // Copia o arquivo
+    if (do_cp(current_inode, src_path, src_name, dst_path, dst_name, uid) != 0) return -1;
+
+    // Apaga o arquivo de origem
+    int src_parent_inode;
+    if (resolvePath(src_path, current_inode, &src_parent_inode) != 0) return -1;
+
+    return deleteFile(src_parent_inode, src_name, uid);
+}
+
+
+// ln -s (cria link simbolico)
+static int do_ln_s(int current_inode,
+             const char *target_path,
+             const char *link_path,
+             int uid) {
+    if (!target_path || !link_path || !validUid(uid))
+        return -1;
+
+    int target_index;
+    if (resolvePath(target_path, current_inode, &target_index) != 0) return -1;
+    
+
+
+    char link_dir[256];
+    char link_name[256];
+    splitPath(link_path, link_dir, link_name);
+
+    int link_dir_index;
+
+    // --- 2. Garante que o diretório do link exista ---
+    // Tenta resolver o link_path normalmente
+    if (resolvePath(link_dir, current_inode, &link_dir_index) != 0) {
+        // Se falhar, cria diretórios recursivamente
+        if (createDirectoriesRecursively(link_dir, current_inode, uid) != 0)
+            return -1;
+
+        // Tenta resolver novamente agora que o caminho existe
+        if (resolvePath(link_dir, current_inode, &link_dir_index) != 0)
+            return -1;
+    }
+
+    // --- 3. Cria o link simbólico ---
+    return createSymlink(link_dir_index, target_index, link_name, uid);
+}
+
+
+// ls (lista elementos)
+static void lsPrintEntry(const fs_entry_t *e, int info_arg) {
+    // Determina tipo de arquivo
+    char type = '-';
+    if (e->type == FILE_DIRECTORY) type = 'd';
+    else if (e->type == FILE_REGULAR) type = 'f';
+    else if (e->type == FILE_SYMLINK) type = 'l';
+
+    if (!info_arg) {
+        printf("-%c     %s\n", type, e->name);
+        return;
+    }
+
+    // Caso utilize o argumento para emular o ls -l
+    // Formata permissões (rwxrwxrwx)
+    char perm_str[10] = "---------";
+    for (int who = 6; who >= 0; who -= 3) {
+        perm_str[8-who-2] = (e->permissions & (PERM_READ << who)) ? 'r' : '-';
+        perm_str[8-who-1] = (e->permissions & (PERM_WRITE << who)) ? 'w' : '-';
+        perm_str[8-who] = (e->permissions & (PERM_EXEC << who)) ? 'x' : '-';
+    }
+
+    char mtime_buf[32];
+    format_time(e->modification_date, mtime_buf, sizeof(mtime_buf));
+
+    printf("%c%s %8s %8s %8llu %s %s",
+        type,
+        perm_str,
+        userName(e->uid),
+        groupName(e->gid),
+        (unsigned long long)e->size,
+        mtime_buf,
+        e->name
+    );
+
+    // Se for link simbólico, mostra o alvo
+    if (e->type == FILE_SYMLINK) {
+        printf(" -> %s", inode_meta[e->link_target_index].name);
+    }
+    printf("\n");
+}
+
+static int do_ls(int current_inode, const char *path, int uid, int info_arg) {
+    if (!validUid(uid)) return -1;
+
+    // checa se o caminho existe
+    int target_inode = current_inode;
+    if (path && strlen(path) > 0) {
+        if (resolvePath(path, current_inode, &target_inode) != 0) {
+            printf("ls: caminho não encontrado: %s\n", path);
+            return -1;
+        }
+    }
+
+    // arquivo ou link: mostra só a própria entrada
+    if (inode_table[target_inode].type != FILE_DIRECTORY) {
+        dir_entry_t self = { .inode_index = target_inode };
+        memcpy(self.name, inode_meta[target_inode].name, MAX_NAMESIZE);
+        fs_entry_t e;
+        dirFillEntry(&e, &self);
+        lsPrintEntry(&e, info_arg);
+        return 0;
+    }
+
+    fs_dir_list_t list;
+    if (dirList(target_inode, 0, 0, DIR_LIST_SORTED, &list) != 0) return -1;
+    for (int i = 0; i < list.count; i++)
+        lsPrintEntry(&list.entries[i], info_arg);
+    dirListFree(&list);
+    return 0;
+}
+
+// remove elementos (usada tanto por rmdir quanto por rm)
+int cmd_remove(int current_inode, const char *filepath, int uid, int remove_dir) {
+    if (!filepath || !validUid(uid)) return -1;
+
+    char parent_path[1024];
+    char name[MAX_NAMESIZE];
+
+    // Encontra a última barra para separar caminho/nome
+    splitPath(filepath, parent_path, name);
+    
+    // resolve o inode do diretorio pai
+    int parent_inode;
+    if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
+        if (remove_dir)
+            printf("rmdir: diretório não encontrado: %s\n", parent_path);
+        else
+            printf("Arquivo não encontrado\n");
+        return -1;
+    }
+
+    // Procura o arquivo com o nome dentro do diretório pai
+    int target_inode;
+    if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
+        if (remove_dir)
+            printf("rmdir: não existe o diretório: %s\n", filepath);
+        else
+            printf("Arquivo não encontrado\n");
+        return -1;
+    }
+
+    inode_t *target = &inode_table[target_inode];
+
+    // Verifica conforme o tipo de rm (e.g. rm ou rmdir)
+    if (remove_dir) {
+        if (target->type != FILE_DIRECTORY) {
+            printf("rmdir: não é um diretório: %s\n", filepath);
+            return -1;
+        }
+        if (deleteDirectory(parent_inode, name, uid) != 0) {
+            printf("rmdir: não foi possível remover '%s'\n", filepath);
+            return -1;
+        }
+        return 0;
+    } else {
+        if (target->type == FILE_DIRECTORY) {
+            printf("rm: não é possível remover '%s': é um diretório\n", filepath);
+            return -1;
+        }
+        if (deleteFile(parent_inode, name, uid) != 0) {
+            printf("Erro ao remover arquivo: %s\n", filepath);
+            return -1;
+        }
+        return 0;
+    }
+}
+
+// rm (remove arquivo)
+static int do_rm(int current_inode, const char *filepath, int uid) {
+    return cmd_remove(current_inode, filepath, uid, 0);
+}
+
+// rm -r (remove diretório e todo o seu conteúdo)
+// A subárvore é listada em paralelo e checada por inteiro antes de qualquer
+// alteração; os inodes e blocos são então liberados só em memória e os
+// metadados gravados uma única vez no fim.
+static int do_rm_r(int current_inode, const char *filepath, int uid) {
+    if (!filepath || !validUid(uid)) return -1;
+
+    char parent_path[1024];
+    char name[MAX_NAMESIZE];
+    splitPath(filepath, parent_path, name);
+
+    int parent_inode, target_inode;
+    if (resolvePath(parent_path, current_inode, &parent_inode) != 0 ||
+        dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
+        printf("Arquivo não encontrado\n");
+        return -1;
+    }
+    if (inode_table[target_inode].type != FILE_DIRECTORY)
+        return cmd_remove(current_inode, filepath, uid, 0);
+    if (target_inode == ROOT_INODE || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        printf("rm: não é possível remover '%s'\n", filepath);
+        return -1;
+    }
+
+    tree_walk_t walk;
+    if (treeWalk(&walk, target_inode, name, uid, PERM_WRITE) != 0) {
+        printf("rm: falha ao ler '%s'\n", filepath);
+        free(walk.nodes);
+        return -1;
+    }
+    int res = 0;
+    if (walk.denied) {
+        printf("rm: permissão negada em %d entrada(s) de '%s'\n", walk.denied, filepath);
+        res = -1;
+    }
+    for (int i = 0; i < walk.count && res == 0; i++) {
+        if (walk.nodes[i].inode == current_inode) {
+            printf("rm: '%s' contém o diretório atual\n", filepath);
+            res = -1;
+        }
+    }
+
+    if (res == 0) {
+        int was_deferred = set_deferred_sync(1);
+        // folhas primeiro; a raiz sai junto com a entrada no pai
+        for (int i = walk.count - 1; i > 0; i--) freeInode(walk.nodes[i].inode);
+        if (dirRemoveEntry(parent_inode, name, FILE_DIRECTORY) != 0) res = -1;
+        sync_fs();
+        set_deferred_sync(was_deferred);
+    }
+    free(walk.nodes);
+    return res;
+}
+
+// rmdir (remove diretorio)
+static int do_rmdir(int current_inode, const char *filepath, int uid) {
+    printf("passou");
+    return cmd_remove(current_inode, filepath, uid, 1);
+}
+
+static int do_unlink(int current_inode, const char *filepath, int uid){
+    if (!filepath || !validUid(uid)) return -1;
+
+    char parent_path[1024];
+    char name[MAX_NAMESIZE];
+
+    // Encontra a última barra para separar caminho/nome
+    splitPath(filepath, parent_path, name);
+    
+    // resolve o inode do diretorio pai
+    int parent_inode;
+    if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
+        printf("Link não encontrado\n");
+        return -1;
+    }
+
+    // Procura o arquivo com o nome dentro do diretório pai
+    int target_inode;
+    if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
+        printf("Link não encontrado\n");
+        return -1;
+    }
+
+    inode_t *target = &inode_table[target_inode];
+
+    // Verifica se é um link simbolico
+    if (target->type != FILE_SYMLINK) {
+        printf("Alvo não é um link: %s\n", filepath);
+        return -1;
+        }
+
+    if (deleteSymlink(parent_inode, target_inode, uid) != 0) {
+            printf("Não foi possível remover '%s'\n", filepath);
+            return -1;
+        }
+    return 0;
+}
+
+static int do_df(int groups){
+    uint32_t free_blocks = 0, free_inodes = 0, fb, fi;
+    for (uint32_t g = 0; blockGroupInfo(g, &fb, &fi) == 0; g++) {
+        free_blocks += fb;
+        free_inodes += fi;
+    }
+
+    int used_blocks = computed_data_blocks - free_blocks;
+    int use_percentage = (used_blocks * 100 + computed_data_blocks -1) / computed_data_blocks;
+
+    printf("Filesystem     N-blocks     Used Available Use%% Mounted on\n");
+    printf("%-14s %-12d %-6d %-5d %3d%%   /~\n",
+           DISK_NAME, computed_data_blocks, used_blocks, free_blocks, use_percentage);
+
+    // -g: livres por grupo de blocos
+    if (groups) {
+        printf("\n%6s %12s %12s %12s\n", "grupo", "primeiro", "blocos livres", "inodes livres");
+        for (uint32_t g = 0; blockGroupInfo(g, &fb, &fi) == 0; g++)
+            printf("%6u %12u %12u %12u\n", g, g * BLOCKS_PER_GROUP, fb, fi);
+        printf("%u inodes livres de %d\n", free_inodes, MAX_INODES);
+    }
+
+    return 0;
+}
+
+/* ---- import (copia árvore do host para o volume) ---- */
+#define IMPORT_CHUNK_BLOCKS 2048   /* 1 MiB por leitura no host */
+
+typedef struct {
+    int parent_inode;
+    char name[MAX_NAMESIZE];
+    char target[PATH_MAX];
+} import_link_t;
+
+typedef struct {
+    int uid;
+    const char *host_root;
+    int root_inode;
+    char *buffer;
+    import_link_t *links;
+    int links_count, links_cap;
+    int dirs, files, symlinks, errors;
+    unsigned long long bytes;
+} import_ctx_t;
+
+/* Copia o conteúdo de um arquivo do host para um inode recém-criado */
+static int importFileData(import_ctx_t *ctx, const char *host_path, int inode_index, off_t host_size) {
+    int fd = open(host_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    // arquivos pequenos vão direto para o inode
+    if (host_size <= INODE_INLINE_MAX) {
+        inode_t *inode = &inode_table[inode_index];
+        ssize_t got;
+        do got = read(fd, inode->inline_data, INODE_INLINE_MAX);
+        while (got < 0 && errno == EINTR);
+        close(fd);
+        if (got < 0) return -1;
+        inode->flags |= INODE_INLINE;
+        inode->size = got;
+        inode_meta[inode_index].modification_date = time(NULL);
+        usageRefresh(inode_index);
+        ctx->bytes += got;
+        if (trace_enabled) trace_record(TRACE_LOGICAL_WRITE, inode_index, got, stats_now());
+        return 0;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    // reserva todos os blocos de uma vez, contíguos quando possível
+    // (arquivos comprimidos alocam chunk a chunk e, com dedup, bloco a bloco)
+    int compressed = inode_table[inode_index].flags & INODE_COMPRESSED;
+    int dedup = !compressed && (fs_features & FS_FEAT_DEDUP);
+    block_cursor_t cur;
+    cursorInit(&cur, inode_index);
+    if (!compressed && !dedup && preallocateInode(inode_index, host_size) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t total = 0;
+    uint32_t logical = 0;
+    const size_t chunk = (size_t)IMPORT_CHUNK_BLOCKS * BLOCK_SIZE;
+    int res = 0;
+
+    while (total < (size_t)host_size) {
+        size_t want = (size_t)host_size - total;
+        if (want > chunk) want = chunk;
+
+        size_t got = 0;
+        while (got < want) {
+            ssize_t r = read(fd, ctx->buffer + got, want - got);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) break;
+            got += r;
+        }
+        if (got == 0) break; // arquivo encolheu durante a leitura
+
+        if (compressed) {
+            if (compressedAppend(inode_index, ctx->buffer, got) != 0) {
+                res = -1;
+                break;
+            }
+            total += got;
+            if (got < want) break;
+            continue;
+        }
+
+        uint32_t nblocks = (got + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        memset(ctx->buffer + got, 0, (size_t)nblocks * BLOCK_SIZE - got);
+        for (uint32_t k = 0; dedup && k < nblocks; k++) {
+            uint32_t *slot = cursorSlot(&cur, logical + k, 1);
+            int block = slot ? dedupStore(ctx->buffer + (size_t)k * BLOCK_SIZE, inodeBlockGoal(inode_index)) : -1;
+            if (block < 0) {
+                res = -1;
+                break;
+            }
+            *slot = block;
+        }
+        if (res != 0 || (!dedup && inodeBlocksIO(inode_index, logical, nblocks, ctx->buffer, 1) != 0)) {
+            res = -1;
+            break;
+        }
+
+        logical += nblocks;
+        total += got;
+        if (got < want) break;
+    }
+    close(fd);
+
+    // falha ou arquivo menor que o esperado: a reserva além do que foi
+    // gravado volta para o disco
+    if (!compressed) blocksFreeFrom(inode_index, (total + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    inode_table[inode_index].size = total;
+    inode_meta[inode_index].modification_date = time(NULL);
+    usageRefresh(inode_index);
+    ctx->bytes += total;
+    if (trace_enabled) trace_record(TRACE_LOGICAL_WRITE, inode_index, total, stats_now());
+    return res;
+}
+
+/* Importa uma entrada do host (arquivo, diretório ou link) para parent_inode */
+static void importEntry(import_ctx_t *ctx, const char *host_path, int parent_inode, const char *name) {
+    struct stat st;
+    if (lstat(host_path, &st) != 0) {
+        fprintf(stderr, "import: não foi possível ler %s\n", host_path);
+        ctx->errors++;
+        return;
+    }
+    if (strlen(name) >= MAX_NAMESIZE) {
+        fprintf(stderr, "import: nome muito longo, ignorado: %s\n", host_path);
+        ctx->errors++;
+        return;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        int dir_inode;
+        if (dirFindEntry(parent_inode, name, FILE_DIRECTORY, &dir_inode) != 0) {
+            if (createDirectory(parent_inode, name, ctx->uid) != 0 ||
+                dirFindEntry(parent_inode, name, FILE_DIRECTORY, &dir_inode) != 0) {
+                fprintf(stderr, "import: falha ao criar diretório %s\n", host_path);
+                ctx->errors++;
+                return;
+            }
+            ctx->dirs++;
+        }
+
+        DIR *dir = opendir(host_path);
+        if (!dir) {
+            fprintf(stderr, "import: não foi possível abrir %s\n", host_path);
+            ctx->errors++;
+            return;
+        }
+        struct dirent *de;
+        char child_path[PATH_MAX];
+        while ((de = readdir(dir)) != NULL) {
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+            snprintf(child_path, sizeof(child_path), "%s/%s", host_path, de->d_name);
+            importEntry(ctx, child_path, dir_inode, de->d_name);
+        }
+        closedir(dir);
+    }
+    else if (S_ISREG(st.st_mode)) {
+        int file_inode;
+        if (createFile(parent_inode, name, ctx->uid) != 0 ||
+            dirFindEntry(parent_inode, name, FILE_REGULAR, &file_inode) != 0) {
+            fprintf(stderr, "import: falha ao criar arquivo %s\n", host_path);
+            ctx->errors++;
+            return;
+        }
+        if (importFileData(ctx, host_path, file_inode, st.st_size) != 0) {
+            fprintf(stderr, "import: falha ao copiar dados de %s\n", host_path);
+            ctx->errors++;
+            return;
+        }
+        ctx->files++;
+    }
+    else if (S_ISLNK(st.st_mode)) {
+        // links apontam para inodes: resolvidos depois que toda a árvore existir
+        if (ctx->links_count == ctx->links_cap) {
+            int cap = ctx->links_cap ? ctx->links_cap * 2 : 64;
+            import_link_t *links = realloc(ctx->links, cap * sizeof(import_link_t));
+            if (!links) { ctx->errors++; return; }
+            ctx->links = links;
+            ctx->links_cap = cap;
+        }
+        import_link_t *link = &ctx->links[ctx->links_count];
+        ssize_t len = readlink(host_path, link->target, sizeof(link->target) - 1);
+        if (len < 0) { ctx->errors++; return; }
+        link->target[len] = '\0';
+        link->parent_inode = parent_inode;
+        strcpy(link->name, name);
+        ctx->links_count++;
+    }
+    else {
+        fprintf(stderr, "import: tipo não suportado, ignorado: %s\n", host_path);
+    }
+}
+
+/* Cria os links pendentes; alvos fora da árvore importada são ignorados */
+static void importResolveLinks(import_ctx_t *ctx) {
+    size_t root_len = strlen(ctx->host_root);
+    for (int i = 0; i < ctx->links_count; i++) {
+        import_link_t *link = &ctx->links[i];
+        int base = link->parent_inode;
+        const char *target = link->target;
+
+        if (target[0] == '/') {
+            if (strncmp(target, ctx->host_root, root_len) != 0 ||
+                (target[root_len] != '/' && target[root_len] != '\0')) {
+                fprintf(stderr, "import: alvo fora da árvore, link ignorado: %s\n", link->name);
+                ctx->errors++;
+                continue;
+            }
+            base = ctx->root_inode;
+            target += root_len;
+            while (*target == '/') target++;
+        }
+
+        int target_inode;
+        if (resolvePath(target, base, &target_inode) != 0 ||
+            createSymlink(link->parent_inode, target_inode, link->name, ctx->uid) != 0) {
+            fprintf(stderr, "import: não foi possível criar o link %s -> %s\n", link->name, link->target);
+            ctx->errors++;
+            continue;
+        }
+        ctx->symlinks++;
+    }
+}
+
+// import (copia arquivo ou árvore do host para dentro do volume)
+static int do_import(int current_inode, const char *host_path, const char *dest_path, int uid) {
+    if (!host_path || !validUid(uid)) return -1;
+    if (!dest_path) dest_path = ".";
+
+    struct stat st;
+    if (lstat(host_path, &st) != 0) {
+        printf("import: caminho do host não encontrado: %s\n", host_path);
+        return -1;
+    }
+
+    int dest_inode;
+    if (resolvePath(dest_path, current_inode, &dest_inode) != 0) {
+        if (createDirectoriesRecursively(dest_path, current_inode, uid) != 0) return -1;
+        if (resolvePath(dest_path, current_inode, &dest_inode) != 0) return -1;
+    }
+    if (inode_table[dest_inode].type != FILE_DIRECTORY) {
+        printf("import: destino não é um diretório: %s\n", dest_path);
+        return -1;
+    }
+
+    import_ctx_t ctx = {0};
+    ctx.uid = uid;
+    ctx.root_inode = dest_inode;
+    ctx.buffer = malloc((size_t)IMPORT_CHUNK_BLOCKS * BLOCK_SIZE);
+    char host_root[PATH_MAX];
+    if (!ctx.buffer || !realpath(host_path, host_root)) {
+        free(ctx.buffer);
+        return -1;
+    }
+    ctx.host_root = host_root;
+
+    // metadados ficam em memória durante toda a importação: um único flush
+    int was_deferred = set_deferred_sync(1);
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(host_path);
+        if (dir) {
+            struct dirent *de;
+            char child_path[PATH_MAX];
+            while ((de = readdir(dir)) != NULL) {
+                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+                snprintf(child_path, sizeof(child_path), "%s/%s", host_path, de->d_name);
+                importEntry(&ctx, child_path, dest_inode, de->d_name);
+            }
+            closedir(dir);
+        } else {
+            ctx.errors++;
+        }
+    } else {
+        const char *base = strrchr(host_path, '/');
+        importEntry(&ctx, host_path, dest_inode, base ? base + 1 : host_path);
+        // link de arquivo avulso é resolvido a partir do diretório do host
+        char *slash = strrchr(host_root, '/');
+        if (slash && slash != host_root) *slash = '\0';
+    }
+    importResolveLinks(&ctx);
+
+    sync_fs();
+    set_deferred_sync(was_deferred);
+
+    printf("import: %d diretórios, %d arquivos, %d links, %llu bytes",
+           ctx.dirs, ctx.files, ctx.symlinks, ctx.bytes);
+    if (ctx.errors) printf(", %d erros", ctx.errors);
+    printf("\n");
+
+    free(ctx.links);
+    free(ctx.buffer);
+    return ctx.errors ? -1 : 0;
+}
+
+/* ---- export (copia subárvore do volume para o host ou stream tar) ---- */
+#define EXPORT_CHUNK_BLOCKS 2048   /* 1 MiB por leitura no volume */
+
+typedef struct {
+    int uid;
+    const char *host_root;   /* diretório de destino (modo diretório) */
+    FILE *tar;               /* stream tar (modo tar) ou NULL */
+    char *buffer;
+    char **paths;            /* caminho relativo de cada inode exportado */
+    int *links;              /* symlinks, criados no fim */
+    int links_count;
+    int aborted;             /* stream tar inutilizado por falha de leitura */
+    int dirs, files, symlinks, errors;
+    unsigned long long bytes;
+} export_ctx_t;
+
+/* Caminho relativo de 'to' visto a partir do diretório 'from_dir' */
+static void relativePath(const char *from_dir, const char *to, char *out, size_t outlen) {
+    // descarta os componentes iniciais em comum
+    const char *f = from_dir, *t = to;
+    while (*f && *t) {
+        size_t flen = strcspn(f, "/"), tlen = strcspn(t, "/");
+        if (flen != tlen || strncmp(f, t, flen) != 0) break;
+        f += flen; t += tlen;
+        if (*f == '/') f++;
+        if (*t == '/') t++;
+    }
+
+    // um '..' para cada componente que sobrou em from_dir
+    out[0] = '\0';
+    while (*f) {
+        strncat(out, out[0] ? "/.." : "..", outlen - strlen(out) - 1);
+        f += strcspn(f, "/");
+        if (*f == '/') f++;
+    }
+    if (*t) {
+        if (out[0]) strncat(out, "/", outlen - strlen(out) - 1);
+        strncat(out, t, outlen - strlen(out) - 1);
+    }
+    if (out[0] == '\0') strncpy(out, ".", outlen);
+}
+
+/* Escreve um cabeçalho ustar; nomes longos usam o campo prefix */
+static int tarWriteHeader(FILE *tar, const char *path, char typeflag, const inode_t *inode,
+                          uint32_t size, const char *linkname) {
+    unsigned char h[BLOCK_SIZE];
+    memset(h, 0, sizeof(h));
+
+    size_t len = strlen(path);
+    if (len <= 100) {
+        memcpy(h, path, len);
+    } else {
+        const char *split = path + len - 101;
+        while (*split && *split != '/') split++;
+        if (!*split || split - path > 155) return -1;
+        memcpy(h + 345, path, split - path);
+        memcpy(h, split + 1, strlen(split + 1));
+    }
+
+    snprintf((char *)h + 100, 8, "%07o", (unsigned)(inode->permissions & 0777));
+    snprintf((char *)h + 108, 8, "%07o", (unsigned)inode->uid);
+    snprintf((char *)h + 116, 8, "%07o", (unsigned)inode->gid);
+    snprintf((char *)h + 124, 12, "%011o", size);
+    const inode_meta_t *meta = &inode_meta[inode - inode_table];
+    snprintf((char *)h + 136, 12, "%011lo", (unsigned long)meta->modification_date);
+    h[156] = typeflag;
+    if (linkname) strncpy((char *)h + 157, linkname, 100);
+    memcpy(h + 257, "ustar", 6);
+    memcpy(h + 263, "00", 2);
+    const char *uname = userName(inode->uid), *gname = groupName(inode->gid);
+    memcpy(h + 265, uname, strnlen(uname, 31));
+    memcpy(h + 297, gname, strnlen(gname, 31));
+
+    memset(h + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) sum += h[i];
+    snprintf((char *)h + 148, 8, "%06o", sum);
+    h[155] = ' ';
+
+    return fwrite(h, 1, BLOCK_SIZE, tar) == BLOCK_SIZE ? 0 : -1;
+}
+
+/* Copia os dados de um arquivo para o host (fd) ou para o tar, em chunks */
+static int exportFileData(export_ctx_t *ctx, int inode_index, int fd) {
+    size_t size = inode_table[inode_index].size;
+    size_t offset = 0;
+    const size_t chunk = (size_t)EXPORT_CHUNK_BLOCKS * BLOCK_SIZE;
+
+    while (offset < size) {
+        size_t got = 0;
+        if (readContentAt(inode_index, offset, ctx->buffer, chunk, &got, ctx->uid) != 0 || got == 0)
+            return -1;
+
+        if (ctx->tar) {
+            // completa o último bloco do tar com zeros
+            size_t padded = (got + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+            memset(ctx->buffer + got, 0, padded - got);
+            if (fwrite(ctx->buffer, 1, padded, ctx->tar) != padded) return -1;
+        } else {
+            size_t done = 0;
+            while (done < got) {
+                ssize_t w = write(fd, ctx->buffer + done, got - done);
+                if (w < 0 && errno == EINTR) continue;
+                if (w <= 0) return -1;
+                done += w;
+            }
+        }
+        offset += got;
+    }
+    ctx->bytes += size;
+    return 0;
+}
+
+/* Exporta um inode (e, se diretório, seus filhos) com caminho relativo rel */
+static void exportEntry(export_ctx_t *ctx, int inode_index, const char *rel) {
+    if (ctx->aborted) return;
+    inode_t *inode = &inode_table[inode_index];
+    ctx->paths[inode_index] = strdup(rel);
+
+    char host_path[PATH_MAX];
+    snprintf(host_path, sizeof(host_path), "%s/%s", ctx->host_root ? ctx->host_root : "", rel);
+
+    if (inode->type == FILE_DIRECTORY) {
+        if (!hasPermission(inode, ctx->uid, PERM_READ)) {
+            fprintf(stderr, "export: permissão negada: %s\n", rel);
+            ctx->errors++;
+            return;
+        }
+        if (rel[0]) {
+            if (ctx->tar) {
+                char name[PATH_MAX];
+                snprintf(name, sizeof(name), "%s/", rel);
+                if (tarWriteHeader(ctx->tar, name, '5', inode, 0, NULL) != 0) {
+                    fprintf(stderr, "export: caminho longo demais para tar: %s\n", rel);
+                    ctx->errors++;
+                    return;
+                }
+            } else if (mkdir(host_path, inode->permissions & 0777) != 0 && errno != EEXIST) {
+                fprintf(stderr, "export: falha ao criar %s\n", host_path);
+                ctx->errors++;
+                return;
+            }
+            ctx->dirs++;
+        }
+
+        dir_entry_t *entries;
+        int count;
+        if (dirCollectEntries(inode_index, &entries, &count) != 0) {
+            ctx->errors++;
+            return;
+        }
+        char child[PATH_MAX];
+        for (int i = 0; i < count; i++) {
+            int child_inode = entries[i].inode_index;
+            if (child_inode <= 0 || child_inode >= MAX_INODES || ctx->paths[child_inode]) continue;
+            if (rel[0]) snprintf(child, sizeof(child), "%s/%s", rel, entries[i].name);
+            else snprintf(child, sizeof(child), "%s", entries[i].name);
+            exportEntry(ctx, child_inode, child);
+        }
+        free(entries);
     }
-    
-    inode_t *dir_inode = &inode_table[target_inode];
-
-    // itera sobre cada next dentro do inode
-    do {
-        // itera sobre cada bloco dentro do inode do diretório
-        for (int block_idx = 0; block_idx < BLOCKS_PER_INODE; block_idx++) {
-            if (dir_inode->blocks[block_idx] == 0) continue;
-            
-            dir_entry_t *entries = malloc(BLOCK_SIZE);
-            if (readBlock(dir_inode->blocks[block_idx], entries) != 0) {
-                free(entries);
-                return -1;
+    else if (inode->type == FILE_REGULAR) {
+        int fd = -1;
+        if (ctx->tar) {
+            if (tarWriteHeader(ctx->tar, rel, '0', inode, inode->size, NULL) != 0) {
+                fprintf(stderr, "export: caminho longo demais para tar: %s\n", rel);
+                ctx->errors++;
+                return;
             }
-            
-            int entries_per_block = BLOCK_SIZE / sizeof(dir_entry_t);
-            for (int entry_idx = 0; entry_idx < entries_per_block; entry_idx++) {
-                if (entries[entry_idx].inode_index == 0)
-                    continue;
+        } else {
+            fd = open(host_path, O_WRONLY | O_CREAT | O_TRUNC, inode->permissions & 0777);
+            if (fd < 0) {
+                fprintf(stderr, "export: falha ao criar %s\n", host_path);
+                ctx->errors++;
+                return;
+            }
+        }
 
-                inode_t *entry_inode = &inode_table[entries[entry_idx].inode_index];
-
-                // Determina tipo de arquivo
-                char type = '-';
-                if (entry_inode->type == FILE_DIRECTORY) type = 'd';
-                else if (entry_inode->type == FILE_REGULAR) type = 'f';
-                else if (entry_inode->type == FILE_SYMLINK) type = 'l';
-                
-
-                // Caso utilize o argumento para emular o ls - l
-                if (info_arg) {
-                    // Formata permissões (rwxrwxrwx)
-                    char perm_str[10] = "---------";
-                    for (int who = 6; who >= 0; who -= 3) {
-                        perm_str[8-who-2] = (entry_inode->permissions & (PERM_READ << who)) ? 'r' : '-';
-                        perm_str[8-who-1] = (entry_inode->permissions & (PERM_WRITE << who)) ? 'w' : '-';
-                        perm_str[8-who] = (entry_inode->permissions & (PERM_EXEC << who)) ? 'x' : '-';
-                    }
+        int res = exportFileData(ctx, inode_index, fd);
+        if (fd >= 0) {
+            struct timespec times[2];
+            times[0].tv_sec = times[1].tv_sec = inode_meta[inode_index].modification_date;
+            times[0].tv_nsec = times[1].tv_nsec = 0;
+            futimens(fd, times);
+            close(fd);
+        }
+        if (res != 0) {
+            // no tar um arquivo truncado corromperia o stream inteiro
+            fprintf(stderr, "export: falha ao ler %s\n", rel);
+            ctx->errors++;
+            if (ctx->tar) ctx->aborted = 1;
+            return;
+        }
+        ctx->files++;
+    }
+    else if (inode->type == FILE_SYMLINK) {
+        ctx->links[ctx->links_count++] = inode_index;
+    }
+}
+
+/* Cria os links depois que todos os caminhos exportados são conhecidos */
+static void exportLinks(export_ctx_t *ctx) {
+    for (int i = 0; i < ctx->links_count && !ctx->aborted; i++) {
+        int link = ctx->links[i];
+        int target = inode_table[link].link_target_index;
+        const char *link_rel = ctx->paths[link];
+
+        if (target < 0 || target >= MAX_INODES || !ctx->paths[target]) {
+            fprintf(stderr, "export: alvo fora da subárvore, link ignorado: %s\n", link_rel);
+            ctx->errors++;
+            continue;
+        }
+
+        char link_dir[PATH_MAX], target_rel[PATH_MAX];
+        strncpy(link_dir, link_rel, sizeof(link_dir) - 1);
+        link_dir[sizeof(link_dir) - 1] = '\0';
+        char *slash = strrchr(link_dir, '/');
+        if (slash) *slash = '\0'; else link_dir[0] = '\0';
+        relativePath(link_dir, ctx->paths[target], target_rel, sizeof(target_rel));
+
+        if (ctx->tar) {
+            if (strlen(target_rel) > 100 ||
+                tarWriteHeader(ctx->tar, link_rel, '2', &inode_table[link], 0, target_rel) != 0) {
+                fprintf(stderr, "export: caminho longo demais para tar: %s\n", link_rel);
+                ctx->errors++;
+                continue;
+            }
+        } else {
+            char host_path[PATH_MAX];
+            snprintf(host_path, sizeof(host_path), "%s/%s", ctx->host_root, link_rel);
+            unlink(host_path);
+            if (symlink(target_rel, host_path) != 0) {
+                fprintf(stderr, "export: falha ao criar link %s\n", host_path);
+                ctx->errors++;
+                continue;
+            }
+        }
+        ctx->symlinks++;
+    }
+}
+
+// export (copia arquivo ou subárvore para um diretório do host ou tar)
+// host_dest "-" escreve tar em stdout; terminado em ".tar" grava um arquivo tar
+static int do_export(int current_inode, const char *path, const char *host_dest, int uid) {
+    if (!path || !host_dest || !validUid(uid)) return -1;
+
+    int root_inode;
+    if (resolvePath(path, current_inode, &root_inode) != 0) {
+        fprintf(stderr, "export: caminho não encontrado: %s\n", path);
+        return -1;
+    }
+
+    export_ctx_t ctx = {0};
+    ctx.uid = uid;
+    ctx.buffer = malloc((size_t)EXPORT_CHUNK_BLOCKS * BLOCK_SIZE);
+    ctx.paths = calloc(MAX_INODES, sizeof(char *));
+    ctx.links = malloc(MAX_INODES * sizeof(int));
+    if (!ctx.buffer || !ctx.paths || !ctx.links) {
+        free(ctx.buffer); free(ctx.paths); free(ctx.links);
+        return -1;
+    }
+
+    size_t dest_len = strlen(host_dest);
+    FILE *tar_file = NULL;
+    if (strcmp(host_dest, "-") == 0) {
+        fflush(stdout);
+        ctx.tar = stdout;
+    } else if (dest_len > 4 && strcmp(host_dest + dest_len - 4, ".tar") == 0) {
+        tar_file = fopen(host_dest, "wb");
+        if (!tar_file) {
+            perror("export");
+            free(ctx.buffer); free(ctx.paths); free(ctx.links);
+            return -1;
+        }
+        ctx.tar = tar_file;
+    } else {
+        if (mkdir(host_dest, 0755) != 0 && errno != EEXIST) {
+            perror("export");
+            free(ctx.buffer); free(ctx.paths); free(ctx.links);
+            return -1;
+        }
+        ctx.host_root = host_dest;
+    }
+
+    if (inode_table[root_inode].type == FILE_DIRECTORY) {
+        exportEntry(&ctx, root_inode, "");
+    } else {
+        exportEntry(&ctx, root_inode, inode_meta[root_inode].name);
+    }
+    exportLinks(&ctx);
+
+    if (ctx.tar && !ctx.aborted) {
+        // fim do arquivo tar: dois blocos zerados
+        char zero[2 * BLOCK_SIZE] = {0};
+        fwrite(zero, 1, sizeof(zero), ctx.tar);
+        fflush(ctx.tar);
+    }
+    if (tar_file) fclose(tar_file);
+
+    // com tar em stdout o resumo vai para stderr
+    fprintf(strcmp(host_dest, "-") == 0 ? stderr : stdout,
+            "export: %d diretórios, %d arquivos, %d links, %llu bytes%s\n",
+            ctx.dirs, ctx.files, ctx.symlinks, ctx.bytes, ctx.errors ? " (com erros)" : "");
+
+    for (int i = 0; i < MAX_INODES; i++) free(ctx.paths[i]);
+    free(ctx.paths);
+    free(ctx.links);
+    free(ctx.buffer);
+    return ctx.errors ? -1 : 0;
+}
+
+/* ---- Verificação de consistência (fsck) ---- */
+/* Fase 1: busca em largura pelos diretórios a partir da raiz, um nível por vez,
+ *         com as threads dividindo os diretórios do nível; marca os inodes
+ *         alcançados e descarta entradas inválidas.
+ * Fase 2: as threads dividem a tabela de inodes; cada inode alcançado tem sua
+ *         cadeia next_inode percorrida e seus blocos reivindicados; depois,
+ *         a imagem de cada snapshot e os blocos que ela congelou.
+ * Fase 3: os bitmaps são comparados com o que foi reivindicado e, com repair,
+ *         reconstruídos. O bloco 0 continua sempre reservado.
+ * Fase 4: o uso por subárvore (du) é recalculado e comparado com o mantido. */
+#define FSCK_HEAD 1    /* alcançado por entrada de diretório (ou raiz) */
+#define FSCK_CHAIN 2   /* inode de extensão de alguma cadeia */
+
+typedef struct {
+    int repair;
+    int threads;
+    uint8_t *inode_ref;
+    uint16_t *block_ref;            /* referências encontradas por bloco */
+    uint32_t *parent;               /* diretório onde cada inode foi achado */
+    int *frontier, frontier_count;
+    int *next, next_count, next_cap;
+    int cursor;                     /* próximo índice a ser pego pelas threads */
+    int failed;                     /* sem memória: algum diretório não foi lido */
+    pthread_mutex_t lock;
+    fsck_report_t *report;
+} fsck_ctx_t;
+
+#define FSCK_COUNT(field, n) __atomic_fetch_add(&ctx->report->field, (n), __ATOMIC_RELAXED)
+
+static int inodeAllocated(uint32_t index) {
+    return index < MAX_INODES && (inode_bitmap[index / 8] & (1 << (index % 8)));
+}
+
+static int validNext(uint32_t next) {
+    return next != 0 && inodeAllocated(next);
+}
+
+static void fsckPushDir(fsck_ctx_t *ctx, int dir) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->next_count == ctx->next_cap) {
+        int cap = ctx->next_cap ? ctx->next_cap * 2 : 256;
+        int *next = realloc(ctx->next, cap * sizeof(int));
+        if (!next) {
+            ctx->failed = 1;
+            pthread_mutex_unlock(&ctx->lock);
+            return;
+        }
+        ctx->next = next;
+        ctx->next_cap = cap;
+    }
+    ctx->next[ctx->next_count++] = dir;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+/* Lê as entradas de um diretório (e de sua cadeia) */
+static void fsckScanDir(fsck_ctx_t *ctx, int dir, dir_entry_t *buffer) {
+    int entries = BLOCK_SIZE / sizeof(dir_entry_t);
+    int current = dir;
+    for (int hops = 0; hops < MAX_INODES; hops++) {
+        inode_t *node = &inode_table[current];
+        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+            uint32_t block = node->blocks[i];
+            if (block == 0 || block >= computed_data_blocks) continue;
+            if (readBlock(block, buffer) != 0) continue;
 
-                    // Formata datas
-                    char ctime_buf[32], mtime_buf[32];
-                    format_time(entry_inode->creation_date, ctime_buf, sizeof(ctime_buf));
-                    format_time(entry_inode->modification_date, mtime_buf, sizeof(mtime_buf));
-
-                    printf("%c%s %8s %8s %8lu %s %s", 
-                        type,
-                        perm_str,
-                        entry_inode->owner,
-                        entry_inode->creator,
-                        (unsigned long)entry_inode->size,
-                        mtime_buf, 
-                        entry_inode->name
-                    );
-
-                    // Se for link simbólico, mostra o alvo
-                    if (entry_inode->type == FILE_SYMLINK) {
-                        printf(" -> %s", inode_table[entry_inode->link_target_index].name);
+            int dirty = 0;
+            for (int j = 0; j < entries; j++) {
+                dir_entry_t *e = &buffer[j];
+                if (e->inode_index == 0) continue;
+                if (strcmp(e->name, ".") == 0 || strcmp(e->name, "..") == 0) continue;
+
+                uint32_t target = e->inode_index;
+                if (!inodeAllocated(target) || (unsigned)inode_table[target].type > FILE_SYMLINK) {
+                    FSCK_COUNT(bad_entries, 1);
+                    if (ctx->repair) {
+                        e->inode_index = 0;
+                        e->name[0] = '\0';
+                        dirty = 1;
                     }
-                    printf("\n");
-                }
-                else {
-                    printf("-%c     %s\n", type, entry_inode->name);
+                    continue;
                 }
+
+                ctx->parent[target] = dir;
+                if (__atomic_exchange_n(&ctx->inode_ref[target], FSCK_HEAD, __ATOMIC_RELAXED) == 0 &&
+                    inode_table[target].type == FILE_DIRECTORY)
+                    fsckPushDir(ctx, target);
+            }
+            if (dirty) writeBlock(block, buffer);
+        }
+        if (!validNext(node->next_inode)) break;
+        current = node->next_inode;
+    }
+}
+
+static void *fsckDirWorker(void *arg) {
+    fsck_ctx_t *ctx = ((parallel_worker_t *)arg)->ctx;
+    dir_entry_t *buffer = malloc(BLOCK_SIZE);
+    if (!buffer) {
+        __atomic_store_n(&ctx->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    for (;;) {
+        int i = __atomic_fetch_add(&ctx->cursor, 1, __ATOMIC_RELAXED);
+        if (i >= ctx->frontier_count) break;
+        fsckScanDir(ctx, ctx->frontier[i], buffer);
+        FSCK_COUNT(directories, 1);
+    }
+    free(buffer);
+    return NULL;
+}
+
+/* Reivindica os blocos de uma cadeia; ponteiros inválidos ou já
+ * reivindicados por outro inode são contados (e zerados com repair) */
+static void fsckClaimChain(fsck_ctx_t *ctx, int head) {
+    int current = head;
+    for (;;) {
+        inode_t *node = &inode_table[current];
+        FSCK_COUNT(inodes_checked, 1);
+
+        // inline: o tamanho precisa caber no inode e não há cadeia
+        if ((node->flags & INODE_INLINE) && (node->type != FILE_REGULAR || node->size > INODE_INLINE_MAX)) {
+            FSCK_COUNT(bad_pointers, 1);
+            if (ctx->repair) {
+                if (node->type == FILE_REGULAR) node->size = INODE_INLINE_MAX;
+                else node->flags &= ~INODE_INLINE;
+            }
+        }
+        for (int i = 0; inodeHasBlocks(node) && i < BLOCKS_PER_INODE; i++) {
+            uint32_t block = node->blocks[i];
+            if (block == 0) continue;
+            if (block >= computed_data_blocks) {
+                FSCK_COUNT(bad_pointers, 1);
+                if (ctx->repair) node->blocks[i] = 0;
+                continue;
+            }
+            // blocos deduplicados podem ter até block_refs[block] donos
+            uint16_t allowed = block_refs[block] ? block_refs[block] : 1;
+            if (__atomic_fetch_add(&ctx->block_ref[block], 1, __ATOMIC_RELAXED) >= allowed) {
+                __atomic_fetch_sub(&ctx->block_ref[block], 1, __ATOMIC_RELAXED);
+                FSCK_COUNT(bad_pointers, 1);
+                if (ctx->repair) node->blocks[i] = 0;
+            }
+        }
+
+        uint32_t next = node->next_inode;
+        if (next == 0) break;
+        uint8_t expected = 0;
+        if (!inodeAllocated(next) ||
+            !__atomic_compare_exchange_n(&ctx->inode_ref[next], &expected, FSCK_CHAIN, 0,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            FSCK_COUNT(bad_pointers, 1);
+            if (ctx->repair) node->next_inode = 0;
+            break;
+        }
+        current = next;
+    }
+}
+
+static void *fsckChainWorker(void *arg) {
+    parallel_worker_t *w = arg;
+    fsck_ctx_t *ctx = w->ctx;
+    // faixas intercaladas: inodes vizinhos costumam ter tamanhos parecidos
+    const int stride = 64;
+    for (int base = w->id * stride; base < MAX_INODES; base += ctx->threads * stride) {
+        int end = base + stride < MAX_INODES ? base + stride : MAX_INODES;
+        for (int i = base; i < end; i++)
+            if (ctx->inode_ref[i] == FSCK_HEAD) fsckClaimChain(ctx, i);
+    }
+    return NULL;
+}
+
+/* Reivindica a imagem de cada snapshot e os blocos que ela referencia.
+ * Um snapshot ilegível é contado e, com repair, sai do catálogo: os blocos
+ * que só ele usava viram perdidos e as contagens são acertadas na fase 3. */
+static void fsckClaimSnapshots(fsck_ctx_t *ctx) {
+    for (int s = 0; s < MAX_SNAPSHOTS; s++) {
+        fs_snapshot_t *snap = &snapshot_table->snapshots[s];
+        if (!snap->name[0]) continue;
+
+        snapshot_image_t img;
+        if (snap->first_block >= computed_data_blocks ||
+            snap->image_blocks > computed_data_blocks - snap->first_block ||
+            snapshotLoad(snap, &img) != 0) {
+            ctx->report->bad_snapshots++;
+            if (ctx->repair) memset(snap, 0, sizeof(*snap));
+            continue;
+        }
+        for (uint32_t b = 0; b < snap->image_blocks; b++) ctx->block_ref[snap->first_block + b]++;
+        for (uint32_t i = 0; i < MAX_INODES; i++) {
+            if (!snapshotInodeAllocated(img.inode_bitmap, i)) continue;
+            inode_t *inode = &img.inode_table[i];
+            for (int k = 0; inodeHasBlocks(inode) && k < BLOCKS_PER_INODE; k++) {
+                uint32_t block = inode->blocks[k];
+                if (block && block < computed_data_blocks) ctx->block_ref[block]++;
+            }
+        }
+        snapshotFreeImage(&img);
+    }
+}
+
+/* Verifica (e, com repair, corrige) bitmaps, entradas e cadeias.
+ * threads <= 0 usa o número de CPUs. Retorna o número de problemas
+ * encontrados, ou -1 em erro. */
+int fsck_fs(int repair, int threads, fsck_report_t *report) {
+    if (!disk || !block_bitmap || !inode_bitmap || !inode_table || !report) return -1;
+    memset(report, 0, sizeof(*report));
+    uint64_t start = stats_now();
+
+    if (threads <= 0) threads = parallelThreads();
+    if (threads > FSCK_MAX_THREADS) threads = FSCK_MAX_THREADS;
+
+    fsck_ctx_t ctx = {0};
+    ctx.repair = repair;
+    ctx.threads = threads;
+    ctx.report = report;
+    ctx.inode_ref = calloc(MAX_INODES, 1);
+    ctx.block_ref = calloc(computed_data_blocks, sizeof(uint16_t));
+    ctx.parent = calloc(MAX_INODES, sizeof(uint32_t));
+    ctx.frontier = malloc(sizeof(int));
+    if (!ctx.inode_ref || !ctx.block_ref || !ctx.parent || !ctx.frontier) {
+        free(ctx.inode_ref); free(ctx.block_ref); free(ctx.parent); free(ctx.frontier);
+        return -1;
+    }
+    pthread_mutex_init(&ctx.lock, NULL);
+    int previous = set_deferred_sync(1);
+    adviseInodeTable(MADV_SEQUENTIAL);
+
+    /* Fase 1: diretórios, nível a nível */
+    ctx.inode_ref[ROOT_INODE] = FSCK_HEAD;
+    ctx.frontier[0] = ROOT_INODE;
+    ctx.frontier_count = 1;
+    while (ctx.frontier_count > 0 && !ctx.failed) {
+        ctx.cursor = 0;
+        parallelRun(threads, fsckDirWorker, &ctx);
+        free(ctx.frontier);
+        ctx.frontier = ctx.next;
+        ctx.frontier_count = ctx.next_count;
+        ctx.next = NULL;
+        ctx.next_count = ctx.next_cap = 0;
+    }
+    // uma árvore lida pela metade faria tudo abaixo dela parecer órfão
+    int problems = -1;
+    if (ctx.failed) {
+        fprintf(stderr, "fsck: memória insuficiente para percorrer os diretórios; verificação abortada\n");
+        goto done;
+    }
+
+    /* Fase 2: cadeias e blocos */
+    ctx.block_ref[0] = 1;
+    parallelRun(threads, fsckChainWorker, &ctx);
+    fsckClaimSnapshots(&ctx);
+
+    /* Fase 3: compara e reconstrói os bitmaps */
+    for (uint32_t i = 0; i < MAX_INODES; i++) {
+        if (inodeAllocated(i) && !ctx.inode_ref[i]) {
+            report->orphan_inodes++;
+            if (repair) {
+                inode_bitmap[i / 8] &= ~(1 << (i % 8));
+                memset(&inode_table[i], 0, sizeof(inode_t));
+                memset(&inode_meta[i], 0, sizeof(inode_meta_t));
+            }
+        }
+    }
+    for (uint32_t b = 0; b < computed_data_blocks; b++) {
+        int marked = (block_bitmap[b / 8] >> (b % 8)) & 1;
+        if (marked && !ctx.block_ref[b]) {
+            report->leaked_blocks++;
+            if (repair) {
+                block_bitmap[b / 8] &= ~(1 << (b % 8));
+                block_refs[b] = 0;
+            }
+            continue;
+        } else if (!marked && ctx.block_ref[b]) {
+            report->unmarked_blocks++;
+            if (repair) block_bitmap[b / 8] |= 1 << (b % 8);
+        }
+        // referências perdidas (ex.: queda no meio de um rm) deixam a contagem alta
+        // (e um bloco compartilhado com snapshot precisa contar todos os donos)
+        if (b != 0 && (block_refs[b] > 1 || ctx.block_ref[b] > 1) && block_refs[b] != ctx.block_ref[b]) {
+            report->bad_refcounts++;
+            if (repair) block_refs[b] = ctx.block_ref[b];
+        }
+    }
+
+    /* Fase 4: uso por subárvore (du), recalculado a partir dos inodes alcançados */
+    inode_usage_t *usage = calloc(MAX_INODES, sizeof(inode_usage_t));
+    if (usage) {
+        for (uint32_t i = 0; i < MAX_INODES; i++) {
+            if (ctx.inode_ref[i] != FSCK_HEAD) continue;
+            usage[i].parent = ctx.parent[i];
+            uint64_t bytes = inode_table[i].type == FILE_REGULAR ? inode_table[i].size : 0;
+            uint32_t blocks = inodeBlockCount(i);
+            for (uint32_t dir = i, hops = 0; hops < MAX_INODES; hops++) {
+                usage[dir].bytes += bytes;
+                usage[dir].blocks += blocks;
+                if (dir == ROOT_INODE) break;
+                dir = ctx.parent[dir];
+            }
+        }
+        for (uint32_t i = 0; i < MAX_INODES; i++) {
+            if (ctx.inode_ref[i] != FSCK_HEAD) continue;
+            if (memcmp(&usage[i], &inode_usage[i], sizeof(inode_usage_t)) != 0) {
+                report->bad_usage++;
+                if (repair) inode_usage[i] = usage[i];
             }
+        }
+        free(usage);
+    }
+
+    problems = report->bad_entries + report->bad_pointers + report->orphan_inodes +
+               report->leaked_blocks + report->unmarked_blocks + report->bad_refcounts +
+               report->bad_usage + report->bad_snapshots;
+    if (repair && problems) {
+        groupsRecount();
+        sync_fs();
+    }
+done:
+    set_deferred_sync(previous);
+    adviseInodeTable(MADV_RANDOM);
+
+    pthread_mutex_destroy(&ctx.lock);
+    free(ctx.inode_ref);
+    free(ctx.block_ref);
+    free(ctx.parent);
+    free(ctx.frontier);
+    free(ctx.next);
+
+    report->threads = threads;
+    report->elapsed_ns = stats_now() - start;
+    return problems;
+}
+
+static void fsckPrint(const fsck_report_t *r, int problems, int repair) {
+    printf("fsck: %u inodes em %u diretórios verificados em %.1f ms (%d threads)\n",
+           r->inodes_checked, r->directories, r->elapsed_ns / 1e6, r->threads);
+    if (problems == 0) {
+        printf("  sistema de arquivos consistente\n");
+        return;
+    }
+    printf("  entradas inválidas         %8u\n", r->bad_entries);
+    printf("  ponteiros inválidos        %8u\n", r->bad_pointers);
+    printf("  inodes órfãos              %8u\n", r->orphan_inodes);
+    printf("  blocos perdidos            %8u\n", r->leaked_blocks);
+    printf("  blocos em uso não marcados %8u\n", r->unmarked_blocks);
+    printf("  contagens de dedup erradas %8u\n", r->bad_refcounts);
+    printf("  uso de subárvore errado    %8u\n", r->bad_usage);
+    printf("  snapshots danificados      %8u\n", r->bad_snapshots);
+    printf(repair ? "  (reparado)\n" : "  (use 'fsck -r' para reparar)\n");
+}
+
+// fsck (verifica; com repair != 0 também corrige)
+static int do_fsck(int repair) {
+    fsck_report_t report;
+    int problems = fsck_fs(repair, 0, &report);
+    if (problems < 0) return -1;
+    fsckPrint(&report, problems, repair);
+    return problems && !repair ? -1 : 0;
+}
 
-            free(entries);
+/* ---- stats (contadores e latências) ---- */
+
+/* Limite superior (us) do bucket que contém o percentil p */
+static uint64_t stats_percentile_us(const uint64_t *hist, uint64_t count, double p) {
+    if (count == 0) return 0;
+    uint64_t want = (uint64_t)(p * count + 0.5), acc = 0;
+    if (want == 0) want = 1;
+    for (int b = 0; b < STAT_LAT_BUCKETS; b++) {
+        acc += hist[b];
+        if (acc >= want) return 1ull << b;
+    }
+    return 1ull << (STAT_LAT_BUCKETS - 1);
+}
+
+// stats (mostra contadores; com reset != 0 zera depois de mostrar)
+int cmd_stats(int reset) {
+    fs_stats_t st = fs_stats;
+
+    printf("E/S de disco\n");
+    printf("  blocos lidos        %12llu\n", (unsigned long long)st.block_reads);
+    printf("  blocos escritos     %12llu\n", (unsigned long long)st.block_writes);
+    printf("  bytes lidos         %12llu\n", (unsigned long long)st.bytes_read);
+    printf("  bytes escritos      %12llu\n", (unsigned long long)st.bytes_written);
+    printf("  fsync               %12llu\n", (unsigned long long)st.fsyncs);
+    printf("Metadados\n");
+    printf("  sync_fs (chamadas)  %12llu\n", (unsigned long long)st.sync_fs_calls);
+    printf("  sync_fs (gravações) %12llu\n", (unsigned long long)st.metadata_flushes);
+    printf("  sync_inode          %12llu\n", (unsigned long long)st.sync_inode_calls);
+    printf("Alocação\n");
+    printf("  blocos alocados     %12llu  (bits varridos: %llu, média %.1f)\n",
+           (unsigned long long)st.block_allocs, (unsigned long long)st.alloc_bits_scanned,
+           st.block_allocs ? (double)st.alloc_bits_scanned / st.block_allocs : 0.0);
+    printf("  blocos liberados    %12llu\n", (unsigned long long)st.block_frees);
+    printf("  blocos descartados  %12llu\n", (unsigned long long)st.blocks_discarded);
+    printf("  inodes alocados     %12llu  (bits varridos: %llu, média %.1f)\n",
+           (unsigned long long)st.inode_allocs, (unsigned long long)st.inode_bits_scanned,
+           st.inode_allocs ? (double)st.inode_bits_scanned / st.inode_allocs : 0.0);
+    printf("Compressão\n");
+    printf("  chunks comprimidos  %12llu\n", (unsigned long long)st.chunks_compressed);
+    printf("  chunks lidos        %12llu\n", (unsigned long long)st.chunks_decompressed);
+    printf("Deduplicação\n");
+    printf("  blocos procurados   %12llu  (compartilhados: %llu)\n",
+           (unsigned long long)st.dedup_lookups, (unsigned long long)st.dedup_hits);
+    printf("  cópias (COW)        %12llu\n", (unsigned long long)st.dedup_cow);
+    printf("Integridade (CRC32C, %s)\n", crc32c_backend());
+    printf("  blocos conferidos   %12llu  (erros: %llu)\n",
+           (unsigned long long)st.checksums_verified, (unsigned long long)st.checksum_errors);
+    printf("Diretórios\n");
+    printf("  buscas              %12llu  (entradas varridas: %llu, média %.1f)\n",
+           (unsigned long long)st.dir_lookups, (unsigned long long)st.dir_entries_scanned,
+           st.dir_lookups ? (double)st.dir_entries_scanned / st.dir_lookups : 0.0);
+
+    printf("Latência por comando (us; percentis pelo limite do bucket)\n");
+    printf("  %-10s %10s %8s %12s %10s %10s %10s\n", "comando", "chamadas", "erros", "média", "p50<=", "p99<=", "máx<=");
+    for (int id = 1; id < STAT_CMD_COUNT; id++) {
+        uint64_t calls = st.cmd_calls[id];
+        if (calls == 0) continue;
+        uint64_t max_bucket = 0;
+        for (int b = 0; b < STAT_LAT_BUCKETS; b++)
+            if (st.cmd_latency[id][b]) max_bucket = b;
+        printf("  %-10s %10llu %8llu %12.1f %10llu %10llu %10llu\n",
+               fs_cmd_names[id], (unsigned long long)calls, (unsigned long long)st.cmd_errors[id],
+               st.cmd_total_ns[id] / 1000.0 / calls,
+               (unsigned long long)stats_percentile_us(st.cmd_latency[id], calls, 0.50),
+               (unsigned long long)stats_percentile_us(st.cmd_latency[id], calls, 0.99),
+               (unsigned long long)(1ull << max_bucket));
+    }
+
+    if (reset) {
+        reset_stats();
+        printf("(contadores zerados)\n");
+    }
+    return 0;
+}
+
+/* ---- Comandos instrumentados ---- */
+/* Cada cmd_* público mede a própria latência; chamadas internas entre
+ * comandos usam as versões do_* para não contar duas vezes */
+#define TIMED_CMD(id, call) do {              \
+        fs_cmd_id_t outer_ = current_cmd;     \
+        current_cmd = (id);                   \
+        uint64_t start_ = stats_now();        \
+        int result_ = (call);                 \
+        stats_cmd_done((id), start_, result_); \
+        current_cmd = outer_;                 \
+        return result_;                       \
+    } while (0)
+
+int cmd_cd(int *current_inode, const char *path) {
+    TIMED_CMD(STAT_CMD_CD, do_cd(current_inode, path));
+}
+
+int cmd_mkdir(int current_inode, const char *full_path, int uid) {
+    TIMED_CMD(STAT_CMD_MKDIR, do_mkdir(current_inode, full_path, uid));
+}
+
+int cmd_touch(int current_inode, const char *full_path, int uid) {
+    TIMED_CMD(STAT_CMD_TOUCH, do_touch(current_inode, full_path, uid));
+}
+
+int cmd_echo_arrow(int current_inode, const char *full_path, const char *content, int uid) {
+    TIMED_CMD(STAT_CMD_ECHO, do_echo_arrow(current_inode, full_path, content, uid));
+}
+
+int cmd_echo_arrow_arrow(int current_inode, const char *full_path, const char *content, int uid) {
+    TIMED_CMD(STAT_CMD_ECHO_APPEND, do_echo_arrow_arrow(current_inode, full_path, content, uid));
+}
+
+int cmd_cat(int current_inode, const char *path, int uid) {
+    TIMED_CMD(STAT_CMD_CAT, do_cat(current_inode, path, uid));
+}
+
+int cmd_cp(int current_inode, const char *src_path, const char *src_name,
+           const char *dst_path, const char *dst_name, int uid) {
+    TIMED_CMD(STAT_CMD_CP, do_cp(current_inode, src_path, src_name, dst_path, dst_name, uid));
+}
+
+int cmd_cp_r(int current_inode, const char *src_path, const char *dst_path, int uid) {
+    TIMED_CMD(STAT_CMD_CP, do_cp_r(current_inode, src_path, dst_path, uid));
+}
+
+int cmd_mv(int current_inode, const char *src_path, const char *src_name,
+           const char *dst_path, const char *dst_name, int uid) {
+    TIMED_CMD(STAT_CMD_MV, do_mv(current_inode, src_path, src_name, dst_path, dst_name, uid));
+}
+
+int cmd_ln_s(int current_inode, const char *target_path, const char *link_path, int uid) {
+    TIMED_CMD(STAT_CMD_LN_S, do_ln_s(current_inode, target_path, link_path, uid));
+}
+
+int cmd_ls(int current_inode, const char *path, int uid, int info_arg) {
+    TIMED_CMD(STAT_CMD_LS, do_ls(current_inode, path, uid, info_arg));
+}
+
+int cmd_rm(int current_inode, const char *filepath, int uid) {
+    TIMED_CMD(STAT_CMD_RM, do_rm(current_inode, filepath, uid));
+}
+
+int cmd_rm_r(int current_inode, const char *filepath, int uid) {
+    TIMED_CMD(STAT_CMD_RM, do_rm_r(current_inode, filepath, uid));
+}
+
+int cmd_rmdir(int current_inode, const char *filepath, int uid) {
+    TIMED_CMD(STAT_CMD_RMDIR, do_rmdir(current_inode, filepath, uid));
+}
+
+int cmd_unlink(int current_inode, const char *filepath, int uid) {
+    TIMED_CMD(STAT_CMD_UNLINK, do_unlink(current_inode, filepath, uid));
+}
+
+int cmd_df(int groups) {
+    TIMED_CMD(STAT_CMD_DF, do_df(groups));
+}
+
+int cmd_import(int current_inode, const char *host_path, const char *dest_path, int uid) {
+    TIMED_CMD(STAT_CMD_IMPORT, do_import(current_inode, host_path, dest_path, uid));
+}
+
+int cmd_export(int current_inode, const char *path, const char *host_dest, int uid) {
+    TIMED_CMD(STAT_CMD_EXPORT, do_export(current_inode, path, host_dest, uid));
+}
+
+int cmd_fsck(int repair) {
+    TIMED_CMD(STAT_CMD_FSCK, do_fsck(repair));
+}
+
+/* Definidos mais abaixo, junto com o resto de cada comando */
+static int do_useradd(const char *name, const char *group, int uid);
+static int do_compress(int current_inode, const char *arg1, const char *arg2, int uid);
+static int do_dedup(const char *arg, int uid);
+static int do_discard(const char *arg, int uid);
+static int do_trim(int uid);
+static int do_snapshot(const char *action, const char *name, char *command, int uid);
+static int do_du(int current_inode, const char *path);
+static int do_find(int current_inode, int argc, char *argv[]);
+static int do_defrag(int current_inode, int argc, char *argv[], int uid);
+static int do_truncate(int current_inode, const char *path, const char *size_arg, int uid);
+static int do_fallocate(int current_inode, const char *path, const char *size_arg, int uid);
+static int do_write(int current_inode, const char *path, const char *offset_arg, const char *content, int uid);
+
+int cmd_useradd(const char *name, const char *group, int uid) {
+    TIMED_CMD(STAT_CMD_USERADD, do_useradd(name, group, uid));
+}
+
+int cmd_compress(int current_inode, const char *arg1, const char *arg2, int uid) {
+    TIMED_CMD(STAT_CMD_COMPRESS, do_compress(current_inode, arg1, arg2, uid));
+}
+
+int cmd_dedup(const char *arg, int uid) {
+    TIMED_CMD(STAT_CMD_DEDUP, do_dedup(arg, uid));
+}
+
+int cmd_discard(const char *arg, int uid) {
+    TIMED_CMD(STAT_CMD_DISCARD, do_discard(arg, uid));
+}
+
+int cmd_trim(int uid) {
+    TIMED_CMD(STAT_CMD_TRIM, do_trim(uid));
+}
+
+int cmd_snapshot(const char *action, const char *name, char *command, int uid) {
+    TIMED_CMD(STAT_CMD_SNAPSHOT, do_snapshot(action, name, command, uid));
+}
+
+int cmd_du(int current_inode, const char *path) {
+    TIMED_CMD(STAT_CMD_DU, do_du(current_inode, path));
+}
+
+int cmd_find(int current_inode, int argc, char *argv[]) {
+    TIMED_CMD(STAT_CMD_FIND, do_find(current_inode, argc, argv));
+}
+
+int cmd_defrag(int current_inode, int argc, char *argv[], int uid) {
+    TIMED_CMD(STAT_CMD_DEFRAG, do_defrag(current_inode, argc, argv, uid));
+}
+
+int cmd_truncate(int current_inode, const char *path, const char *size_arg, int uid) {
+    TIMED_CMD(STAT_CMD_TRUNCATE, do_truncate(current_inode, path, size_arg, uid));
+}
+
+int cmd_fallocate(int current_inode, const char *path, const char *size_arg, int uid) {
+    TIMED_CMD(STAT_CMD_FALLOCATE, do_fallocate(current_inode, path, size_arg, uid));
+}
+
+int cmd_write(int current_inode, const char *path, const char *offset_arg, const char *content, int uid) {
+    TIMED_CMD(STAT_CMD_WRITE, do_write(current_inode, path, offset_arg, content, uid));
+}
+
+// trace on [N] | trace off | trace dump <arquivo>
+int cmd_trace(const char *action, const char *arg) {
+    if (!action) return -1;
+    if (strcmp(action, "on") == 0) {
+        uint32_t capacity = arg ? (uint32_t)strtoul(arg, NULL, 10) : 0;
+        if (trace_start(capacity) != 0) {
+            printf("trace: memória insuficiente\n");
+            return -1;
+        }
+        printf("trace: ligado (%u registros)\n", trace_capacity);
+        return 0;
+    }
+    if (strcmp(action, "off") == 0) {
+        trace_stop();
+        printf("trace: desligado (%llu registros capturados)\n", (unsigned long long)trace_head);
+        return 0;
+    }
+    if (strcmp(action, "dump") == 0 && arg) {
+        if (trace_dump(arg) != 0) {
+            printf("trace: falha ao gravar %s\n", arg);
+            return -1;
+        }
+        uint64_t count = trace_head < trace_capacity ? trace_head : trace_capacity;
+        printf("trace: %llu registros gravados em %s\n", (unsigned long long)count, arg);
+        return 0;
+    }
+    printf("Uso: trace on [registros] | trace off | trace dump <arquivo>\n");
+    return -1;
+}
+
+/* useradd <nome> [grupo]: só root cria usuários */
+static int do_useradd(const char *name, const char *group, int uid) {
+    if (uid != ROOT_UID) {
+        printf("Permissão negada\n");
+        return -1;
+    }
+    int new_uid = userAdd(name, group);
+    if (new_uid < 0) {
+        printf("Não foi possível criar o usuário '%s'\n", name);
+        return -1;
+    }
+    int gid = userGid(new_uid);
+    printf("Usuário %s criado (uid=%d, gid=%d %s)\n", name, new_uid, gid, groupName(gid));
+    return 0;
+}
+
+/* compress <arquivo> | compress -d <arquivo> | compress -a on|off (padrão do volume) */
+static int do_compress(int current_inode, const char *arg1, const char *arg2, int uid) {
+    if (strcmp(arg1, "-a") == 0 && arg2 && (strcmp(arg2, "on") == 0 || strcmp(arg2, "off") == 0)) {
+        if (uid != ROOT_UID) {
+            printf("Permissão negada\n");
+            return -1;
+        }
+        int enable = strcmp(arg2, "on") == 0;
+        if (setVolumeFeature(FS_FEAT_COMPRESS, enable) != 0) return -1;
+        printf("Compressão de arquivos novos %s\n", enable ? "ligada" : "desligada");
+        return 0;
+    }
+
+    int enable = 1;
+    const char *path = arg1;
+    if (strcmp(arg1, "-d") == 0) {
+        enable = 0;
+        path = arg2;
+    }
+    if (!path || path[0] == '-') {
+        printf("Uso: compress [-d] <arquivo> | compress -a on|off\n");
+        return -1;
+    }
+
+    int inode_index;
+    if (resolvePath(path, current_inode, &inode_index) != 0) {
+        printf("Arquivo não encontrado\n");
+        return -1;
+    }
+    if (setFileCompression(inode_index, enable, uid) != 0) {
+        printf("Falha ao %s '%s'\n", enable ? "comprimir" : "descomprimir", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* dedup on|off (só root) liga a deduplicação de blocos novos; sem
+ * argumento, mostra o estado e quantos blocos estão sendo economizados */
+static int do_dedup(const char *arg, int uid) {
+    if (arg) {
+        if (strcmp(arg, "on") != 0 && strcmp(arg, "off") != 0) {
+            printf("Uso: dedup [on|off]\n");
+            return -1;
+        }
+        if (uid != ROOT_UID) {
+            printf("Permissão negada\n");
+            return -1;
+        }
+        if (setVolumeFeature(FS_FEAT_DEDUP, strcmp(arg, "on") == 0) != 0) return -1;
+    }
+
+    uint32_t shared = 0;
+    uint64_t saved = 0;
+    for (uint32_t b = 1; b < computed_data_blocks; b++) {
+        if (block_refs[b] > 1) {
+            shared++;
+            saved += block_refs[b] - 1;
+        }
+    }
+    printf("Deduplicação %s: %u blocos compartilhados, %llu blocos economizados (%llu KiB)\n",
+           (fs_features & FS_FEAT_DEDUP) ? "ligada" : "desligada", shared,
+           (unsigned long long)saved, (unsigned long long)saved * BLOCK_SIZE / 1024);
+    return 0;
+}
+
+/* Espaço que o disk.dat ocupa de fato no host, em KiB */
+static unsigned long long hostUsageKiB(void) {
+    struct stat st;
+    if (fstat(fileno(disk), &st) != 0) return 0;
+    return (unsigned long long)st.st_blocks * 512 / 1024;
+}
+
+/* discard on|off (só root) liga o descarte contínuo: o espaço dos blocos
+ * liberados volta para o host a cada gravação dos metadados; sem
+ * argumento, mostra o estado e quanto o disco ocupa no host */
+static int do_discard(const char *arg, int uid) {
+    if (arg) {
+        if (strcmp(arg, "on") != 0 && strcmp(arg, "off") != 0) {
+            printf("Uso: discard [on|off]\n");
+            return -1;
+        }
+        if (uid != ROOT_UID) {
+            printf("Permissão negada\n");
+            return -1;
         }
-        dir_inode = &inode_table[dir_inode->next_inode];
-    } while (dir_inode->next_inode != 0);
+        if (setVolumeFeature(FS_FEAT_DISCARD, strcmp(arg, "on") == 0) != 0) return -1;
+    }
+    printf("Descarte %s: disco ocupa %llu KiB de %u KiB no host\n",
+           (fs_features & FS_FEAT_DISCARD) ? "ligado" : "desligado", hostUsageKiB(),
+           DISK_SIZE_MB * 1024);
     return 0;
 }
 
-// remove elementos (usada tanto por rmdir quanto por rm)
-int cmd_remove(int current_inode, const char *filepath, const char *user, int remove_dir) {
-    if (!filepath || !user) return -1;
-
-    char parent_path[1024];
-    char name[MAX_NAMESIZE];
-
-    // Encontra a última barra para separar caminho/nome
-    splitPath(filepath, parent_path, name);
-    
-    // resolve o inode do diretorio pai
-    int parent_inode;
-    if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
-        if (remove_dir)
-            printf("rmdir: diretório não encontrado: %s\n", parent_path);
-        else
-            printf("Arquivo não encontrado\n");
+/* trim (só root) descarta de uma vez todo o espaço livre do volume, inclusive
+ * o liberado antes de o descarte ser ligado ou por um fsck */
+static int do_trim(int uid) {
+    if (uid != ROOT_UID) {
+        printf("Permissão negada\n");
         return -1;
     }
-
-    // Procura o arquivo com o nome dentro do diretório pai
-    int target_inode;
-    if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
-        if (remove_dir)
-            printf("rmdir: não existe o diretório: %s\n", filepath);
-        else
-            printf("Arquivo não encontrado\n");
+    if (snapshot_view) {
+        printf("[ERRO] trim não é permitido dentro de um snapshot\n");
         return -1;
     }
+    flush_fs();
+    unsigned long long before = hostUsageKiB();
+    long discarded = discardRange(1, computed_data_blocks);
+    if (discarded < 0) {
+        printf("[ERRO] o sistema de arquivos do host não suporta buracos: %s\n", strerror(errno));
+        return -1;
+    }
+    diskSync();
+    printf("%ld blocos livres descartados; disco ocupa %llu KiB no host (antes: %llu KiB)\n",
+           discarded, hostUsageKiB(), before);
+    return 0;
+}
 
-    inode_t *target = &inode_table[target_inode];
-
-    // Verifica conforme o tipo de rm (e.g. rm ou rmdir)
-    if (remove_dir) {
-        if (target->type != FILE_DIRECTORY) {
-            printf("rmdir: não é um diretório: %s\n", filepath);
+/* snapshot create|delete <nome> (só root), snapshot list e
+ * snapshot show <nome> <comando>: executa ls, cat, find, du ou export
+ * dentro do snapshot, a partir da raiz dele */
+static int do_snapshot(const char *action, const char *name, char *command, int uid) {
+    static const char *const readonly_cmds[] = { "ls", "cat", "find", "du", "export", NULL };
+
+    if (action && strcmp(action, "list") == 0) {
+        int count = 0;
+        for (int s = 0; s < MAX_SNAPSHOTS; s++) {
+            fs_snapshot_t *snap = &snapshot_table->snapshots[s];
+            if (!snap->name[0]) continue;
+            char date[32];
+            format_time(snap->creation_date, date, sizeof(date));
+            printf("%-*s %s  %6u inodes  imagem de %u blocos\n", MAX_NAMESIZE, snap->name, date,
+                   snap->inodes, snap->image_blocks);
+            count++;
+        }
+        if (!count) printf("Nenhum snapshot\n");
+        return 0;
+    }
+    if (action && name && (strcmp(action, "create") == 0 || strcmp(action, "delete") == 0)) {
+        if (uid != ROOT_UID) {
+            printf("Permissão negada\n");
             return -1;
         }
-        if (deleteDirectory(parent_inode, name, user) != 0) {
-            printf("rmdir: não foi possível remover '%s'\n", filepath);
+        int create = strcmp(action, "create") == 0;
+        if (create && snapshotLookup(name) >= 0) {
+            printf("snapshot: '%s' já existe\n", name);
             return -1;
         }
-        return 0;
-    } else {
-        if (target->type == FILE_DIRECTORY) {
-            printf("rm: não é possível remover '%s': é um diretório\n", filepath);
+        if (!create && snapshotLookup(name) < 0) {
+            printf("snapshot: '%s' não existe\n", name);
             return -1;
         }
-        if (deleteFile(parent_inode, name, user) != 0) {
-            printf("Erro ao remover arquivo: %s\n", filepath);
+        if ((create ? snapshotCreate(name) : snapshotDelete(name)) != 0) {
+            printf("snapshot: falha ao %s '%s'\n", create ? "criar" : "apagar", name);
             return -1;
         }
         return 0;
     }
+    if (action && name && command && strcmp(action, "show") == 0) {
+        int index = snapshotLookup(name);
+        if (index < 0) {
+            printf("snapshot: '%s' não existe\n", name);
+            return -1;
+        }
+        size_t len = strcspn(command, " ");
+        int allowed = 0;
+        for (int i = 0; readonly_cmds[i] && !allowed; i++)
+            allowed = strlen(readonly_cmds[i]) == len && strncmp(command, readonly_cmds[i], len) == 0;
+        if (!allowed) {
+            printf("snapshot: só ls, cat, find, du e export dentro de um snapshot\n");
+            return -1;
+        }
+        if (snapshotEnter(index) != 0) {
+            printf("snapshot: imagem de '%s' ilegível\n", name);
+            return -1;
+        }
+        int cwd = ROOT_INODE, view_uid = uid;
+        int res = cmd_exec(command, &cwd, &view_uid);
+        snapshotLeave();
+        return res;
+    }
+
+    printf("Uso: snapshot create|delete <nome> | snapshot list | snapshot show <nome> <comando>\n");
+    return -1;
 }
 
-// rm (remove arquivo)
-int cmd_rm(int current_inode, const char *filepath, const char *user) {
-    return cmd_remove(current_inode, filepath, user, 0);
+/* du [caminho]: uso da subárvore, lido direto de inode_usage (sem percorrer) */
+static int do_du(int current_inode, const char *path) {
+    int inode_index;
+    if (resolvePath(path, current_inode, &inode_index) != 0) {
+        printf("du: caminho não encontrado: %s\n", path);
+        return -1;
+    }
+    inode_usage_t *u = &inode_usage[inode_index];
+    printf("%llu bytes\t%u blocos (%llu KiB)\t%s\n", (unsigned long long)u->bytes, u->blocks,
+           (unsigned long long)u->blocks * BLOCK_SIZE / 1024, path);
+    return 0;
 }
 
-// rmdir (remove diretorio)
-int cmd_rmdir(int current_inode, const char *filepath, const char *user) {
-    printf("passou");
-    return cmd_remove(current_inode, filepath, user, 1);
+/* ---- find (percurso paralelo com roubo de trabalho) ---- */
+/* Cada worker tem uma deque de diretórios pendentes: o dono empilha e
+ * desempilha pelo fim (em profundidade, o que mantém os blocos de diretório
+ * recém-lidos por perto), e quem fica sem trabalho rouba pelo início da
+ * deque de outro worker, onde estão os diretórios mais rasos e portanto as
+ * maiores subárvores. Cada diretório vem de dirList, já com os dados dos
+ * inodes, então o único I/O é a leitura dos blocos de diretório. */
+typedef struct {
+    const char *name;           /* glob (fnmatch) sobre o nome; NULL = qualquer */
+    int type;                   /* FILE_REGULAR, FILE_DIRECTORY, FILE_SYMLINK ou FILE_ANY */
+    int size_cmp;               /* -1 menor, 0 igual, +1 maior; só vale com has_size */
+    int has_size;
+    uint64_t size;
+    int uid;                    /* dono; -1 = qualquer */
+    int mtime_cmp;              /* como size_cmp, em dias inteiros desde a modificação */
+    int has_mtime;
+    int64_t mtime_days;
+    time_t now;
+} find_pred_t;
+
+typedef struct {
+    int inode;
+    char *path;
+} find_task_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    find_task_t *items;
+    int head, tail, cap;        /* roubo em head, dono em tail */
+} find_deque_t;
+
+typedef struct {
+    char **paths;
+    int count, cap;
+} find_out_t;
+
+typedef struct {
+    const find_pred_t *pred;
+    find_deque_t deques[FSCK_MAX_THREADS];
+    find_out_t out[FSCK_MAX_THREADS];
+    int threads;
+    int pending;                /* diretórios enfileirados ou em processamento */
+    int queued;                 /* ... só os enfileirados (sobe sob idle_lock) */
+    pthread_mutex_t idle_lock;  /* workers sem tarefa dormem em 'work' */
+    pthread_cond_t work;
+    int errors;
+} find_ctx_t;
+
+static int findCompare(int cmp, int64_t value, int64_t ref) {
+    if (cmp < 0) return value < ref;
+    if (cmp > 0) return value > ref;
+    return value == ref;
 }
 
-int cmd_unlink(int current_inode, const char *filepath, const char *user){
-    if (!filepath || !user) return -1;
+static int findMatch(const find_pred_t *pred, const fs_entry_t *e) {
+    if (pred->type != FILE_ANY && (int)e->type != pred->type) return 0;
+    if (pred->uid >= 0 && e->uid != pred->uid) return 0;
+    if (pred->has_size && !findCompare(pred->size_cmp, (int64_t)e->size, (int64_t)pred->size)) return 0;
+    if (pred->has_mtime) {
+        int64_t age = (pred->now - e->modification_date) / 86400;
+        if (!findCompare(pred->mtime_cmp, age, pred->mtime_days)) return 0;
+    }
+    return !pred->name || fnmatch(pred->name, e->name, 0) == 0;
+}
 
-    char parent_path[1024];
-    char name[MAX_NAMESIZE];
+static int findPush(find_deque_t *dq, int inode, char *path) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head == dq->tail) dq->head = dq->tail = 0;
+    if (dq->tail == dq->cap) {
+        int cap = dq->cap ? dq->cap * 2 : 64;
+        find_task_t *grown = realloc(dq->items, cap * sizeof(find_task_t));
+        if (!grown) {
+            pthread_mutex_unlock(&dq->lock);
+            return -1;
+        }
+        dq->items = grown;
+        dq->cap = cap;
+    }
+    dq->items[dq->tail].inode = inode;
+    dq->items[dq->tail].path = path;
+    dq->tail++;
+    pthread_mutex_unlock(&dq->lock);
+    return 0;
+}
 
-    // Encontra a última barra para separar caminho/nome
-    splitPath(filepath, parent_path, name);
-    
-    // resolve o inode do diretorio pai
-    int parent_inode;
-    if (resolvePath(parent_path, current_inode, &parent_inode) != 0) {
-        printf("Link não encontrado\n");
-        return -1;
+/* Tira uma tarefa da deque: pelo fim (dono) ou pelo início (roubo) */
+static int findTake(find_deque_t *dq, find_task_t *task, int steal) {
+    pthread_mutex_lock(&dq->lock);
+    int found = dq->head < dq->tail;
+    if (found) *task = steal ? dq->items[dq->head++] : dq->items[--dq->tail];
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static int findAddMatch(find_out_t *out, const char *path) {
+    if (out->count == out->cap) {
+        int cap = out->cap ? out->cap * 2 : 256;
+        char **grown = realloc(out->paths, cap * sizeof(char *));
+        if (!grown) return -1;
+        out->paths = grown;
+        out->cap = cap;
+    }
+    if (!(out->paths[out->count] = strdup(path))) return -1;
+    out->count++;
+    return 0;
+}
+
+/* Lê um diretório, testa os predicados em cada entrada e enfileira os
+ * subdiretórios na deque do próprio worker */
+static void findScanDir(find_ctx_t *ctx, int id, const find_task_t *task) {
+    fs_dir_list_t list;
+    if (dirList(task->inode, 0, 0, 0, &list) != 0) {
+        __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+        return;
     }
 
-    // Procura o arquivo com o nome dentro do diretório pai
-    int target_inode;
-    if (dirFindEntry(parent_inode, name, FILE_ANY, &target_inode) != 0) {
-        printf("Link não encontrado\n");
+    size_t base_len = strlen(task->path);
+    int slash = base_len > 0 && task->path[base_len - 1] != '/';
+    for (int i = 0; i < list.count; i++) {
+        fs_entry_t *e = &list.entries[i];
+        size_t len = base_len + slash + strlen(e->name) + 1;
+        char *path = malloc(len);
+        if (!path) {
+            __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        snprintf(path, len, "%s%s%s", task->path, slash ? "/" : "", e->name);
+
+        if (findMatch(ctx->pred, e) && findAddMatch(&ctx->out[id], path) != 0)
+            __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+
+        if (e->type == FILE_DIRECTORY) {
+            __atomic_fetch_add(&ctx->pending, 1, __ATOMIC_ACQ_REL);
+            if (findPush(&ctx->deques[id], e->inode_index, path) == 0) {
+                pthread_mutex_lock(&ctx->idle_lock);
+                __atomic_fetch_add(&ctx->queued, 1, __ATOMIC_ACQ_REL);
+                pthread_cond_signal(&ctx->work);
+                pthread_mutex_unlock(&ctx->idle_lock);
+                continue;
+            }
+            __atomic_fetch_sub(&ctx->pending, 1, __ATOMIC_ACQ_REL);
+            __atomic_fetch_add(&ctx->errors, 1, __ATOMIC_RELAXED);
+        }
+        free(path);
+    }
+    dirListFree(&list);
+}
+
+static void *findWorker(void *arg) {
+    parallel_worker_t *w = arg;
+    find_ctx_t *ctx = w->ctx;
+    find_task_t task;
+
+    // termina quando não há diretório enfileirado nem sendo lido por ninguém;
+    // sem tarefa, espera alguém enfileirar um diretório ou o fim
+    while (__atomic_load_n(&ctx->pending, __ATOMIC_ACQUIRE) > 0) {
+        int found = findTake(&ctx->deques[w->id], &task, 0);
+        for (int k = 1; !found && k < ctx->threads; k++)
+            found = findTake(&ctx->deques[(w->id + k) % ctx->threads], &task, 1);
+        if (!found) {
+            pthread_mutex_lock(&ctx->idle_lock);
+            while (__atomic_load_n(&ctx->pending, __ATOMIC_ACQUIRE) > 0 &&
+                   __atomic_load_n(&ctx->queued, __ATOMIC_ACQUIRE) <= 0)
+                pthread_cond_wait(&ctx->work, &ctx->idle_lock);
+            pthread_mutex_unlock(&ctx->idle_lock);
+            continue;
+        }
+        __atomic_fetch_sub(&ctx->queued, 1, __ATOMIC_ACQ_REL);
+        findScanDir(ctx, w->id, &task);
+        free(task.path);
+        if (__atomic_sub_fetch(&ctx->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+            pthread_mutex_lock(&ctx->idle_lock);
+            pthread_cond_broadcast(&ctx->work);
+            pthread_mutex_unlock(&ctx->idle_lock);
+        }
+    }
+    return NULL;
+}
+
+static int findPathCompare(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Interpreta "+N", "-N" ou "N"; com units, aceita os sufixos k, M e G */
+static int parseNumberArg(const char *arg, int units, int *cmp, int64_t *value) {
+    *cmp = 0;
+    if (*arg == '+' || *arg == '-') *cmp = *arg++ == '+' ? 1 : -1;
+    char *end;
+    errno = 0;
+    long long v = strtoll(arg, &end, 10);
+    if (errno || end == arg || v < 0) return -1;
+    if (units && *end) {
+        const char *suffixes = "kMG";
+        const char *s = strchr(suffixes, *end);
+        if (!s || end[1]) return -1;
+        v <<= 10 * (s - suffixes + 1);
+        end++;
+    }
+    if (*end) return -1;
+    *value = v;
+    return 0;
+}
+
+/* find [caminho] [-name glob] [-type f|d|l] [-size [+-]N[kMG]] [-user nome]
+ * [-mtime [+-]dias]: lista em ordem alfabética os caminhos da subárvore que
+ * satisfazem todos os predicados */
+static int do_find(int current_inode, int argc, char *argv[]) {
+    find_pred_t pred = { .type = FILE_ANY, .uid = -1, .now = time(NULL) };
+    const char *path = ".";
+    int i = 0;
+    if (argc > 0 && argv[0][0] != '-') path = argv[i++];
+
+    for (; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : NULL;
+        int64_t number;
+        if (!val) goto usage;
+        if (strcmp(opt, "-name") == 0) {
+            pred.name = val;
+        } else if (strcmp(opt, "-type") == 0) {
+            if (strcmp(val, "f") == 0) pred.type = FILE_REGULAR;
+            else if (strcmp(val, "d") == 0) pred.type = FILE_DIRECTORY;
+            else if (strcmp(val, "l") == 0) pred.type = FILE_SYMLINK;
+            else goto usage;
+        } else if (strcmp(opt, "-size") == 0) {
+            if (parseNumberArg(val, 1, &pred.size_cmp, &number) != 0) goto usage;
+            pred.size = (uint64_t)number;
+            pred.has_size = 1;
+        } else if (strcmp(opt, "-user") == 0) {
+            if ((pred.uid = userLookup(val)) < 0) {
+                printf("find: usuário '%s' não existe\n", val);
+                return -1;
+            }
+        } else if (strcmp(opt, "-mtime") == 0) {
+            if (parseNumberArg(val, 0, &pred.mtime_cmp, &number) != 0) goto usage;
+            pred.mtime_days = number;
+            pred.has_mtime = 1;
+        } else {
+            goto usage;
+        }
+        i++;
+    }
+
+    int root;
+    if (resolvePath(path, current_inode, &root) != 0) {
+        printf("find: caminho não encontrado: %s\n", path);
         return -1;
     }
 
-    inode_t *target = &inode_table[target_inode];
+    find_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.pred = &pred;
+    ctx.threads = parallelThreads();
+    for (int t = 0; t < ctx.threads; t++) pthread_mutex_init(&ctx.deques[t].lock, NULL);
+    pthread_mutex_init(&ctx.idle_lock, NULL);
+    pthread_cond_init(&ctx.work, NULL);
+
+    // a raiz também é candidata, com o nome que tem no diretório pai
+    dir_entry_t self = { .inode_index = root };
+    snprintf(self.name, MAX_NAMESIZE, "%s", root == ROOT_INODE ? "/" : inode_meta[root].name);
+    fs_entry_t root_entry;
+    dirFillEntry(&root_entry, &self);
+    if (findMatch(&pred, &root_entry)) findAddMatch(&ctx.out[0], path);
+    if (inode_table[root].type == FILE_DIRECTORY) {
+        char *root_path = strdup(path);
+        if (root_path && findPush(&ctx.deques[0], root, root_path) == 0) ctx.pending = ctx.queued = 1;
+        else { free(root_path); ctx.errors++; }
+    }
+    if (ctx.pending) parallelRun(ctx.threads, findWorker, &ctx);
+
+    int total = 0;
+    for (int t = 0; t < ctx.threads; t++) total += ctx.out[t].count;
+    char **all = malloc((total ? total : 1) * sizeof(char *));
+    int n = 0;
+    for (int t = 0; t < ctx.threads; t++) {
+        for (int k = 0; k < ctx.out[t].count; k++) {
+            if (all) all[n++] = ctx.out[t].paths[k];
+            else free(ctx.out[t].paths[k]);
+        }
+        free(ctx.out[t].paths);
+        free(ctx.deques[t].items);
+        pthread_mutex_destroy(&ctx.deques[t].lock);
+    }
+    pthread_mutex_destroy(&ctx.idle_lock);
+    pthread_cond_destroy(&ctx.work);
+    if (!all) return -1;
+
+    qsort(all, n, sizeof(char *), findPathCompare);
+    for (int k = 0; k < n; k++) {
+        printf("%s\n", all[k]);
+        free(all[k]);
+    }
+    free(all);
 
-    // Verifica se é um link simbolico
-    if (target->type != FILE_SYMLINK) {
-        printf("Alvo não é um link: %s\n", filepath);
+    if (ctx.errors) {
+        printf("find: %d diretório(s) não puderam ser lidos\n", ctx.errors);
         return -1;
+    }
+    return 0;
+
+usage:
+    printf("Uso: find [caminho] [-name glob] [-type f|d|l] [-size [+-]N[kMG]] "
+           "[-user nome] [-mtime [+-]dias]\n");
+    return -1;
+}
+
+/* ---- Desfragmentação ---- */
+/* Um arquivo (ou diretório) está fragmentado quando seus blocos, em ordem
+ * lógica, ocupam mais de uma faixa física. defragInode copia os blocos para
+ * uma faixa contígua nova, força os dados para o disco, troca o mapa de
+ * blocos de uma vez, grava os metadados e só então libera os blocos
+ * antigos: até a troca chegar ao disco, o mapa gravado continua apontando
+ * para os blocos antigos, intactos. Os buracos continuam buracos, e as
+ * reservas do fallocate além do fim mudam de lugar sem ser lidas. Blocos
+ * compartilhados (dedup ou snapshot) não se movem; o arquivo que os tem é
+ * pulado. A cópia é feita em pedaços de DEFRAG_CHUNK_BLOCKS. Com um limite
+ * de blocos, cada execução para depois do arquivo que o atinge e a próxima
+ * continua dali: o terminal fica preso só pelo tempo de uma fatia. */
+#define DEFRAG_CHUNK_BLOCKS 256   /* 128 KiB por leitura */
+
+typedef struct {
+    uint64_t limit;             /* blocos movidos por execução; 0 = sem limite */
+    int dry_run;                /* só analisa */
+    uint64_t start_ns;
+    uint32_t files, fragmented, defragmented;
+    uint32_t skipped_shared, skipped_space;
+    uint64_t blocks_moved;
+    uint64_t runs_before, runs_after;
+} defrag_ctx_t;
+
+/* Slots alocados do mapa de blocos em ordem lógica (até 'max'); conta as
+ * faixas físicas, se algum bloco é compartilhado e, em *live, quantos
+ * ficam antes de eof_blocks (os demais são reservas nunca escritas) */
+static uint32_t defragSlots(int inode_index, uint32_t eof_blocks, uint32_t **slots, uint32_t max,
+                            uint32_t *live, uint32_t *runs, int *shared) {
+    uint32_t n = 0, prev = 0;
+    *live = 0;
+    *runs = 0;
+    *shared = 0;
+    for (int hops = 0; hops < MAX_INODES; hops++) {
+        inode_t *node = &inode_table[inode_index];
+        for (int i = 0; i < BLOCKS_PER_INODE; i++) {
+            uint32_t b = node->blocks[i];
+            if (b == 0) continue;
+            if ((uint32_t)hops * BLOCKS_PER_INODE + i < eof_blocks) (*live)++;
+            if (n == 0 || b != prev + 1) (*runs)++;
+            if (block_refs && block_refs[b] > 1) *shared = 1;
+            if (slots && n < max) slots[n] = &node->blocks[i];
+            prev = b;
+            n++;
         }
+        if (node->next_inode == 0) break;
+        inode_index = node->next_inode;
+    }
+    return n;
+}
 
-    if (deleteSymlink(parent_inode, target_inode, user) != 0) {
-            printf("Não foi possível remover '%s'\n", filepath);
-            return -1;
+/* Onde a última execução com limite parou: a próxima, na mesma subárvore,
+ * retoma a partir deste inode (os nós são visitados em ordem de inode) */
+static int defrag_resume_root = -1;
+static int defrag_resume_inode = 0;
+
+static int cmpWalkInode(const void *a, const void *b) {
+    return ((const walk_node_t *)a)->inode - ((const walk_node_t *)b)->inode;
+}
+
+/* Reloca os blocos de um inode para uma faixa contígua, se estiverem
+ * espalhados. Retorna 0 (inclusive quando não há o que fazer) ou -1. */
+static int defragInode(int inode_index, defrag_ctx_t *ctx) {
+    inode_t *inode = &inode_table[inode_index];
+    if (!inodeHasBlocks(inode)) return 0;
+
+    // reservas do fallocate além do fim só existem em arquivos não comprimidos
+    uint32_t eof_blocks = UINT32_MAX;
+    if (inode->type == FILE_REGULAR && !(inode->flags & INODE_COMPRESSED))
+        eof_blocks = (inode->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    uint32_t live, runs;
+    int shared;
+    uint32_t count = defragSlots(inode_index, eof_blocks, NULL, 0, &live, &runs, &shared);
+    ctx->files++;
+    ctx->runs_before += runs;
+    if (runs <= 1 || ctx->dry_run) {
+        if (runs > 1) ctx->fragmented++;
+        ctx->runs_after += runs;
+        return 0;
+    }
+    ctx->fragmented++;
+    ctx->runs_after += runs;
+    if (shared) {
+        ctx->skipped_shared++;
+        return 0;
+    }
+
+    int first = allocateBlockRunNear(inodeBlockGoal(inode_index), count);
+    if (first < 0) {
+        ctx->skipped_space++;
+        return 0;
+    }
+
+    uint32_t **slots = malloc(count * sizeof(uint32_t *));
+    uint32_t *old = malloc(count * sizeof(uint32_t));
+    char *buffer = malloc((size_t)DEFRAG_CHUNK_BLOCKS * BLOCK_SIZE);
+    int res = slots && old && buffer ? 0 : -1;
+    if (res == 0) defragSlots(inode_index, eof_blocks, slots, count, &live, &runs, &shared);
+
+    // copia pedaço a pedaço, lendo de uma vez cada faixa antiga; as reservas
+    // além do fim nunca foram escritas, então só mudam de lugar no mapa
+    for (uint32_t i = 0; res == 0 && i < live; i += DEFRAG_CHUNK_BLOCKS) {
+        uint32_t n = live - i < DEFRAG_CHUNK_BLOCKS ? live - i : DEFRAG_CHUNK_BLOCKS;
+        for (uint32_t k = 0; res == 0 && k < n; ) {
+            uint32_t start = *slots[i + k], run = 1;
+            while (k + run < n && *slots[i + k + run] == start + run) run++;
+            res = readBlocks(start, run, buffer + (size_t)k * BLOCK_SIZE);
+            k += run;
         }
-    return 0;
+        if (res == 0) res = writeBlocks(first + i, n, buffer);
+        ctx->blocks_moved += n;
+    }
+    if (res == 0) diskSync();
+
+    if (res != 0) {
+        for (uint32_t k = 0; k < count; k++) freeBlock(first + k);
+    } else {
+        // troca o mapa inteiro e grava antes de liberar os blocos antigos
+        for (uint32_t k = 0; k < count; k++) {
+            old[k] = *slots[k];
+            *slots[k] = first + k;
+        }
+        res = flush_fs();
+        for (uint32_t k = 0; k < count; k++) freeBlock(old[k]);
+        ctx->blocks_moved += count - live;
+        ctx->defragmented++;
+        ctx->runs_after -= runs - 1;
+    }
+    free(slots);
+    free(old);
+    free(buffer);
+    return res;
 }
 
-int cmd_df(){
-    int free_blocks = 0;
+/* defrag [caminho] [-l blocos] [-n]: desfragmenta os arquivos e
+ * diretórios da subárvore; -l para depois de mover esse tanto de blocos
+ * (a próxima execução continua de onde parou); -n só mostra a fragmentação */
+static int do_defrag(int current_inode, int argc, char *argv[], int uid) {
+    defrag_ctx_t ctx = { .start_ns = stats_now() };
+    const char *path = ".";
+    for (int i = 0; i < argc; i++) {
+        int cmp;
+        int64_t limit;
+        if (strcmp(argv[i], "-n") == 0) ctx.dry_run = 1;
+        else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc &&
+                 parseNumberArg(argv[i + 1], 0, &cmp, &limit) == 0 && cmp == 0 && limit > 0) {
+            ctx.limit = limit;
+            i++;
+        }
+        else if (argv[i][0] != '-') path = argv[i];
+        else {
+            printf("Uso: defrag [caminho] [-l blocos] [-n]\n");
+            return -1;
+        }
+    }
+    if (uid != ROOT_UID && !ctx.dry_run) {
+        printf("Permissão negada\n");
+        return -1;
+    }
 
-    for (uint32_t i = 0; i < computed_data_blocks; i++){
-        uint32_t byte = i / 8;
-        uint8_t bit = i % 8;
+    int root;
+    if (resolvePath(path, current_inode, &root) != 0) {
+        printf("defrag: caminho não encontrado: %s\n", path);
+        return -1;
+    }
+    tree_walk_t walk;
+    if (treeWalk(&walk, root, path, uid, 0) != 0) {
+        free(walk.nodes);
+        printf("defrag: não foi possível percorrer %s\n", path);
+        return -1;
+    }
+
+    qsort(walk.nodes, walk.count, sizeof(walk_node_t), cmpWalkInode);
+    int resume = !ctx.dry_run && root == defrag_resume_root ? defrag_resume_inode : 0;
+    if (resume) printf("defrag: continuando do inode %d\n", resume);
 
-        if ((block_bitmap[byte] & (1 << bit)) == 0) {
-            free_blocks ++;
+    int errors = 0, stopped_at = 0;
+    for (int i = 0; i < walk.count; i++) {
+        if (walk.nodes[i].inode < resume) continue;
+        if (defragInode(walk.nodes[i].inode, &ctx) != 0) errors++;
+        if (ctx.limit && ctx.blocks_moved >= ctx.limit && !ctx.dry_run && i + 1 < walk.count) {
+            stopped_at = walk.nodes[i + 1].inode;
+            break;
         }
     }
+    free(walk.nodes);
+    if (!ctx.dry_run) {
+        defrag_resume_root = stopped_at ? root : -1;
+        defrag_resume_inode = stopped_at;
+    }
 
-    int used_blocks = computed_data_blocks - free_blocks;
-    int use_percentage = (used_blocks * 100 + computed_data_blocks -1) / computed_data_blocks;
+    printf("defrag: %u arquivos e diretórios, %u fragmentados; faixas: %llu -> %llu\n",
+           ctx.files, ctx.fragmented, (unsigned long long)ctx.runs_before, (unsigned long long)ctx.runs_after);
+    if (!ctx.dry_run) {
+        printf("  %u desfragmentados, %llu blocos movidos em %.1f ms", ctx.defragmented,
+               (unsigned long long)ctx.blocks_moved, (stats_now() - ctx.start_ns) / 1e6);
+        if (ctx.skipped_shared || ctx.skipped_space)
+            printf("; pulados: %u com blocos compartilhados, %u sem faixa livre",
+                   ctx.skipped_shared, ctx.skipped_space);
+        printf("\n");
+    }
+    if (stopped_at)
+        printf("defrag: limite atingido; execute de novo para continuar do inode %d\n", stopped_at);
+    if (errors) printf("defrag: %d falha(s) de E/S\n", errors);
+    return errors ? -1 : 0;
+}
 
-    printf("Filesystem     N-blocks     Used Available Use%% Mounted on\n");
-    printf("%-14s %-12d %-6d %-5d %3d%%   /~\n",
-           DISK_NAME, computed_data_blocks, used_blocks, free_blocks, use_percentage);
+/* ---- truncate, fallocate e write ---- */
+/* truncate <arquivo> <tamanho[kMG]>: crescer deixa um buraco no fim */
+static int do_truncate(int current_inode, const char *path, const char *size_arg, int uid) {
+    int inode_index, cmp;
+    int64_t size;
+    if (parseNumberArg(size_arg, 1, &cmp, &size) != 0 || cmp != 0) {
+        printf("Uso: truncate <arquivo> <tamanho[kMG]>\n");
+        return -1;
+    }
+    if (resolvePath(path, current_inode, &inode_index) != 0) {
+        printf("truncate: arquivo não encontrado: %s\n", path);
+        return -1;
+    }
+    if (truncateInode(inode_index, size, uid) != 0) {
+        printf("truncate: falha ao mudar o tamanho de %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* fallocate <arquivo> <tamanho[kMG]>: reserva blocos contíguos além do fim */
+static int do_fallocate(int current_inode, const char *path, const char *size_arg, int uid) {
+    int inode_index, cmp;
+    int64_t length;
+    if (parseNumberArg(size_arg, 1, &cmp, &length) != 0 || cmp != 0) {
+        printf("Uso: fallocate <arquivo> <tamanho[kMG]>\n");
+        return -1;
+    }
+    if (resolvePath(path, current_inode, &inode_index) != 0) {
+        printf("fallocate: arquivo não encontrado: %s\n", path);
+        return -1;
+    }
+    if (fallocateInode(inode_index, length, uid) != 0) {
+        printf("fallocate: não foi possível reservar %s para %s\n", size_arg, path);
+        return -1;
+    }
+    return 0;
+}
 
+/* write <arquivo> <offset[kMG]> <conteúdo>: grava na posição, como pwrite */
+static int do_write(int current_inode, const char *path, const char *offset_arg, const char *content, int uid) {
+    int inode_index, cmp;
+    int64_t offset;
+    if (parseNumberArg(offset_arg, 1, &cmp, &offset) != 0 || cmp != 0) {
+        printf("Uso: write <arquivo> <offset[kMG]> <conteúdo>\n");
+        return -1;
+    }
+    if (resolvePath(path, current_inode, &inode_index) != 0) {
+        printf("write: arquivo não encontrado: %s\n", path);
+        return -1;
+    }
+    if (writeContentAt(inode_index, offset, content, strlen(content), uid) != 0) {
+        printf("write: falha ao gravar em %s\n", path);
+        return -1;
+    }
     return 0;
-}
\ No newline at end of file
+}
+
+/* ---- Interpretador de comandos ---- */
+#define EXEC_MAX_ARGS 32
+
+/* Argumentos livres: junta os já separados com o resto da linha */
+static int execArgs(char *arg1, char *arg2, char *arg3, char *argv[EXEC_MAX_ARGS]) {
+    int argc = 0;
+    if (arg1) argv[argc++] = arg1;
+    if (arg2) argv[argc++] = arg2;
+    for (char *t = arg3 ? strtok(arg3, " ") : NULL; t && argc < EXEC_MAX_ARGS; t = strtok(NULL, " "))
+        argv[argc++] = t;
+    return argc;
+}
+
+/* Executa uma linha de comando do terminal; *uid é o usuário corrente.
+ * Retorna 0 em sucesso, -1 em falha e 1 quando o comando é 'exit'. */
+int cmd_exec(char *input, int *current_inode, int *uid) {
+    // Remove \n final
+    input[strcspn(input, "\n")] = 0;
+
+    // Sair
+    if (strcmp(input, "exit") == 0) return 1;
+
+    // Parse do comando
+    char *cmd = strtok(input, " ");
+    char *arg1 = strtok(NULL, " ");
+    char *arg2 = strtok(NULL, " ");
+    char *arg3 = strtok(NULL, "");
+    //char *arg4 = strtok(NULL, " ");
+
+    if (!cmd) return 0;
+
+    if (strcmp(cmd, "cd") == 0 && arg1) {
+        return cmd_cd(current_inode, arg1);
+    }
+    else if (strcmp(cmd, "mkdir") == 0 && arg1) {
+        return cmd_mkdir(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "touch") == 0 && arg1) {
+        return cmd_touch(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "rm") == 0 && arg1) {
+        if (strcmp(arg1, "-r") == 0) {
+            if (!arg2) {
+                printf("Uso: rm -r <caminho>\n");
+                return -1;
+            }
+            return cmd_rm_r(*current_inode, arg2, *uid);
+        }
+        return cmd_rm(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "clear") == 0) {
+        system("clear");
+        return 0;
+    }
+    else if (strcmp(cmd, "rmdir") == 0 && arg1) {
+        return cmd_rmdir(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "echo") == 0 && arg1) {
+        char *content = arg1;
+        char *redir = arg2; // > ou >>
+        char *filename = arg3;
+
+        if (redir && filename && content) {
+            if (strcmp(redir, ">") == 0) {
+                return cmd_echo_arrow(*current_inode, filename, content, *uid);
+            }
+            else if (strcmp(redir, ">>") == 0) {
+                return cmd_echo_arrow_arrow(*current_inode, filename, content, *uid);
+            }
+        }
+        printf("Falha: echo conteudo >|>> arquivo\n");
+        return -1;
+    }
+    else if (strcmp(cmd, "cat") == 0 && arg1) {
+        return cmd_cat(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "ls") == 0) {
+        if (arg1 && strcmp(arg1, "-l") == 0) {
+            return cmd_ls(*current_inode, arg2? arg2 : ".", *uid, 1);
+        }
+        return cmd_ls(*current_inode, arg1? arg1 : ".", *uid, 0);
+    }
+    else if (strcmp(cmd, "cp") == 0 && arg1 && arg2) {
+        if (strcmp(arg1, "-r") == 0) {
+            if (!arg3) {
+                printf("Uso: cp -r <origem> <destino>\n");
+                return -1;
+            }
+            return cmd_cp_r(*current_inode, arg2, arg3, *uid);
+        }
+        return cmd_cp(*current_inode, ".", arg1, ".", arg2, *uid);
+    }
+    else if (strcmp(cmd, "mv") == 0 && arg1 && arg2) {
+        return cmd_mv(*current_inode, ".", arg1, ".", arg2, *uid);
+    }
+    else if (strcmp(cmd, "ln") == 0 && arg1 && strcmp(arg1, "-s") == 0 && arg2 && arg3) {
+        return cmd_ln_s(*current_inode, arg2, arg3, *uid);
+    }
+    else if (strcmp(cmd, "su") == 0 && arg1){
+        int new_uid = userLookup(arg1);
+        if (new_uid < 0) {
+            printf("Usuário '%s' não existe\n", arg1);
+            return -1;
+        }
+        *uid = new_uid;
+        return 0;
+    }
+    else if (strcmp(cmd, "compress") == 0 && arg1){
+        return cmd_compress(*current_inode, arg1, arg2, *uid);
+    }
+    else if (strcmp(cmd, "dedup") == 0){
+        return cmd_dedup(arg1, *uid);
+    }
+    else if (strcmp(cmd, "discard") == 0){
+        return cmd_discard(arg1, *uid);
+    }
+    else if (strcmp(cmd, "trim") == 0){
+        return cmd_trim(*uid);
+    }
+    else if (strcmp(cmd, "snapshot") == 0){
+        return cmd_snapshot(arg1, arg2, arg3, *uid);
+    }
+    else if (strcmp(cmd, "useradd") == 0 && arg1){
+        return cmd_useradd(arg1, arg2, *uid);
+    }
+    else if (strcmp(cmd, "unlink") == 0 && arg1){
+        return cmd_unlink(*current_inode, arg1, *uid);
+    }
+    else if (strcmp(cmd, "df") == 0){
+        return cmd_df(arg1 && strcmp(arg1, "-g") == 0);
+    }
+    else if (strcmp(cmd, "find") == 0){
+        char *argv[EXEC_MAX_ARGS];
+        int argc = execArgs(arg1, arg2, arg3, argv);
+        return cmd_find(*current_inode, argc, argv);
+    }
+    else if (strcmp(cmd, "defrag") == 0){
+        char *argv[EXEC_MAX_ARGS];
+        int argc = execArgs(arg1, arg2, arg3, argv);
+        return cmd_defrag(*current_inode, argc, argv, *uid);
+    }
+    else if (strcmp(cmd, "truncate") == 0 && arg1 && arg2){
+        return cmd_truncate(*current_inode, arg1, arg2, *uid);
+    }
+    else if (strcmp(cmd, "fallocate") == 0 && arg1 && arg2){
+        return cmd_fallocate(*current_inode, arg1, arg2, *uid);
+    }
+    else if (strcmp(cmd, "write") == 0 && arg1 && arg2 && arg3){
+        return cmd_write(*current_inode, arg1, arg2, arg3, *uid);
+    }
+    else if (strcmp(cmd, "du") == 0){
+        return cmd_du(*current_inode, arg1 ? arg1 : ".");
+    }
+    else if (strcmp(cmd, "import") == 0 && arg1){
+        return cmd_import(*current_inode, arg1, arg2 ? arg2 : ".", *uid);
+    }
+    else if (strcmp(cmd, "export") == 0 && arg1 && arg2){
+        return cmd_export(*current_inode, arg1, arg2, *uid);
+    }
+    else if (strcmp(cmd, "fsck") == 0){
+        return cmd_fsck(arg1 && strcmp(arg1, "-r") == 0);
+    }
+    else if (strcmp(cmd, "stats") == 0){
+        return cmd_stats(arg1 && strcmp(arg1, "-r") == 0);
+    }
+    else if (strcmp(cmd, "trace") == 0 && arg1){
+        return cmd_trace(arg1, arg2);
+    }
+
+    printf("Comando não reconhecido\n");
+    return -1;
+}
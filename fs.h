@@ -13,27 +13,58 @@
 #define DISK_NAME "disk.dat"
 #define FS_MAGIC 0xF5F5F5F5
 #define DISK_SIZE_MB 64
-#define MAX_INODES 128
+#define MAX_INODES 16384
 #define BLOCK_SIZE 512
+#define META_PAGE_SIZE 4096   /* alinhamento da tabela de inodes no disco */
 #define BLOCKS_PER_INODE 12
+#define INODE_INLINE_MAX (BLOCKS_PER_INODE * 4)  /* bytes de dados guardados no próprio inode */
+#define COMPRESS_CHUNK_BLOCKS 8   /* blocos lógicos por chunk comprimido */
 #define MAX_BLOCKS ((DISK_SIZE_MB * 1024 * 1024) / BLOCK_SIZE)
+#define BLOCKS_PER_GROUP 8192   /* blocos por grupo (4 MiB); os inodes são divididos em tantos grupos quanto */
+#define MAX_BLOCK_GROUPS ((MAX_BLOCKS + BLOCKS_PER_GROUP - 1) / BLOCKS_PER_GROUP)
 #define MAX_NAMESIZE 32
 
 #define ROOT_INODE 0
+#define ROOT_UID 0
+#define ROOT_GID 0
+#define MAX_USERS 256
+#define MAX_GROUPS 256
 
 typedef struct {
     uint32_t magic; // identificador do FS
     uint32_t block_bitmap_bytes;
     uint32_t inode_bitmap_bytes;
     uint32_t inode_table_bytes;
+    uint32_t inode_meta_bytes;
+    uint32_t user_table_bytes;
+    uint32_t dedup_bytes;
+    uint32_t crc_bytes;
+    uint32_t usage_bytes;
+    uint32_t snapshot_bytes;
     uint32_t meta_blocks;
     uint32_t data_blocks;
     uint32_t off_block_bitmap;
     uint32_t off_inode_bitmap;
     uint32_t off_inode_table;
+    uint32_t off_user_table;
+    uint32_t off_inode_meta;
+    uint32_t off_dedup;
+    uint32_t off_crc;
+    uint32_t off_usage;
+    uint32_t off_snapshots;
     uint32_t off_data_region;
+    uint32_t state;           // FS_STATE_CLEAN após unmount_fs
+    uint32_t features;        // FS_FEAT_*
 } fs_header_t;
 
+#define FS_STATE_DIRTY 0
+#define FS_STATE_CLEAN 0x434C4E21
+
+/* fs_header_t.features */
+#define FS_FEAT_COMPRESS 0x01     /* arquivos novos nascem comprimidos */
+#define FS_FEAT_DEDUP    0x02     /* blocos de dados idênticos são compartilhados */
+#define FS_FEAT_DISCARD  0x04     /* blocos liberados viram buracos no disk.dat */
+
 typedef enum {
     FILE_REGULAR,
     FILE_DIRECTORY,
@@ -52,114 +83,413 @@ typedef enum {
     PERM_ALL   = (PERM_RWX << 6) | (PERM_RWX << 3) | PERM_RWX
 } permission_t;
 
+/* inode_t.flags */
+#define INODE_INLINE 0x01           /* conteúdo em inline_data, sem blocos */
+#define INODE_COMPRESSED 0x02       /* blocos em chunks comprimidos (LZ) */
+
+/* Campos quentes do inode: tudo o que buscas, leituras, cadeias e checagens
+ * de permissão consultam, em 64 bytes (uma linha de cache). Nomes e datas
+ * ficam em inode_meta_t. */
 typedef struct {
-    inode_type_t type;
-    char name[MAX_NAMESIZE];
-    char creator[MAX_NAMESIZE];
-    char owner[MAX_NAMESIZE];
+    uint8_t type;                   /* inode_type_t */
+    uint8_t flags;
+    uint16_t permissions;           /* permission_t */
+    uint16_t uid;                   /* dono */
+    uint16_t gid;                   /* grupo */
     uint32_t size;
-    time_t creation_date;       
-    time_t modification_date;   
-    permission_t permissions;
-    uint32_t blocks[BLOCKS_PER_INODE];
+    union {
+        uint32_t blocks[BLOCKS_PER_INODE];
+        uint32_t link_target_index; /* FILE_SYMLINK não usa blocos */
+        char inline_data[INODE_INLINE_MAX];
+    };
     uint32_t next_inode;
-    uint32_t link_target_index;     
 } inode_t;
 
+_Static_assert(sizeof(inode_t) == 64, "inode_t deve ocupar uma linha de cache");
+
+/* blocks[] contém números de bloco (falso para symlinks e arquivos inline) */
+static inline int inodeHasBlocks(const inode_t *inode) {
+    return inode->type != FILE_SYMLINK && !(inode->flags & INODE_INLINE);
+}
+
+/* Campos frios, em tabela paralela (mesmo índice do inode): só usados
+ * por ls -l, export, criação e checagem de dono */
+typedef struct {
+    char name[MAX_NAMESIZE];
+    uint32_t creator;               /* uid de quem criou */
+    int64_t creation_date;
+    int64_t modification_date;
+} inode_meta_t;
+
+/* Tabela persistente de usuários e grupos; o índice é o uid/gid e
+ * entradas com nome vazio estão livres */
+typedef struct {
+    char name[MAX_NAMESIZE];
+    uint32_t gid;                   /* grupo primário */
+} fs_user_t;
+
+typedef struct {
+    char name[MAX_NAMESIZE];
+} fs_group_t;
+
+typedef struct {
+    fs_user_t users[MAX_USERS];
+    fs_group_t groups[MAX_GROUPS];
+} fs_user_table_t;
+
+/* Snapshots: catálogo persistente. A imagem de cada snapshot (bitmap de
+ * inodes e os inodes alocados, com nome, datas e uso) fica em blocos
+ * contíguos da região de dados; os blocos dos arquivos são compartilhados
+ * com o sistema vivo pelas contagens de block_refs. */
+#define MAX_SNAPSHOTS 16
+
+typedef struct {
+    char name[MAX_NAMESIZE];        /* vazio = entrada livre */
+    int64_t creation_date;
+    uint32_t first_block;           /* início da imagem */
+    uint32_t image_blocks;
+    uint32_t inodes;                /* inodes alocados na imagem */
+    uint32_t reserved;
+} fs_snapshot_t;
+
+typedef struct {
+    fs_snapshot_t snapshots[MAX_SNAPSHOTS];
+} fs_snapshot_table_t;
+
+/* Deduplicação: block_refs[b] é 0 para bloco fora do esquema de
+ * compartilhamento (um único dono, nunca indexado), 1 para bloco
+ * deduplicado com um só dono e N > 1 para bloco compartilhado por N
+ * referências; freeBlock só libera quando cai abaixo de 2. O índice mapeia
+ * hash do conteúdo -> bloco, com sondagem linear. Entradas podem ficar obsoletas (bloco liberado ou
+ * reescrito); o conteúdo é sempre comparado antes de compartilhar. */
+#define DEDUP_SLOTS (1u << 17)    /* potência de 2 >= MAX_BLOCKS */
+#define DEDUP_PROBES 16
+#define DEDUP_MAX_REFS 0xFFFE
+
+typedef struct {
+    uint32_t hash;
+    uint32_t block;               /* 0 = vazia */
+} dedup_entry_t;
+
 typedef struct {
     char name[MAX_NAMESIZE];
     uint32_t inode_index;
 } dir_entry_t;
 
+/* Uso de espaço por inode, para o du: em arquivos, o próprio conteúdo; em
+ * diretórios, a soma da subárvore (inclusive os blocos de diretório).
+ * Mantido incrementalmente: toda mudança sobe pela cadeia de pais. */
 typedef struct {
-    char name[MAX_NAMESIZE];
+    uint64_t bytes;                 /* tamanho lógico dos arquivos */
+    uint32_t blocks;                /* blocos de dados referenciados */
+    uint32_t parent;                /* diretório que contém a entrada */
+} inode_usage_t;
+
+/* Entrada de listagem com os dados do inode já preenchidos (readdir-plus) */
+typedef struct {
+    char name[MAX_NAMESIZE];        /* nome no diretório listado */
     inode_type_t type;
-    char creator[MAX_NAMESIZE];
-    char owner[MAX_NAMESIZE];
-    uint32_t size;
-    time_t creation_date;       
-    time_t modification_date;   
-    uint16_t permissions;
     uint32_t inode_index;
+    uint16_t uid;
+    uint16_t gid;
+    uint16_t permissions;
+    uint8_t flags;                  /* INODE_* */
+    uint32_t creator;
+    uint64_t size;
+    int64_t creation_date;
+    int64_t modification_date;
+    uint32_t link_target_index;     /* só em FILE_SYMLINK */
 } fs_entry_t;
 
 typedef struct {
     fs_entry_t *entries;
     int count;
+    uint32_t next_cursor;           /* cursor da próxima página; 0 = fim */
 } fs_dir_list_t;
 
+/* dirList flags */
+#define DIR_LIST_SORTED 0x01        /* ordena por nome */
+
+/* Comandos instrumentados (índices dos histogramas de latência) */
+typedef enum {
+    STAT_CMD_NONE,
+    STAT_CMD_CD,
+    STAT_CMD_MKDIR,
+    STAT_CMD_TOUCH,
+    STAT_CMD_ECHO,
+    STAT_CMD_ECHO_APPEND,
+    STAT_CMD_CAT,
+    STAT_CMD_CP,
+    STAT_CMD_MV,
+    STAT_CMD_LN_S,
+    STAT_CMD_LS,
+    STAT_CMD_RM,
+    STAT_CMD_RMDIR,
+    STAT_CMD_UNLINK,
+    STAT_CMD_DF,
+    STAT_CMD_IMPORT,
+    STAT_CMD_EXPORT,
+    STAT_CMD_FSCK,
+    STAT_CMD_USERADD,
+    STAT_CMD_COMPRESS,
+    STAT_CMD_DEDUP,
+    STAT_CMD_DISCARD,
+    STAT_CMD_TRIM,
+    STAT_CMD_SNAPSHOT,
+    STAT_CMD_DU,
+    STAT_CMD_FIND,
+    STAT_CMD_DEFRAG,
+    STAT_CMD_TRUNCATE,
+    STAT_CMD_FALLOCATE,
+    STAT_CMD_WRITE,
+    STAT_CMD_COUNT
+} fs_cmd_id_t;
+
+#define STAT_LAT_BUCKETS 32   /* bucket 0: < 1us; bucket i: [2^(i-1), 2^i) us */
+
+typedef struct {
+    uint64_t block_reads;          /* blocos de dados lidos */
+    uint64_t block_writes;         /* blocos de dados escritos */
+    uint64_t bytes_read;           /* bytes lidos do disco (dados + metadados) */
+    uint64_t bytes_written;        /* bytes escritos no disco (dados + metadados) */
+    uint64_t fsyncs;
+    uint64_t sync_fs_calls;        /* chamadas a sync_fs (inclusive adiadas) */
+    uint64_t metadata_flushes;     /* gravações efetivas dos metadados */
+    uint64_t sync_inode_calls;
+    uint64_t block_allocs;
+    uint64_t block_frees;
+    uint64_t blocks_discarded;     /* blocos devolvidos ao host (PUNCH_HOLE) */
+    uint64_t alloc_bits_scanned;   /* bits do bitmap de blocos varridos */
+    uint64_t inode_allocs;
+    uint64_t inode_bits_scanned;
+    uint64_t dir_lookups;          /* chamadas a dirFindEntry */
+    uint64_t dir_entries_scanned;  /* entradas comparadas por dirFindEntry */
+    uint64_t chunks_compressed;    /* chunks gravados comprimidos */
+    uint64_t chunks_decompressed;
+    uint64_t dedup_lookups;        /* blocos novos procurados no índice */
+    uint64_t dedup_hits;           /* ... e compartilhados em vez de gravados */
+    uint64_t dedup_cow;            /* cópias de blocos compartilhados */
+    uint64_t checksums_verified;   /* blocos conferidos na leitura */
+    uint64_t checksum_errors;
+    uint64_t cmd_calls[STAT_CMD_COUNT];
+    uint64_t cmd_errors[STAT_CMD_COUNT];
+    uint64_t cmd_total_ns[STAT_CMD_COUNT];
+    uint64_t cmd_latency[STAT_CMD_COUNT][STAT_LAT_BUCKETS];
+} fs_stats_t;
+
+/* Trace de E/S: registros binários de tamanho fixo */
+#define TRACE_MAGIC 0x52545346   /* "FSTR" */
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_RECORDS 65536
+
+typedef enum {
+    TRACE_READ,            /* readBlock(s): target = primeiro bloco */
+    TRACE_WRITE,           /* writeBlock(s): target = primeiro bloco */
+    TRACE_SYNC_FS,         /* gravação efetiva dos metadados */
+    TRACE_SYNC_INODE,      /* target = inode */
+    TRACE_LOGICAL_WRITE,   /* bytes pedidos pelo usuário; target = inode */
+    TRACE_OP_COUNT
+} trace_op_t;
+
+typedef struct {
+    uint64_t timestamp_ns;   /* desde trace_start */
+    uint32_t target;         /* bloco ou inode, conforme op */
+    uint32_t size;           /* bytes */
+    uint32_t latency_ns;
+    uint8_t op;              /* trace_op_t */
+    uint8_t cmd;             /* fs_cmd_id_t do comando de origem */
+    uint16_t reserved;
+} trace_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t block_size;
+    uint32_t reserved;
+    uint64_t count;          /* registros no arquivo */
+    uint64_t dropped;        /* registros sobrescritos no ring buffer */
+} trace_file_header_t;
+
 /* Funções principais */
 int init_fs(void);
 int mount_fs(void);
 int sync_fs(void);
+int flush_fs(void);
+int set_deferred_sync(int enabled);
 void sync_inode(int inode_num);
 int unmount_fs(void);
 
+/* Estatísticas */
+void reset_stats(void);
+int cmd_stats(int reset);
+
+/* Trace */
+int trace_start(uint32_t capacity);
+void trace_stop(void);
+int trace_dump(const char *path);
+int cmd_trace(const char *action, const char *arg);
+
 /* Utilitarios */
 const char *format_time(time_t t, char *buf, size_t buflen);
 int show_inode_info(int inode_index);
 
+/* Checksums */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+const char *crc32c_backend(void);
+
 /* Alocação */
 int allocateBlock(void);
+int allocateBlockRun(uint32_t count);
+int allocateBlockNear(uint32_t goal);
+int allocateBlockRunNear(uint32_t goal, uint32_t count);
+uint32_t allocateBlockRunAt(uint32_t start, uint32_t count);
 void freeBlock(int block_index);
 int allocateInode(void);
+int allocateInodeNear(int parent_inode, int is_directory);
 void freeInode(int inode_index);
 
+/* Grupos de blocos */
+void groupsRecount(void);
+uint32_t blockGroupCount(void);
+int blockGroupInfo(uint32_t g, uint32_t *free_blocks, uint32_t *free_inodes);
+
 /* Leitura e escrita nos blocos */
 int readBlock(uint32_t block_index, void *buffer);
 int writeBlock(uint32_t block_index, const void *buffer);
+int readBlocks(uint32_t first_block, uint32_t count, void *buffer);
+int writeBlocks(uint32_t first_block, uint32_t count, const void *buffer);
 
 /* Diretórios */
 int dirFindEntry(int dir_inode, const char *name, inode_type_t type, int *out_inode);
 int dirAddEntry(int dir_inode, const char *name, inode_type_t type, int inode_index);
 int dirRemoveEntry(int dir_inode, const char *name, inode_type_t type);
+int dirList(int dir_inode, uint32_t cursor, int limit, int flags, fs_dir_list_t *out);
+void dirListFree(fs_dir_list_t *list);
 
 /* Permissões */
-int hasPermission(const inode_t *inode, const char *username, permission_t perm);
+int hasPermission(const inode_t *inode, int uid, permission_t perm);
+
+/* Usuários e grupos */
+int userLookup(const char *name);
+int groupLookup(const char *name);
+int userAdd(const char *name, const char *group);
+int userGid(int uid);
+const char *userName(int uid);
+const char *groupName(int gid);
+int cmd_useradd(const char *name, const char *group, int uid);
 
 /* Manipulação de conteúdos */
-int createDirectory(int parent_inode, const char *name, const char *user);
-int deleteDirectory(int parent_inode, const char *name, const char *user);
-int createFile(int parent_inode, const char *name, const char *user);
-int deleteFile(int parent_inode, const char *name, const char *user);
-int addContentToInode(int inode_number, const char *data, size_t data_size, const char *user);
-int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, const char *user);
+int createDirectory(int parent_inode, const char *name, int uid);
+int deleteDirectory(int parent_inode, const char *name, int uid);
+int createFile(int parent_inode, const char *name, int uid);
+int deleteFile(int parent_inode, const char *name, int uid);
+int addContentToInode(int inode_number, const char *data, size_t data_size, int uid);
+int readContentFromInode(int inode_number, char *buffer, size_t buffer_size, size_t *out_bytes, int uid);
+int readContentAt(int inode_number, size_t offset, char *buffer, size_t len, size_t *out_bytes, int uid);
+int writeContentAt(int inode_number, size_t offset, const char *data, size_t len, int uid);
+int truncateInode(int inode_number, size_t size, int uid);
+int fallocateInode(int inode_number, size_t length, int uid);
+int preallocateInode(int inode_index, size_t size);
+int setFileCompression(int inode_index, int enable, int uid);
+int setVolumeFeature(uint32_t feature, int enable);
+int cmd_compress(int current_inode, const char *arg1, const char *arg2, int uid);
+int cmd_dedup(const char *arg, int uid);
+int cmd_discard(const char *arg, int uid);
+int cmd_trim(int uid);
+
+/* Snapshots */
+int snapshotLookup(const char *name);
+int snapshotCreate(const char *name);
+int snapshotDelete(const char *name);
+int snapshotEnter(int index);
+void snapshotLeave(void);
+int cmd_snapshot(const char *action, const char *name, char *command, int uid);
 
 int resolvePath(const char *path, int current_inode, int *inode_out);
-int createDirectoriesRecursively(const char *path, int current_inode, const char *user);
+int createDirectoriesRecursively(const char *path, int current_inode, int uid);
 static void splitPath(const char *full_path, char *dir_path, char *base_name);
 
-int createSymlink(int parent_inode, int target_index, const char *link_name, const char *user);
+int createSymlink(int parent_inode, int target_index, const char *link_name, int uid);
 
 // core utils
 int cmd_cd(int *current_inode, const char *path);
-int cmd_cat(int current_inode, const char *path, const char *user);
-int cmd_mkdir(int current_inode, const char *fullpath, const char *user);
-int cmd_touch(int current_inode, const char *fullpath, const char *user);
-int cmd_echo_arrow(int current_inode, const char *fullpath, const char *content, const char *user);
-int cmd_echo_arrow_arrow(int current_inode, const char *fullpath, const char *content, const char *user);
+int cmd_cat(int current_inode, const char *path, int uid);
+int cmd_mkdir(int current_inode, const char *fullpath, int uid);
+int cmd_touch(int current_inode, const char *fullpath, int uid);
+int cmd_echo_arrow(int current_inode, const char *fullpath, const char *content, int uid);
+int cmd_echo_arrow_arrow(int current_inode, const char *fullpath, const char *content, int uid);
 
 int cmd_cp(int current_inode, const char *src_path, const char *src_name,
-           const char *dst_path, const char *dst_name, const char *user);
+           const char *dst_path, const char *dst_name, int uid);
+int cmd_cp_r(int current_inode, const char *src_path, const char *dst_path, int uid);
 int cmd_mv(int current_inode, const char *src_path, const char *src_name,
-           const char *dst_path, const char *dst_name, const char *user);
-int cmd_ln_s(int current_inode, const char *target_path, const char *link_path, const char *user);
-int cmd_ls(int current_inode, const char *path, const char *user, int info_args);
-int cmd_rm(int current_inode, const char *filepath, const char *user);
-int cmd_rmdir(int current_inode, const char *filepath, const char *user);
-int cmd_unlink(int current_inode, const char *filepath, const char *user);
-int cmd_df(void);
+           const char *dst_path, const char *dst_name, int uid);
+int cmd_ln_s(int current_inode, const char *target_path, const char *link_path, int uid);
+int cmd_ls(int current_inode, const char *path, int uid, int info_args);
+int cmd_rm(int current_inode, const char *filepath, int uid);
+int cmd_rm_r(int current_inode, const char *filepath, int uid);
+int cmd_rmdir(int current_inode, const char *filepath, int uid);
+int cmd_unlink(int current_inode, const char *filepath, int uid);
+int cmd_df(int groups);
+int cmd_du(int current_inode, const char *path);
+int cmd_find(int current_inode, int argc, char *argv[]);
+int cmd_defrag(int current_inode, int argc, char *argv[], int uid);
+int cmd_truncate(int current_inode, const char *path, const char *size_arg, int uid);
+int cmd_fallocate(int current_inode, const char *path, const char *size_arg, int uid);
+int cmd_write(int current_inode, const char *path, const char *offset_arg, const char *content, int uid);
+int cmd_import(int current_inode, const char *host_path, const char *dest_path, int uid);
+int cmd_export(int current_inode, const char *path, const char *host_dest, int uid);
+int cmd_exec(char *line, int *current_inode, int *uid);
+
+/* Verificação de consistência */
+#define FSCK_MAX_THREADS 16
+
+typedef struct {
+    uint32_t inodes_checked;
+    uint32_t directories;
+    uint32_t bad_entries;      /* entradas apontando para inode inválido */
+    uint32_t bad_pointers;     /* blocos/next_inode fora da faixa ou duplicados */
+    uint32_t orphan_inodes;    /* alocados, mas inalcançáveis a partir da raiz */
+    uint32_t leaked_blocks;    /* marcados no bitmap, mas sem dono */
+    uint32_t unmarked_blocks;  /* em uso, mas livres no bitmap */
+    uint32_t bad_refcounts;    /* contagem de dedup diferente das referências */
+    uint32_t bad_usage;        /* uso de subárvore (du) diferente do recalculado */
+    uint32_t bad_snapshots;    /* imagem de snapshot ilegível ou inválida */
+    int threads;
+    uint64_t elapsed_ns;
+} fsck_report_t;
+
+int fsck_fs(int repair, int threads, fsck_report_t *report);
+int cmd_fsck(int repair);
 
 /* Variáveis globais */
 extern unsigned char *block_bitmap;
 extern unsigned char *inode_bitmap;
 extern inode_t *inode_table;
+extern inode_meta_t *inode_meta;
+extern fs_user_table_t *user_table;
+extern uint16_t *block_refs;
+extern dedup_entry_t *dedup_index;
+extern uint32_t *block_crc;
+extern inode_usage_t *inode_usage;
+extern fs_snapshot_table_t *snapshot_table;
+extern int fs_verify_checksums;
 extern FILE *disk;
+extern int fs_verbose;
+extern fs_stats_t fs_stats;
+extern const char *const fs_cmd_names[STAT_CMD_COUNT];
 
 /* Variáveis computadas (para testes) */
 extern size_t computed_block_bitmap_bytes;
 extern size_t computed_inode_bitmap_bytes;
 extern size_t computed_inode_table_bytes;
+extern size_t computed_inode_meta_bytes;
+extern size_t computed_user_table_bytes;
+extern size_t computed_dedup_bytes;
+extern size_t computed_crc_bytes;
+extern size_t computed_usage_bytes;
+extern size_t computed_snapshot_bytes;
 extern uint32_t computed_meta_blocks;
 extern uint32_t computed_data_blocks;
 
@@ -0,0 +1,176 @@
+// tracedump.c
+// Decodifica um arquivo gerado por 'trace dump' e resume blocos mais
+// acessados, distância de seek e amplificação de escrita por comando.
+//
+//   gcc -O2 tracedump.c fs.c -o tracedump
+//   ./tracedump trace.bin [-n top] [-v]
+#include "fs.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+/* Faixas do histograma de distância de seek (em blocos) */
+static const uint32_t seek_limits[] = {0, 1, 8, 64, 512, 4096, UINT32_MAX};
+#define SEEK_BUCKETS (sizeof(seek_limits) / sizeof(seek_limits[0]))
+
+static const char *op_names[TRACE_OP_COUNT] = {
+    "read", "write", "sync_fs", "sync_inode", "logical"
+};
+
+typedef struct {
+    uint64_t ops[TRACE_OP_COUNT];
+    uint64_t bytes[TRACE_OP_COUNT];
+    uint64_t latency_ns[TRACE_OP_COUNT];
+    uint64_t seeks, seek_total;
+} cmd_summary_t;
+
+typedef struct {
+    uint32_t block;
+    uint32_t reads, writes;
+} block_heat_t;
+
+static int cmp_heat(const void *a, const void *b) {
+    const block_heat_t *x = a, *y = b;
+    uint32_t tx = x->reads + x->writes, ty = y->reads + y->writes;
+    if (tx != ty) return tx < ty ? 1 : -1;
+    return x->block < y->block ? -1 : (x->block > y->block);
+}
+
+static const char *cmd_name(uint8_t cmd) {
+    return cmd < STAT_CMD_COUNT ? fs_cmd_names[cmd] : "?";
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int top = 10, verbose = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) top = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-v") == 0) verbose = 1;
+        else if (!path) path = argv[i];
+        else path = NULL;
+    }
+    if (!path) {
+        fprintf(stderr, "Uso: %s trace.bin [-n top] [-v]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) { perror(path); return 2; }
+
+    trace_file_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t)) {
+        fprintf(stderr, "%s: não é um trace válido\n", path);
+        fclose(f);
+        return 2;
+    }
+
+    trace_record_t *records = malloc(header.count ? header.count * sizeof(trace_record_t) : 1);
+    if (!records || fread(records, sizeof(trace_record_t), header.count, f) != header.count) {
+        fprintf(stderr, "%s: trace truncado\n", path);
+        fclose(f);
+        return 2;
+    }
+    fclose(f);
+
+    cmd_summary_t per_cmd[STAT_CMD_COUNT + 1];
+    memset(per_cmd, 0, sizeof(per_cmd));
+    uint64_t seek_hist[SEEK_BUCKETS] = {0};
+    uint32_t max_block = 0;
+
+    // seek: distância entre o fim do acesso anterior e o início do atual
+    int have_prev = 0;
+    uint64_t next_expected = 0;
+    for (uint64_t i = 0; i < header.count; i++) {
+        trace_record_t *r = &records[i];
+        if (r->op >= TRACE_OP_COUNT) continue;
+        uint8_t cmd = r->cmd < STAT_CMD_COUNT ? r->cmd : STAT_CMD_COUNT;
+        cmd_summary_t *c = &per_cmd[cmd];
+        c->ops[r->op]++;
+        c->bytes[r->op] += r->size;
+        c->latency_ns[r->op] += r->latency_ns;
+
+        if (verbose) {
+            printf("%12.3f ms  %-10s %-8s %8u %8u B %8u ns\n", r->timestamp_ns / 1e6,
+                   op_names[r->op], cmd_name(r->cmd), r->target, r->size, r->latency_ns);
+        }
+
+        if (r->op != TRACE_READ && r->op != TRACE_WRITE) continue;
+        uint32_t nblocks = (r->size + header.block_size - 1) / header.block_size;
+        if (r->target + nblocks > max_block) max_block = r->target + nblocks;
+
+        if (have_prev) {
+            uint64_t dist = r->target > next_expected ? r->target - next_expected : next_expected - r->target;
+            size_t b = 0;
+            while (b < SEEK_BUCKETS - 1 && dist > seek_limits[b]) b++;
+            seek_hist[b]++;
+            c->seeks++;
+            c->seek_total += dist;
+        }
+        have_prev = 1;
+        next_expected = (uint64_t)r->target + nblocks;
+    }
+
+    printf("Trace %s: %llu registros", path, (unsigned long long)header.count);
+    if (header.dropped) printf(" (%llu mais antigos descartados)", (unsigned long long)header.dropped);
+    printf("\n\n");
+
+    // amplificação = bytes físicos escritos (dados + metadados) / bytes pedidos
+    printf("Por comando\n");
+    printf("  %-10s %9s %12s %9s %12s %8s %12s %8s %10s\n", "comando", "leituras", "bytes lidos",
+           "escritas", "bytes escr.", "syncs", "lógico", "amplif.", "seek médio");
+    for (int cmd = 0; cmd <= STAT_CMD_COUNT; cmd++) {
+        cmd_summary_t *c = &per_cmd[cmd];
+        uint64_t total = 0;
+        for (int op = 0; op < TRACE_OP_COUNT; op++) total += c->ops[op];
+        if (total == 0) continue;
+
+        uint64_t physical = c->bytes[TRACE_WRITE] + c->bytes[TRACE_SYNC_FS] + c->bytes[TRACE_SYNC_INODE];
+        uint64_t logical = c->bytes[TRACE_LOGICAL_WRITE];
+        char amp[16] = "-";
+        if (logical) snprintf(amp, sizeof(amp), "%.1fx", (double)physical / logical);
+
+        printf("  %-10s %9llu %12llu %9llu %12llu %8llu %12llu %8s %10.1f\n",
+               cmd == STAT_CMD_COUNT ? "?" : cmd_name(cmd),
+               (unsigned long long)c->ops[TRACE_READ], (unsigned long long)c->bytes[TRACE_READ],
+               (unsigned long long)c->ops[TRACE_WRITE], (unsigned long long)c->bytes[TRACE_WRITE],
+               (unsigned long long)(c->ops[TRACE_SYNC_FS] + c->ops[TRACE_SYNC_INODE]),
+               (unsigned long long)logical, amp,
+               c->seeks ? (double)c->seek_total / c->seeks : 0.0);
+    }
+
+    printf("\nDistância de seek (blocos)\n");
+    for (size_t b = 0; b < SEEK_BUCKETS; b++) {
+        if (b == 0) printf("  %-16s", "sequencial");
+        else if (seek_limits[b] == UINT32_MAX) printf("  > %-14u", seek_limits[b - 1]);
+        else printf("  %6u - %-7u", seek_limits[b - 1] + 1, seek_limits[b]);
+        printf(" %10llu\n", (unsigned long long)seek_hist[b]);
+    }
+
+    // blocos mais acessados
+    block_heat_t *heat = calloc(max_block + 1, sizeof(block_heat_t));
+    if (heat) {
+        for (uint32_t b = 0; b <= max_block; b++) heat[b].block = b;
+        for (uint64_t i = 0; i < header.count; i++) {
+            trace_record_t *r = &records[i];
+            if (r->op != TRACE_READ && r->op != TRACE_WRITE) continue;
+            uint32_t nblocks = (r->size + header.block_size - 1) / header.block_size;
+            for (uint32_t k = 0; k < nblocks; k++) {
+                if (r->op == TRACE_READ) heat[r->target + k].reads++;
+                else heat[r->target + k].writes++;
+            }
+        }
+        qsort(heat, max_block + 1, sizeof(block_heat_t), cmp_heat);
+
+        printf("\nBlocos mais acessados\n");
+        printf("  %10s %10s %10s\n", "bloco", "leituras", "escritas");
+        for (int i = 0; i < top && i <= (int)max_block; i++) {
+            if (heat[i].reads + heat[i].writes == 0) break;
+            printf("  %10u %10u %10u\n", heat[i].block, heat[i].reads, heat[i].writes);
+        }
+        free(heat);
+    }
+
+    free(records);
+    return 0;
+}
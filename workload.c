@@ -0,0 +1,433 @@
+// workload.c
+// Gerador de cargas sobre a API cmd_* numa imagem temporária, com
+// personalidades (mail, fileserver, metastorm) e reprodução de logs
+// gravados com './cmd -l'. Reporta vazão e latências de cauda.
+//
+//   gcc -O2 workload.c fs.c -o workload
+//   ./workload -w mail -n 5000
+//   ./workload -r comandos.log
+#include "fs.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#define DEFAULT_OPS 2000
+#define MAX_CLASSES 8
+#define MAX_PATH_LEN 256
+#define MAX_CONTENT (512 * 1024)
+#define MAX_LINE 256
+
+typedef struct {
+    char name[16];
+    int weight;
+    uint64_t *lat;
+    int ops, cap, errors;
+} op_class_t;
+
+typedef struct {
+    char path[MAX_PATH_LEN];
+    size_t size;
+    int depth;
+} pool_entry_t;
+
+typedef struct {
+    pool_entry_t *items;
+    int count, cap;
+} pool_t;
+
+static op_class_t classes[MAX_CLASSES];
+static int class_count = 0;
+static int total_ops = DEFAULT_OPS;
+static int real_sync = 0;
+
+static pool_t files, dirs;
+static int name_seq = 0;
+static char *content;   // MAX_CONTENT letras terminadas em '\0'
+static const int uid = ROOT_UID;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t percentile(const uint64_t *sorted, int n, double p) {
+    if (n == 0) return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+/* ---- Classes de operação ---- */
+static int add_class(const char *name, int weight) {
+    for (int i = 0; i < class_count; i++)
+        if (strcmp(classes[i].name, name) == 0) return i;
+    if (class_count == MAX_CLASSES) return MAX_CLASSES - 1;
+    op_class_t *c = &classes[class_count];
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->weight = weight;
+    c->lat = NULL;
+    c->ops = c->cap = c->errors = 0;
+    return class_count++;
+}
+
+static int pick_class(void) {
+    int total = 0;
+    for (int i = 0; i < class_count; i++) total += classes[i].weight;
+    int r = rand() % total;
+    for (int i = 0; i < class_count; i++) {
+        if (r < classes[i].weight) return i;
+        r -= classes[i].weight;
+    }
+    return 0;
+}
+
+static void account(int cls, uint64_t start, int result) {
+    uint64_t elapsed = now_ns() - start;
+    op_class_t *c = &classes[cls];
+    if (c->ops == c->cap) {
+        int cap = c->cap ? c->cap * 2 : 1024;
+        uint64_t *lat = realloc(c->lat, cap * sizeof(uint64_t));
+        if (!lat) return;
+        c->lat = lat;
+        c->cap = cap;
+    }
+    c->lat[c->ops++] = elapsed;
+    if (result != 0) c->errors++;
+}
+
+/* ---- Conjuntos de arquivos e diretórios ---- */
+static pool_entry_t *pool_add(pool_t *p, const char *path, size_t size, int depth) {
+    if (p->count == p->cap) {
+        int cap = p->cap ? p->cap * 2 : 256;
+        pool_entry_t *items = realloc(p->items, cap * sizeof(pool_entry_t));
+        if (!items) return NULL;
+        p->items = items;
+        p->cap = cap;
+    }
+    pool_entry_t *e = &p->items[p->count++];
+    snprintf(e->path, sizeof(e->path), "%s", path);
+    e->size = size;
+    e->depth = depth;
+    return e;
+}
+
+static pool_entry_t *pool_pick(pool_t *p) {
+    return p->count ? &p->items[rand() % p->count] : NULL;
+}
+
+static void pool_remove(pool_t *p, pool_entry_t *e) {
+    *e = p->items[--p->count];
+}
+
+static const char *content_of(size_t size) {
+    if (size > MAX_CONTENT) size = MAX_CONTENT;
+    return content + (MAX_CONTENT - size);
+}
+
+static size_t rand_size(size_t min, size_t max) {
+    return min + (size_t)rand() % (max - min + 1);
+}
+
+/* ---- Personalidades ---- */
+
+/* Spool de e-mail: muitas mensagens pequenas criadas, anexadas,
+ * lidas e apagadas em poucas caixas */
+static void run_mail(void) {
+    int deliver = add_class("deliver", 35);
+    int append = add_class("append", 20);
+    int read = add_class("read", 30);
+    add_class("delete", 15);
+
+    char path[MAX_PATH_LEN];
+    cmd_mkdir(ROOT_INODE, "mail", uid);
+    for (int i = 0; i < 16; i++) {
+        snprintf(path, sizeof(path), "mail/u%d", i);
+        cmd_mkdir(ROOT_INODE, path, uid);
+    }
+
+    static const size_t sizes[] = {512, 1024, 1024, 2048, 2048, 4096, 8192};
+    for (int op = 0; op < total_ops; op++) {
+        int cls = pick_class();
+        pool_entry_t *f = pool_pick(&files);
+        if (!f) cls = deliver;
+
+        uint64_t start = now_ns();
+        if (cls == deliver) {
+            size_t size = sizes[rand() % (sizeof(sizes) / sizeof(sizes[0]))];
+            snprintf(path, sizeof(path), "mail/u%d/m%d", rand() % 16, name_seq++);
+            int res = cmd_echo_arrow(ROOT_INODE, path, content_of(size), uid);
+            account(cls, start, res);
+            if (res == 0) pool_add(&files, path, size, 2);
+        } else if (cls == append) {
+            size_t size = rand_size(256, 1024);
+            int res = cmd_echo_arrow_arrow(ROOT_INODE, f->path, content_of(size), uid);
+            account(cls, start, res);
+            if (res == 0) f->size += size;
+        } else if (cls == read) {
+            account(cls, start, cmd_cat(ROOT_INODE, f->path, uid));
+        } else {
+            int res = cmd_rm(ROOT_INODE, f->path, uid);
+            account(cls, start, res);
+            if (res == 0) pool_remove(&files, f);
+        }
+    }
+}
+
+/* Servidor de arquivos: conjunto estável de arquivos grandes com
+ * leituras inteiras, regravações e anexos */
+static void run_fileserver(void) {
+    int read = add_class("read", 50);
+    int overwrite = add_class("overwrite", 25);
+    int append = add_class("append", 15);
+    add_class("replace", 10);
+
+    char path[MAX_PATH_LEN];
+    for (int i = 0; i < 64; i++) {
+        size_t size = rand_size(64 * 1024, 512 * 1024);
+        snprintf(path, sizeof(path), "srv/d%d/f%d", i % 8, name_seq++);
+        if (cmd_echo_arrow(ROOT_INODE, path, content_of(size), uid) == 0)
+            pool_add(&files, path, size, 2);
+    }
+    flush_fs();
+
+    for (int op = 0; op < total_ops; op++) {
+        int cls = pick_class();
+        pool_entry_t *f = pool_pick(&files);
+        if (!f) break;
+
+        // anexos não deixam um arquivo passar de 1 MiB
+        if (cls == append && f->size > 1024 * 1024) cls = overwrite;
+
+        uint64_t start = now_ns();
+        if (cls == read) {
+            account(cls, start, cmd_cat(ROOT_INODE, f->path, uid));
+        } else if (cls == overwrite) {
+            size_t size = rand_size(16 * 1024, 512 * 1024);
+            int res = cmd_echo_arrow(ROOT_INODE, f->path, content_of(size), uid);
+            account(cls, start, res);
+            if (res == 0) f->size = size;
+        } else if (cls == append) {
+            int res = cmd_echo_arrow_arrow(ROOT_INODE, f->path, content_of(64 * 1024), uid);
+            account(cls, start, res);
+            if (res == 0) f->size += 64 * 1024;
+        } else {
+            // apaga um arquivo e cria outro em seu lugar
+            size_t size = rand_size(64 * 1024, 512 * 1024);
+            snprintf(path, sizeof(path), "srv/d%d/f%d", rand() % 8, name_seq++);
+            int res = cmd_rm(ROOT_INODE, f->path, uid);
+            if (res == 0) res = cmd_echo_arrow(ROOT_INODE, path, content_of(size), uid);
+            account(cls, start, res);
+            snprintf(f->path, sizeof(f->path), "%s", path);
+            f->size = size;
+        }
+    }
+}
+
+/* Tempestade de metadados: árvore profunda crescendo com mkdir/touch,
+ * listagens, resolução de caminhos e remoções */
+#define STORM_MAX_DEPTH 24
+
+static void run_metastorm(void) {
+    int mkdir_c = add_class("mkdir", 30);
+    int touch_c = add_class("touch", 30);
+    int ls_c = add_class("ls", 15);
+    int cd_c = add_class("cd", 15);
+    int rm_c = add_class("rm", 10);
+
+    char path[MAX_PATH_LEN + 16];
+    cmd_mkdir(ROOT_INODE, "tree", uid);
+    pool_add(&dirs, "tree", 0, 1);
+
+    for (int op = 0; op < total_ops; op++) {
+        int cls = pick_class();
+        pool_entry_t *d = pool_pick(&dirs);
+        pool_entry_t *f = pool_pick(&files);
+        if (cls == rm_c && !f) cls = touch_c;
+        if (cls == mkdir_c && d->depth >= STORM_MAX_DEPTH) cls = touch_c;
+
+        uint64_t start = now_ns();
+        if (cls == mkdir_c) {
+            snprintf(path, sizeof(path), "%s/d%d", d->path, name_seq++);
+            int depth = d->depth + 1;
+            int res = cmd_mkdir(ROOT_INODE, path, uid);
+            account(cls, start, res);
+            if (res == 0) pool_add(&dirs, path, 0, depth);
+        } else if (cls == touch_c) {
+            snprintf(path, sizeof(path), "%s/f%d", d->path, name_seq++);
+            int res = cmd_touch(ROOT_INODE, path, uid);
+            account(cls, start, res);
+            if (res == 0) pool_add(&files, path, 0, d->depth + 1);
+        } else if (cls == ls_c) {
+            account(cls, start, cmd_ls(ROOT_INODE, d->path, uid, 0));
+        } else if (cls == cd_c) {
+            int cur = ROOT_INODE;
+            account(cls, start, cmd_cd(&cur, d->path));
+        } else {
+            int res = cmd_rm(ROOT_INODE, f->path, uid);
+            account(cls, start, res);
+            if (res == 0) pool_remove(&files, f);
+        }
+    }
+}
+
+/* Reproduz um log de comandos (formato do modo batch / './cmd -l') */
+static int run_replay(FILE *log) {
+    int current_inode = ROOT_INODE;
+    int replay_uid = ROOT_UID;
+    char line[MAX_LINE], name[16];
+    int replayed = 0;
+
+    while (fgets(line, sizeof(line), log) && replayed < total_ops) {
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\n' || *p == '\0' || *p == '#') continue;
+
+        size_t len = strcspn(p, " \t\n");
+        if (len >= sizeof(name)) len = sizeof(name) - 1;
+        memcpy(name, p, len);
+        name[len] = '\0';
+        int cls = add_class(name, 0);
+
+        uint64_t start = now_ns();
+        int res = cmd_exec(p, &current_inode, &replay_uid);
+        if (res == 1) break;
+        account(cls, start, res);
+        replayed++;
+    }
+    return replayed;
+}
+
+/* ---- Relatório ---- */
+static int count_bits(const unsigned char *bitmap, size_t bytes) {
+    int n = 0;
+    for (size_t i = 0; i < bytes; i++) n += __builtin_popcount(bitmap[i]);
+    return n;
+}
+
+static void report(const char *label, uint64_t elapsed_ns) {
+    int ops = 0, errors = 0;
+    for (int i = 0; i < class_count; i++) {
+        ops += classes[i].ops;
+        errors += classes[i].errors;
+    }
+    double secs = elapsed_ns / 1e9;
+    printf("Workload %s: %d ops em %.2f s (%.0f ops/s), %d falha(s)\n\n",
+           label, ops, secs, secs > 0 ? ops / secs : 0, errors);
+
+    uint64_t *all = malloc((ops ? ops : 1) * sizeof(uint64_t));
+    int all_n = 0;
+
+    printf("%-12s %8s %7s %12s %10s %10s %10s\n", "operação", "ops", "falhas", "ops/s",
+           "p50 us", "p99 us", "p999 us");
+    for (int i = 0; i < class_count; i++) {
+        op_class_t *c = &classes[i];
+        if (c->ops == 0) continue;
+        uint64_t total = 0;
+        for (int k = 0; k < c->ops; k++) {
+            total += c->lat[k];
+            if (all) all[all_n++] = c->lat[k];
+        }
+        qsort(c->lat, c->ops, sizeof(uint64_t), cmp_u64);
+        printf("%-12s %8d %7d %12.0f %10.1f %10.1f %10.1f\n", c->name, c->ops, c->errors,
+               total ? c->ops / (total / 1e9) : 0, percentile(c->lat, c->ops, 0.50) / 1e3,
+               percentile(c->lat, c->ops, 0.99) / 1e3, percentile(c->lat, c->ops, 0.999) / 1e3);
+    }
+    if (all && all_n) {
+        qsort(all, all_n, sizeof(uint64_t), cmp_u64);
+        printf("%-12s %8d %7d %12.0f %10.1f %10.1f %10.1f\n", "total", ops, errors,
+               secs > 0 ? ops / secs : 0, percentile(all, all_n, 0.50) / 1e3,
+               percentile(all, all_n, 0.99) / 1e3, percentile(all, all_n, 0.999) / 1e3);
+    }
+    free(all);
+
+    int used_blocks = count_bits(block_bitmap, computed_block_bitmap_bytes);
+    int used_inodes = count_bits(inode_bitmap, computed_inode_bitmap_bytes);
+    printf("\nOcupação final: %d de %u blocos (%.1f%%), %d de %d inodes (%.1f%%)\n",
+           used_blocks, computed_data_blocks, 100.0 * used_blocks / computed_data_blocks,
+           used_inodes, MAX_INODES, 100.0 * used_inodes / MAX_INODES);
+    printf("E/S: %llu blocos lidos, %llu blocos escritos, %llu fsyncs\n",
+           (unsigned long long)fs_stats.block_reads, (unsigned long long)fs_stats.block_writes,
+           (unsigned long long)fs_stats.fsyncs);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Uso: %s -w mail|fileserver|metastorm [-n ops] [-S semente] [-s]\n", prog);
+    fprintf(stderr, "     %s -r comandos.log [-n ops] [-s]\n", prog);
+    fprintf(stderr, "  -s  mantém fsync por escrita (padrão: sincronização adiada)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *personality = NULL, *replay_path = NULL;
+    unsigned seed = 42;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) personality = argv[++i];
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) replay_path = argv[++i];
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) total_ops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) seed = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "-s") == 0) real_sync = 1;
+        else { usage(argv[0]); return 2; }
+    }
+
+    void (*run)(void) = NULL;
+    if (personality && strcmp(personality, "mail") == 0) run = run_mail;
+    else if (personality && strcmp(personality, "fileserver") == 0) run = run_fileserver;
+    else if (personality && strcmp(personality, "metastorm") == 0) run = run_metastorm;
+    if ((run != NULL) == (replay_path != NULL)) { usage(argv[0]); return 2; }
+    if (total_ops < 1) total_ops = 1;
+    if (replay_path && total_ops == DEFAULT_OPS) total_ops = INT_MAX; // log inteiro
+
+    // o log é aberto antes de trocar de diretório
+    FILE *log = NULL;
+    if (replay_path && !(log = fopen(replay_path, "r"))) { perror(replay_path); return 2; }
+
+    content = malloc(MAX_CONTENT + 1);
+    if (!content) return 2;
+    for (size_t i = 0; i < MAX_CONTENT; i++) content[i] = 'a' + i % 26;
+    content[MAX_CONTENT] = '\0';
+
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) return 2;
+
+    char scratch[] = "/tmp/fsworkload.XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        perror("Erro ao criar diretório temporário");
+        return 2;
+    }
+    fs_verbose = 0;
+    if (init_fs() != 0) return 2;
+    set_deferred_sync(!real_sync);
+    reset_stats();
+    srand(seed);
+
+    // cat e ls escrevem na saída padrão: descarta durante a execução
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+
+    uint64_t start = now_ns();
+    if (run) run();
+    else run_replay(log);
+    flush_fs();
+    uint64_t elapsed = now_ns() - start;
+
+    fflush(stdout);
+    if (saved_stdout >= 0) dup2(saved_stdout, STDOUT_FILENO);
+    if (devnull >= 0) close(devnull);
+
+    report(run ? personality : replay_path, elapsed);
+
+    unmount_fs();
+    unlink(DISK_NAME);
+    if (chdir(cwd) == 0) rmdir(scratch);
+    if (log) fclose(log);
+    return 0;
+}